@@ -1,6 +1,6 @@
 #version 410 core
 
-in vec2 v_UV;
+in vec2 v_ColorUV;
 in vec2 v_GlobalUV;
 in float v_Elevation;
 out vec4 FragColor;
@@ -12,7 +12,7 @@ const float PI = 3.14159265359;
 
 void main()
 {
-    vec4 texColor = texture(u_ColorTexture, v_UV);
+    vec4 texColor = texture(u_ColorTexture, v_ColorUV);
 
     if (u_ShowGrid)
     {
@@ -1,35 +1,64 @@
 #version 410 core
 
-layout(location = 0) in vec3 a_Position;
-layout(location = 1) in vec2 a_UV;
+// Fixed point tile UV (UV_SCALE steps per tile) and skirt flag, see Vertex in Mesh.hpp
+layout(location = 0) in vec2 a_UV;
+layout(location = 1) in float a_Skirt;
 
 uniform mat4 u_ViewProjection;
 uniform int u_TileX;
 uniform int u_TileY;
 uniform int u_TileZ;
 uniform sampler2D u_ElevationTexture;
+// Parts of the color and elevation textures this tile covers: xy scale, zw offset. Tiles whose own
+// textures haven't arrived, or are past the terrain's max zoom, use a sub-rectangle of an ancestor's.
+uniform vec4 u_ColorRect;
+uniform vec4 u_ElevationRect;
 
 out vec2 v_UV;
+out vec2 v_ColorUV;
 out vec2 v_GlobalUV;
 out float v_Elevation;
 
 const float PI = 3.14159265359;
 const float EARTH_RADIUS = 6371000.0;
+const float UV_SCALE = 32768.0;
+
+float DecodeElevation(ivec2 texel)
+{
+    vec4 color = texelFetch(u_ElevationTexture, texel, 0);
+    float r = round(color.r * 255.0);
+    float g = round(color.g * 255.0);
+    float b = round(color.b * 255.0);
+    return -10000.0 + ((r * 65536.0 + g * 256.0 + b) * 0.1);
+}
+
+// Texel i sits at uv = i / size, matching TerrainMesh::DecodeHeights, so vertices of a full tile land
+// on texels exactly. Interpolating decoded heights keeps magnified ancestor tiles smooth where filtering
+// the encoded bytes would not.
+float SampleElevation(vec2 uv)
+{
+    ivec2 size = textureSize(u_ElevationTexture, 0);
+    vec2 position = uv * vec2(size);
+    ivec2 i0 = clamp(ivec2(floor(position)), ivec2(0), size - 1);
+    ivec2 i1 = min(i0 + 1, size - 1);
+    vec2 f = fract(position);
+
+    float h00 = DecodeElevation(i0);
+    float h10 = DecodeElevation(ivec2(i1.x, i0.y));
+    float h01 = DecodeElevation(ivec2(i0.x, i1.y));
+    float h11 = DecodeElevation(i1);
+    return mix(mix(h00, h10, f.x), mix(h01, h11, f.x), f.y);
+}
 
 void main()
 {
-    v_UV = a_UV;
+    v_UV = a_UV / UV_SCALE;
+    v_ColorUV = v_UV * u_ColorRect.xy + u_ColorRect.zw;
 
     float scale = 1.0 / pow(2.0, float(u_TileZ));
-    v_GlobalUV = (a_UV + vec2(float(u_TileX), float(u_TileY))) * scale;
+    v_GlobalUV = (v_UV + vec2(float(u_TileX), float(u_TileY))) * scale;
 
-    // Sample elevation
-    vec4 color = texture(u_ElevationTexture, v_UV);
-    float r = round(color.r * 255.0);
-    float g = round(color.g * 255.0);
-    float b = round(color.b * 255.0);
-    
-    float elevation = -10000.0 + ((r * 65536.0 + g * 256.0 + b) * 0.1);
+    float elevation = SampleElevation(v_UV * u_ElevationRect.xy + u_ElevationRect.zw);
     v_Elevation = elevation;
 
     // Mercator Projection to Sphere Position
@@ -45,6 +74,10 @@ void main()
     float cosLat = cos(latitude);
     float radius = 1.0 + (elevation / EARTH_RADIUS);
 
+    // Skirt vertices hang below the edge to cover cracks against neighbours of different detail
+    if (a_Skirt > 0.0)
+        radius -= 2.0 * PI * scale * 0.02;
+
     float x = radius * cosLat * sin(longitude);
     float y = radius * sin(latitude);
     float z = radius * cosLat * cos(longitude);
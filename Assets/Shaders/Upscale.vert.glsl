@@ -0,0 +1,11 @@
+#version 410 core
+
+// Full-screen triangle generated from the vertex ID, so no vertex buffer is needed
+out vec2 v_UV;
+
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    v_UV = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
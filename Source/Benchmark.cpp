@@ -0,0 +1,356 @@
+#include "Image.hpp"
+#include "ImageDecoder.hpp"
+#include "Mercator.hpp"
+#include "Mesh.hpp"
+#include "Mipmap.hpp"
+#include "TerrainMesh.hpp"
+#include "TextureCompression.hpp"
+#include "VertexCache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <print>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::string Mode;
+        // A z/x/y directory tree, as written by earth-seed, or any directory of images to decode
+        std::string Tiles;
+        float ErrorPixels = 2.0f;
+        int Iterations = 5;
+    };
+
+    struct TileFile
+    {
+        int X = 0, Y = 0, Z = 0;
+        std::vector<unsigned char> Bytes;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    void PrintUsage()
+    {
+        std::println(stderr, "Times the tile pipeline on a fixed set of tiles, so changes can be compared on");
+        std::println(stderr, "identical input.");
+        std::println(stderr, "");
+        std::println(stderr, "Usage: earth-bench mesh --tiles <z/x/y directory> [--error <pixels>] [--iterations <n>]");
+        std::println(stderr, "       earth-bench decode --tiles <directory> [--iterations <n>]");
+        std::println(stderr, "       earth-bench check");
+        std::println(stderr, "");
+        std::println(stderr, "  mesh    Builds terrain meshes from Terrain-RGB tiles and reports build time and the");
+        std::println(stderr, "          vertex cache miss ratio, along with the plane mesh's.");
+        std::println(stderr, "  decode  Decodes every image in the directory and reports throughput per decoder.");
+        std::println(stderr, "  check   Compares BC1 output against known blocks and level sizes, and fails on a");
+        std::println(stderr, "          mismatch.");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& options)
+    {
+        if (argc < 2)
+            return false;
+        options.Mode = argv[1];
+
+        for (int i = 2; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc)
+                return false;
+            std::string value = argv[++i];
+
+            if (arg == "--tiles")
+                options.Tiles = value;
+            else if (arg == "--error")
+                options.ErrorPixels = std::stof(value);
+            else if (arg == "--iterations")
+                options.Iterations = std::max(1, std::stoi(value));
+            else
+                return false;
+        }
+
+        if (options.Mode == "check")
+            return true;
+        return (options.Mode == "mesh" || options.Mode == "decode") && !options.Tiles.empty();
+    }
+
+    // Every z/x/y.* file under `root`, in key order so runs see the same sequence. Without
+    // `requireKeys`, other files are read as well, keyed 0/0/0 and ordered by path.
+    std::vector<TileFile> ReadTiles(const std::filesystem::path& root, bool requireKeys)
+    {
+        std::vector<std::filesystem::path> paths;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(root))
+        {
+            if (entry.is_regular_file())
+                paths.push_back(entry.path());
+        }
+        std::sort(paths.begin(), paths.end());
+
+        std::vector<TileFile> tiles;
+        for (const std::filesystem::path& path : paths)
+        {
+            std::vector<std::string> parts;
+            for (const auto& part : std::filesystem::relative(path, root).parent_path())
+                parts.push_back(part.string());
+
+            TileFile tile;
+            try
+            {
+                if (parts.size() != 2)
+                    throw std::invalid_argument("Not a z/x/y path");
+                tile.Z = std::stoi(parts[0]);
+                tile.X = std::stoi(parts[1]);
+                tile.Y = std::stoi(path.stem().string());
+            }
+            catch (const std::exception&)
+            {
+                if (requireKeys)
+                    continue;
+                tile = {};
+            }
+
+            std::ifstream file(path, std::ios::binary);
+            tile.Bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            tiles.push_back(std::move(tile));
+        }
+
+        std::stable_sort(tiles.begin(), tiles.end(), [](const TileFile& a, const TileFile& b) {
+            return std::tie(a.Z, a.X, a.Y) < std::tie(b.Z, b.X, b.Y);
+        });
+        return tiles;
+    }
+
+    float GetACMR(const Earth::Mesh& mesh)
+    {
+        size_t triangles = mesh.Indices.size() / 3;
+        return triangles ? (float)Earth::VertexCache::CountMisses(mesh.Indices, mesh.Vertices.size()) / triangles
+                         : 0.0f;
+    }
+
+    void BenchmarkMeshes(const Options& options, const std::vector<TileFile>& tiles)
+    {
+        Earth::Mesh plane = Earth::Mercator::GeneratePlaneMesh(64);
+        float planeBefore = GetACMR(plane);
+        Earth::VertexCache::Optimize(plane.Indices, plane.Vertices.size());
+        std::println("Plane mesh: {} triangles, ACMR {:.3f} ({:.3f} unoptimized)", plane.Indices.size() / 3,
+                     GetACMR(plane), planeBefore);
+
+        // Decoding isn't part of what is timed.
+        std::vector<std::vector<float>> heights;
+        std::vector<float> maxErrors;
+        for (const TileFile& tile : tiles)
+        {
+            try
+            {
+                heights.push_back(Earth::TerrainMesh::DecodeHeights(Earth::Image(tile.Bytes)));
+                maxErrors.push_back(Earth::TerrainMesh::GetMaxError(tile.Y, tile.Z, options.ErrorPixels));
+            }
+            catch (const std::exception& e)
+            {
+                std::println(stderr, "Skipping {}/{}/{}: {}", tile.Z, tile.X, tile.Y, e.what());
+            }
+        }
+        if (heights.empty())
+        {
+            std::println(stderr, "No terrain tiles to mesh");
+            return;
+        }
+
+        // The miss ratio comes from a pass of its own, as measuring it slows the optimizer down.
+        Earth::VertexCache::SetMeasuring(true);
+        size_t triangles = 0;
+        for (size_t i = 0; i < heights.size(); ++i)
+            triangles += Earth::TerrainMesh::Build(heights[i], maxErrors[i]).Indices.size() / 3;
+        Earth::VertexCache::SetMeasuring(false);
+
+        double bestMs = 0.0;
+        for (int iteration = 0; iteration < options.Iterations; ++iteration)
+        {
+            auto start = Clock::now();
+            for (size_t i = 0; i < heights.size(); ++i)
+                Earth::TerrainMesh::Build(heights[i], maxErrors[i]);
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            bestMs = iteration == 0 ? ms : std::min(bestMs, ms);
+        }
+
+        const auto& stats = Earth::VertexCache::GetStats();
+        std::println("Terrain meshes: {} tiles, {} triangles at {} px, ACMR {:.3f} ({:.3f} unoptimized)",
+                     heights.size(), triangles, options.ErrorPixels, stats.GetACMRAfter(), stats.GetACMRBefore());
+        std::println("Build time: {:.3f} ms/tile, best of {} runs", bestMs / heights.size(), options.Iterations);
+    }
+
+    void BenchmarkDecoders(const Options& options, const std::vector<TileFile>& tiles)
+    {
+        struct Input
+        {
+            std::span<const unsigned char> Bytes;
+            int Width = 0, Height = 0;
+        };
+
+        // Grouped by the decoder Image would pick, in the order they are tried.
+        std::map<Earth::ImageDecoder*, std::vector<Input>> inputs;
+        for (const TileFile& tile : tiles)
+        {
+            Earth::ImageDecoder* decoder = Earth::ImageDecoders::Find(tile.Bytes);
+            if (!decoder)
+                continue;
+
+            Input input{tile.Bytes};
+            try
+            {
+                decoder->GetInfo(input.Bytes, input.Width, input.Height);
+            }
+            catch (const std::exception&)
+            {
+                continue;
+            }
+            inputs[decoder].push_back(input);
+        }
+        if (inputs.empty())
+        {
+            std::println(stderr, "No images to decode");
+            return;
+        }
+
+        std::vector<unsigned char> output;
+        for (const auto& decoder : Earth::ImageDecoders::GetAll())
+        {
+            auto it = inputs.find(decoder.get());
+            if (it == inputs.end())
+                continue;
+
+            double megapixels = 0.0;
+            for (const Input& input : it->second)
+                megapixels += (double)input.Width * input.Height / 1e6;
+
+            double bestMs = 0.0;
+            for (int iteration = 0; iteration < options.Iterations; ++iteration)
+            {
+                auto start = Clock::now();
+                for (const Input& input : it->second)
+                {
+                    output.resize((size_t)input.Width * input.Height * 4);
+                    decoder->Decode(input.Bytes, output, false);
+                }
+                double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                bestMs = iteration == 0 ? ms : std::min(bestMs, ms);
+            }
+
+            std::println("{}: {} images, {:.1f} MP, {:.1f} MP/s, {:.3f} ms/image, best of {} runs", decoder->GetName(),
+                         it->second.size(), megapixels, megapixels * 1000.0 / bestMs, bestMs / it->second.size(),
+                         options.Iterations);
+        }
+    }
+
+    std::string ToHex(const std::vector<unsigned char>& bytes)
+    {
+        std::string hex;
+        for (unsigned char byte : bytes)
+            hex += std::format("{:02x}", byte);
+        return hex;
+    }
+
+    bool CheckBC1()
+    {
+        // Left half red, right half blue, both exact in RGB565. The only lossless opaque encoding has
+        // red as color 0 and blue as color 1, as color 0 > color 1 selects the four-color mode, and
+        // indices 0 0 1 1 on every row.
+        Earth::TextureData block;
+        block.Levels.push_back({4, 4, {}});
+        for (int i = 0; i < 16; ++i)
+        {
+            unsigned char red = i % 4 < 2 ? 255 : 0;
+            block.Levels[0].Data.insert(block.Levels[0].Data.end(), {red, 0, (unsigned char)(255 - red), 255});
+        }
+
+        const std::vector<unsigned char> expected = {0x00, 0xf8, 0x1f, 0x00, 0x50, 0x50, 0x50, 0x50};
+        std::vector<unsigned char> actual = Earth::TextureCompression::CompressBC1(block).Levels[0].Data;
+        if (actual != expected)
+        {
+            std::println(stderr, "BC1 block: expected {}, got {}", ToHex(expected), ToHex(actual));
+            return false;
+        }
+        std::println("BC1 block: endpoints and indices match");
+
+        // A chain down to 1x1 has levels narrower than a block in one or both directions.
+        Earth::TextureData texture;
+        texture.Levels.push_back({13, 7, std::vector<unsigned char>(13 * 7 * 4, 128)});
+        Earth::Mipmap::Generate(texture);
+        Earth::TextureData compressed = Earth::TextureCompression::CompressBC1(texture);
+        for (size_t i = 0; i < compressed.Levels.size(); ++i)
+        {
+            const Earth::TextureLevel& level = compressed.Levels[i];
+            size_t size = (size_t)std::max(1, (level.Width + 3) / 4) * std::max(1, (level.Height + 3) / 4) * 8;
+            if (level.Data.size() != size)
+            {
+                std::println(stderr, "BC1 level {} ({}x{}): expected {} bytes, got {}", i, level.Width, level.Height,
+                             size, level.Data.size());
+                return false;
+            }
+        }
+        std::println("BC1 levels: {} levels from {}x{}, sizes match", compressed.Levels.size(), texture.Levels[0].Width,
+                     texture.Levels[0].Height);
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    try
+    {
+        if (!ParseOptions(argc, argv, options))
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+    catch (const std::exception&)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (options.Mode == "check")
+    {
+        try
+        {
+            return CheckBC1() ? 0 : 1;
+        }
+        catch (const std::exception& e)
+        {
+            std::println(stderr, "{}", e.what());
+            return 1;
+        }
+    }
+
+    try
+    {
+        bool meshes = options.Mode == "mesh";
+        std::vector<TileFile> tiles = ReadTiles(options.Tiles, meshes);
+        if (tiles.empty())
+            throw std::runtime_error("No tiles in " + options.Tiles);
+        std::println("Read {} tiles from {}", tiles.size(), options.Tiles);
+
+        if (meshes)
+            BenchmarkMeshes(options, tiles);
+        else
+            BenchmarkDecoders(options, tiles);
+    }
+    catch (const std::exception& e)
+    {
+        std::println(stderr, "{}", e.what());
+        return 1;
+    }
+    return 0;
+}
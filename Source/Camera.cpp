@@ -1,10 +1,14 @@
 #include "Camera.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <glm/gtc/matrix_transform.hpp>
 
 namespace Earth
 {
+    // Fraction of the remaining zoom covered per second is 1 - exp(-ZOOM_RATE)
+    static constexpr float ZOOM_RATE = 15.0f;
+
     Camera::Camera(float width, float height) : m_Width(width), m_Height(height)
     {
         UpdateViewMatrix();
@@ -12,17 +16,23 @@ namespace Earth
 
     void Camera::Update(float deltaTime)
     {
-        // Smooth movement could go here
+        if (m_Range == m_TargetRange)
+            return;
+
+        // Ease towards the target range, snapping once the difference is invisible
+        m_Range = m_TargetRange + (m_Range - m_TargetRange) * std::exp(-ZOOM_RATE * deltaTime);
+        if (std::abs(m_Range - m_TargetRange) < m_TargetRange * 0.001f)
+            m_Range = m_TargetRange;
+        UpdateViewMatrix();
     }
 
     void Camera::HandleEvent(const SDL_Event& event)
     {
         if (event.type == SDL_EVENT_MOUSE_WHEEL)
         {
-            float zoomSpeed = std::max(0.00001f, m_Range * 0.1f);
-            m_Range -= event.wheel.y * zoomSpeed;
-            m_Range = std::max(0.00001f, std::min(m_Range, 9.0f));
-            UpdateViewMatrix();
+            float zoomSpeed = std::max(0.00001f, m_TargetRange * 0.1f);
+            m_TargetRange -= event.wheel.y * zoomSpeed;
+            m_TargetRange = std::max(0.00001f, std::min(m_TargetRange, 9.0f));
         }
         else if (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN)
         {
@@ -116,6 +126,7 @@ namespace Earth
         m_TargetLon = targetLon;
         m_TargetLat = targetLat;
         m_Range = range;
+        m_TargetRange = range;
         m_Heading = heading;
         m_Tilt = tilt;
         UpdateViewMatrix();
@@ -128,10 +139,12 @@ namespace Earth
 
         glm::vec3 offset = position - m_TargetPosition;
         m_Range = glm::length(offset);
+        m_TargetRange = m_Range;
 
         if (m_Range < 0.00001f)
         {
             m_Range = 0.00001f;
+            m_TargetRange = m_Range;
             UpdateViewMatrix();
             return;
         }
@@ -193,6 +206,7 @@ namespace Earth
         m_TargetLon = lon;
         m_TargetLat = lat;
         m_Range = alt;
+        m_TargetRange = alt;
         UpdateViewMatrix();
     }
 
@@ -201,6 +215,34 @@ namespace Earth
         return m_ViewMatrix;
     }
 
+    Ray Camera::GetRay(float x, float y) const
+    {
+        glm::dmat4 inverse = glm::inverse(glm::dmat4(GetProjectionMatrix() * GetViewMatrix()));
+        double ndcX = 2.0 * x / m_Width - 1.0;
+        double ndcY = 1.0 - 2.0 * y / m_Height;
+        glm::dvec4 farPoint = inverse * glm::dvec4(ndcX, ndcY, 1.0, 1.0);
+
+        glm::dvec3 origin(m_Position);
+        return {origin, glm::normalize(glm::dvec3(farPoint) / farPoint.w - origin)};
+    }
+
+    void Camera::KeepAbove(float radius)
+    {
+        if (glm::length(m_Position) >= radius)
+            return;
+
+        // Solve |target + direction * range| = radius for the range along the current view direction
+        glm::vec3 direction = glm::normalize(m_Position - m_TargetPosition);
+        float b = glm::dot(m_TargetPosition, direction);
+        float c = glm::dot(m_TargetPosition, m_TargetPosition) - radius * radius;
+        float range = -b + std::sqrt(std::max(b * b - c, 0.0f));
+
+        m_Range = std::max(m_Range, range);
+        // Otherwise a zoom animation would keep pulling the camera back in
+        m_TargetRange = std::max(m_TargetRange, m_Range);
+        UpdateViewMatrix();
+    }
+
     glm::mat4 Camera::GetProjectionMatrix() const
     {
         float nearPlane = std::max(0.000001f, m_Range * 0.1f);
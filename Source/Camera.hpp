@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Ray.hpp"
+
 #include <SDL3/SDL_events.h>
 #include <array>
 #include <glm/glm.hpp>
@@ -18,13 +20,24 @@ namespace Earth
       public:
         Camera(float width, float height);
 
+        // Advances camera animation by `deltaTime` seconds.
         void Update(float deltaTime);
+        bool IsAnimating() const
+        {
+            return m_Range != m_TargetRange;
+        }
         void HandleEvent(const SDL_Event& event);
         void Resize(float width, float height);
 
         glm::mat4 GetViewMatrix() const;
         glm::mat4 GetProjectionMatrix() const;
         Frustum GetFrustum() const;
+        // Ray from the eye through a point of the viewport, in pixels from its top left.
+        Ray GetRay(float x, float y) const;
+
+        // Backs the camera away from its target until it is at least `radius` from the globe's
+        // center, so it can't sink into the terrain below it.
+        void KeepAbove(float radius);
 
         float GetWidth() const
         {
@@ -86,6 +99,7 @@ namespace Earth
 
         // Orbit parameters
         float m_Range = 2.0f; // Distance from Target
+        float m_TargetRange = 2.0f; // Range the zoom animation is heading to
         float m_TargetLon = 0.0f;
         float m_TargetLat = 0.0f;
         float m_Heading = 0.0f;
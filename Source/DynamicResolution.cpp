@@ -0,0 +1,174 @@
+#include "DynamicResolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Earth
+{
+    namespace
+    {
+        // Weight of each new measurement in the smoothed scene time
+        constexpr float SMOOTHING = 0.2f;
+        // Scale changes smaller than this are skipped, so the image doesn't shimmer while it settles.
+        constexpr float DEADBAND = 0.03f;
+        // Frames the GPU may lag behind before frames go untimed
+        constexpr size_t MAX_PENDING_QUERIES = 8;
+    }
+
+    DynamicResolution::DynamicResolution(int width, int height)
+        : m_Scene(width, height), m_Output(width, height),
+          m_UpscaleShader{"Assets/Shaders/Upscale.vert.glsl", "Assets/Shaders/Upscale.frag.glsl"}
+    {
+        GLint bits = 0;
+        glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &bits);
+        m_HasGPUTimers = bits > 0;
+
+        glGenVertexArrays(1, &m_VertexArray);
+    }
+
+    DynamicResolution::~DynamicResolution()
+    {
+        for (const auto& pending : m_PendingQueries)
+            glDeleteQueries(1, &pending.Query);
+        if (!m_FreeQueries.empty())
+            glDeleteQueries((GLsizei)m_FreeQueries.size(), m_FreeQueries.data());
+        glDeleteVertexArrays(1, &m_VertexArray);
+    }
+
+    void DynamicResolution::Resize(int width, int height)
+    {
+        m_Scene.Resize(width, height);
+        m_Output.Resize(width, height);
+    }
+
+    void DynamicResolution::SetEnabled(bool enabled)
+    {
+        float from = GetScale();
+        m_Enabled = enabled;
+        RescaleSceneMs(from);
+    }
+
+    void DynamicResolution::SetScaleRange(float minScale, float maxScale)
+    {
+        float from = GetScale();
+        m_MinScale = std::clamp(minScale, MIN_SCALE, MAX_SCALE);
+        m_MaxScale = std::clamp(maxScale, m_MinScale, MAX_SCALE);
+        m_Scale = std::clamp(m_Scale, m_MinScale, m_MaxScale);
+        RescaleSceneMs(from);
+    }
+
+    void DynamicResolution::RescaleSceneMs(float from)
+    {
+        float ratio = GetScale() / from;
+        m_SceneMs *= ratio * ratio;
+    }
+
+    int DynamicResolution::GetSceneWidth() const
+    {
+        return std::max(1, (int)(GetWidth() * GetScale() + 0.5f));
+    }
+
+    int DynamicResolution::GetSceneHeight() const
+    {
+        return std::max(1, (int)(GetHeight() * GetScale() + 0.5f));
+    }
+
+    GLuint DynamicResolution::GetTextureID() const
+    {
+        return IsUpscaled() ? m_Output.GetTextureID() : m_Scene.GetTextureID();
+    }
+
+    void DynamicResolution::BeginScene()
+    {
+        m_Scene.Bind();
+        glViewport(0, 0, GetSceneWidth(), GetSceneHeight());
+
+        if (m_HasGPUTimers && m_PendingQueries.size() < MAX_PENDING_QUERIES)
+        {
+            GLuint query = 0;
+            if (m_FreeQueries.empty())
+            {
+                glGenQueries(1, &query);
+            }
+            else
+            {
+                query = m_FreeQueries.back();
+                m_FreeQueries.pop_back();
+            }
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            m_PendingQueries.push_back({query, GetScale()});
+            m_QueryActive = true;
+        }
+    }
+
+    void DynamicResolution::EndScene()
+    {
+        if (m_QueryActive)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            m_QueryActive = false;
+        }
+
+        if (!IsUpscaled())
+        {
+            m_Scene.Unbind();
+            UpdateScale();
+            return;
+        }
+
+        m_Output.Bind();
+        glDisable(GL_DEPTH_TEST);
+
+        m_UpscaleShader.Bind();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_Scene.GetTextureID());
+        m_UpscaleShader.SetInt("u_Scene", 0);
+        m_UpscaleShader.SetFloat2("u_SourceSize", glm::vec2(GetSceneWidth(), GetSceneHeight()));
+
+        glBindVertexArray(m_VertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+
+        glEnable(GL_DEPTH_TEST);
+        m_Output.Unbind();
+
+        UpdateScale();
+    }
+
+    void DynamicResolution::UpdateScale()
+    {
+        // Queries finish in submission order, so stop at the first one that isn't ready.
+        size_t completed = 0;
+        for (const auto& pending : m_PendingQueries)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(pending.Query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(pending.Query, GL_QUERY_RESULT, &nanoseconds);
+
+            // What the frame would have taken at the scale frames render at now
+            float ratio = GetScale() / pending.Scale;
+            float milliseconds = (float)(nanoseconds / 1.0e6) * ratio * ratio;
+            m_SceneMs = m_SceneMs > 0.0f ? m_SceneMs + (milliseconds - m_SceneMs) * SMOOTHING : milliseconds;
+
+            m_FreeQueries.push_back(pending.Query);
+            completed++;
+        }
+        m_PendingQueries.erase(m_PendingQueries.begin(), m_PendingQueries.begin() + completed);
+
+        if (!m_Enabled || completed == 0 || m_SceneMs <= 0.0f)
+            return;
+
+        float scale = std::clamp(m_Scale * std::sqrt(m_TargetMs / m_SceneMs), m_MinScale, m_MaxScale);
+        bool atLimit = scale == m_MinScale || scale == m_MaxScale;
+        if (std::abs(scale - m_Scale) < DEADBAND && !(atLimit && scale != m_Scale))
+            return;
+
+        float ratio = scale / m_Scale;
+        m_SceneMs *= ratio * ratio;
+        m_Scale = scale;
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Framebuffer.hpp"
+#include "GL.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace Earth
+{
+    // Renders the scene into part of a framebuffer, a fraction of the output size on each axis, and
+    // upscales it to the output with a Catmull-Rom filter. The fraction follows the scene's GPU time:
+    // fill cost goes with the pixel count, so it moves by the square root of target over measured time.
+    // Without GL timer queries, or while disabled, the scene renders at full size.
+    class DynamicResolution
+    {
+      public:
+        static constexpr float MIN_SCALE = 0.25f;
+        static constexpr float MAX_SCALE = 1.0f;
+
+        DynamicResolution(int width, int height);
+        ~DynamicResolution();
+
+        DynamicResolution(const DynamicResolution&) = delete;
+        DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+        // Sets the output size.
+        void Resize(int width, int height);
+
+        // Binds the scene framebuffer with a viewport of the current scene size and starts timing.
+        void BeginScene();
+        // Stops timing and upscales the scene into the output, unless it was rendered at full size.
+        void EndScene();
+
+        // The output texture, at the output size.
+        GLuint GetTextureID() const;
+        int GetWidth() const
+        {
+            return m_Output.GetWidth();
+        }
+        int GetHeight() const
+        {
+            return m_Output.GetHeight();
+        }
+        int GetSceneWidth() const;
+        int GetSceneHeight() const;
+
+        bool IsEnabled() const
+        {
+            return m_Enabled;
+        }
+        void SetEnabled(bool enabled);
+        // GPU time the scene should take.
+        void SetTargetMs(float milliseconds)
+        {
+            m_TargetMs = milliseconds;
+        }
+        // Clamped to [MIN_SCALE, MAX_SCALE].
+        void SetScaleRange(float minScale, float maxScale);
+
+        float GetScale() const
+        {
+            return m_Enabled && m_HasGPUTimers ? m_Scale : 1.0f;
+        }
+        // Smoothed GPU time of the scene at the scale it renders at now, 0 until the first measurement
+        // arrives.
+        float GetSceneMs() const
+        {
+            return m_SceneMs;
+        }
+        bool HasGPUTimers() const
+        {
+            return m_HasGPUTimers;
+        }
+
+      private:
+        struct PendingQuery
+        {
+            GLuint Query;
+            // The scale the timed frame was rendered at, which is 1 while disabled.
+            float Scale;
+        };
+
+        // Collects finished timings and moves the scale towards the target. Runs after the scene so the
+        // scale holds from one EndScene to the next, and the texture shown matches the frame drawn.
+        void UpdateScale();
+        // Keeps the smoothed scene time in step when the scale frames render at changes from `from`.
+        void RescaleSceneMs(float from);
+        bool IsUpscaled() const
+        {
+            return GetSceneWidth() != GetWidth() || GetSceneHeight() != GetHeight();
+        }
+
+        Framebuffer m_Scene;
+        Framebuffer m_Output;
+        Shader m_UpscaleShader;
+        // Core profiles need a vertex array bound even for the attribute-less full-screen triangle.
+        GLuint m_VertexArray = 0;
+
+        std::vector<PendingQuery> m_PendingQueries;
+        std::vector<GLuint> m_FreeQueries;
+        bool m_HasGPUTimers = false;
+        bool m_QueryActive = false;
+
+        bool m_Enabled = true;
+        float m_TargetMs = 8.0f;
+        float m_MinScale = 0.5f;
+        float m_MaxScale = 1.0f;
+        float m_Scale = 1.0f;
+        float m_SceneMs = 0.0f;
+    };
+}
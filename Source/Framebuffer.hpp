@@ -1,6 +1,6 @@
 #pragma once
 
-#include <OpenGL/gl3.h>
+#include "GL.hpp"
 
 namespace Earth
 {
@@ -0,0 +1,11 @@
+#pragma once
+
+// OpenGL 4.1 core declarations. macOS ships them in its framework. Elsewhere the system headers
+// declare them, and libGL exports every function the renderer uses, Mesa's software drivers included.
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
@@ -2,115 +2,407 @@
 
 #include <curl/curl.h>
 
+#include <algorithm>
+#include <cctype>
 #include <format>
+#include <memory>
 #include <print>
+#include <random>
 #include <stdexcept>
+#include <string_view>
+#include <thread>
 
 namespace
 {
-    size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp)
-    {
-        ((std::string*)userp)->append((char*)contents, size * nmemb);
-        return size * nmemb;
-    }
-}
+    using Clock = std::chrono::steady_clock;
 
-namespace Earth::HTTP
-{
-    std::string Fetch(const URL& url, std::atomic<bool>* cancelled)
+    size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userp)
     {
-        if (cancelled && *cancelled)
+        std::string_view line(buffer, size * nitems);
+        constexpr std::string_view name = "etag:";
+        if (line.size() > name.size() &&
+            std::equal(name.begin(), name.end(), line.begin(),
+                       [](char a, char b) { return a == std::tolower((unsigned char)b); }))
         {
-            throw std::runtime_error("Request cancelled");
+            line.remove_prefix(name.size());
+            while (!line.empty() && std::isspace((unsigned char)line.front()))
+                line.remove_prefix(1);
+            while (!line.empty() && std::isspace((unsigned char)line.back()))
+                line.remove_suffix(1);
+            *(std::string*)userp = std::string(line);
         }
+        return size * nitems;
+    }
 
-        CURLM* multi_handle = curl_multi_init();
-        CURL* curl = curl_easy_init();
-        std::string readBuffer;
+    bool IsRetryable(long status)
+    {
+        return status == 429 || (status >= 500 && status < 600);
+    }
+
+    // One easy handle and the response it is filling in.
+    struct Transfer
+    {
+        CURL* Handle = nullptr;
+        curl_slist* Headers = nullptr;
+        Earth::HTTP::Response Result;
+        Clock::time_point Start = Clock::now();
+        bool Done = false;
 
-        if (curl && multi_handle)
+        Transfer(const Earth::URL& url, const std::string& etag, const Earth::HTTP::SinkFactory& sink)
         {
-            curl_easy_setopt(curl, CURLOPT_URL, url.Get().c_str());
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-            curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+            Handle = curl_easy_init();
+            if (!Handle)
+                throw std::runtime_error("Failed to initialize CURL");
+
+            if (sink)
+                Result.Sink = sink();
+
+            curl_easy_setopt(Handle, CURLOPT_URL, url.Get().c_str());
+            curl_easy_setopt(Handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+            curl_easy_setopt(Handle, CURLOPT_WRITEDATA, this);
+            curl_easy_setopt(Handle, CURLOPT_HEADERFUNCTION, HeaderCallback);
+            curl_easy_setopt(Handle, CURLOPT_HEADERDATA, &Result.ETag);
+            curl_easy_setopt(Handle, CURLOPT_FOLLOWLOCATION, 1L);
             // Set User-Agent to avoid some servers blocking requests
-            curl_easy_setopt(curl, CURLOPT_USERAGENT, "Earth/0.1");
+            curl_easy_setopt(Handle, CURLOPT_USERAGENT, "Earth/0.1");
             // Handle compressed responses
-            curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+            curl_easy_setopt(Handle, CURLOPT_ACCEPT_ENCODING, "");
+
+            if (!etag.empty())
+            {
+                Headers = curl_slist_append(Headers, std::format("If-None-Match: {}", etag).c_str());
+                curl_easy_setopt(Handle, CURLOPT_HTTPHEADER, Headers);
+            }
+        }
+
+        ~Transfer()
+        {
+            curl_easy_cleanup(Handle);
+            curl_slist_free_all(Headers);
+        }
+
+        Transfer(const Transfer&) = delete;
+        Transfer& operator=(const Transfer&) = delete;
+
+        static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp)
+        {
+            Transfer& transfer = *(Transfer*)userp;
+            transfer.Result.Body.append((char*)contents, size * nmemb);
+
+            // Headers are complete by the time the body arrives, so the status is known.
+            if (transfer.Result.Sink)
+            {
+                long status = 0;
+                curl_easy_getinfo(transfer.Handle, CURLINFO_RESPONSE_CODE, &status);
+                if (status == 200)
+                    transfer.Result.Sink->Write({(const unsigned char*)contents, size * nmemb});
+            }
+            return size * nmemb;
+        }
+    };
+
+    // A multi handle driving a primary transfer and, if it is slow, a hedge for the same URL.
+    class Attempt
+    {
+      public:
+        Attempt(const Earth::HTTP::SinkFactory& sink) : m_Sink(sink)
+        {
+            m_Multi = curl_multi_init();
+            if (!m_Multi)
+                throw std::runtime_error("Failed to initialize CURL");
+        }
+
+        ~Attempt()
+        {
+            for (auto& transfer : m_Transfers)
+                curl_multi_remove_handle(m_Multi, transfer->Handle);
+            m_Transfers.clear();
+            curl_multi_cleanup(m_Multi);
+        }
+
+        Attempt(const Attempt&) = delete;
+        Attempt& operator=(const Attempt&) = delete;
 
-            curl_multi_add_handle(multi_handle, curl);
+        void Add(const Earth::URL& url, const std::string& etag)
+        {
+            m_Transfers.push_back(std::make_unique<Transfer>(url, etag, m_Sink));
+            curl_multi_add_handle(m_Multi, m_Transfers.back()->Handle);
+        }
 
-            int still_running = 0;
-            do
+        // Runs until a transfer produces a usable response, the deadline passes or the request is
+        // cancelled. `hedgeAt` is when to add the duplicate; pass time_point::max() to never hedge.
+        Earth::HTTP::Response Run(const Earth::URL& url, const std::string& etag, Clock::time_point hedgeAt,
+                                  Clock::time_point deadline, Earth::HTTP::LatencyTracker* latency,
+                                  std::atomic<bool>* cancelled)
+        {
+            auto& stats = Earth::HTTP::GetStats();
+            std::string lastError;
+            std::unique_ptr<Earth::HTTP::Response> retryable;
+
+            for (;;)
             {
                 if (cancelled && *cancelled)
-                {
-                    curl_multi_remove_handle(multi_handle, curl);
-                    curl_easy_cleanup(curl);
-                    curl_multi_cleanup(multi_handle);
                     throw std::runtime_error("Request cancelled");
-                }
 
-                CURLMcode mc = curl_multi_perform(multi_handle, &still_running);
-                if (mc)
+                Clock::time_point now = Clock::now();
+                if (now >= deadline)
                 {
-                    break;
+                    stats.Timeouts++;
+                    throw std::runtime_error("Request deadline exceeded");
                 }
 
-                if (still_running)
+                if (m_Transfers.size() == 1 && now >= hedgeAt)
                 {
-                    curl_multi_poll(multi_handle, NULL, 0, 100, NULL);
+                    Add(url, etag);
+                    stats.Hedges++;
                 }
-            } while (still_running);
 
-            CURLMsg* msg = nullptr;
-            int msgs_left = 0;
-            while ((msg = curl_multi_info_read(multi_handle, &msgs_left)))
-            {
-                if (msg->msg == CURLMSG_DONE)
+                int stillRunning = 0;
+                CURLMcode mc = curl_multi_perform(m_Multi, &stillRunning);
+                if (mc)
+                    throw std::runtime_error(std::format("curl_multi_perform() failed: {}", curl_multi_strerror(mc)));
+
+                CURLMsg* msg = nullptr;
+                int msgsLeft = 0;
+                while ((msg = curl_multi_info_read(m_Multi, &msgsLeft)))
                 {
+                    if (msg->msg != CURLMSG_DONE)
+                        continue;
+
+                    auto it = std::find_if(m_Transfers.begin(), m_Transfers.end(),
+                                           [&](const auto& transfer) { return transfer->Handle == msg->easy_handle; });
+                    if (it == m_Transfers.end())
+                        continue;
+
+                    Transfer& transfer = **it;
+                    transfer.Done = true;
+
                     if (msg->data.result != CURLE_OK)
                     {
-                        std::string errorMsg =
+                        lastError =
                             std::format("curl_multi_perform() failed: {}", curl_easy_strerror(msg->data.result));
-                        std::println(stderr, "{}", errorMsg);
-                        curl_multi_remove_handle(multi_handle, curl);
-                        curl_easy_cleanup(curl);
-                        curl_multi_cleanup(multi_handle);
-                        throw std::runtime_error(errorMsg);
+                        continue;
                     }
-                    else
+
+                    curl_easy_getinfo(transfer.Handle, CURLINFO_RESPONSE_CODE, &transfer.Result.Status);
+                    if (IsRetryable(transfer.Result.Status))
                     {
-                        long response_code;
-                        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-                        if (response_code != 200)
-                        {
-                            std::string errorMsg =
-                                std::format("HTTP request failed with status code: {}", response_code);
-                            std::println(stderr, "{}", errorMsg);
-                            curl_multi_remove_handle(multi_handle, curl);
-                            curl_easy_cleanup(curl);
-                            curl_multi_cleanup(multi_handle);
-                            throw std::runtime_error(errorMsg);
-                        }
+                        // Worth waiting for the other transfer if it is still going.
+                        retryable = std::make_unique<Earth::HTTP::Response>(std::move(transfer.Result));
+                        continue;
                     }
+
+                    if (latency)
+                        latency->Record(
+                            std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - transfer.Start));
+                    if (it != m_Transfers.begin())
+                        stats.HedgeWins++;
+
+                    // The loser is cancelled when the attempt is destroyed.
+                    return std::move(transfer.Result);
+                }
+
+                bool allDone = std::all_of(m_Transfers.begin(), m_Transfers.end(),
+                                           [](const auto& transfer) { return transfer->Done; });
+                if (allDone)
+                {
+                    // Hedging again is pointless when the server is answering, so hand back the
+                    // error status and let the caller back off.
+                    if (retryable)
+                        return std::move(*retryable);
+                    throw std::runtime_error(lastError);
+                }
+
+                // Wake up in time for the hedge or the deadline.
+                Clock::time_point wakeAt = std::min(deadline, m_Transfers.size() == 1 ? hedgeAt : deadline);
+                auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - Clock::now());
+                curl_multi_poll(m_Multi, nullptr, 0, (int)std::clamp<long long>(timeout.count(), 0, 100), nullptr);
+            }
+        }
+
+      private:
+        const Earth::HTTP::SinkFactory& m_Sink;
+        CURLM* m_Multi = nullptr;
+        std::vector<std::unique_ptr<Transfer>> m_Transfers;
+    };
+
+    // Sleeps for `duration` unless the request is cancelled first.
+    void Backoff(std::chrono::milliseconds duration, std::atomic<bool>* cancelled)
+    {
+        Clock::time_point until = Clock::now() + duration;
+        while (Clock::now() < until)
+        {
+            if (cancelled && *cancelled)
+                throw std::runtime_error("Request cancelled");
+            std::this_thread::sleep_for(std::min<Clock::duration>(until - Clock::now(), std::chrono::milliseconds(20)));
+        }
+    }
+
+    std::chrono::milliseconds GetJitteredBackoff(const Earth::HTTP::RequestPolicy& policy, int retry)
+    {
+        thread_local std::mt19937 s_Random(std::random_device{}());
+
+        long long cap = policy.BaseBackoff.count() << std::min(retry, 16);
+        cap = std::min<long long>(cap, policy.MaxBackoff.count());
+        return std::chrono::milliseconds(std::uniform_int_distribution<long long>(0, cap)(s_Random));
+    }
+
+    Earth::HTTP::Response Perform(const Earth::URL& url, const std::string& etag,
+                                  const Earth::HTTP::RequestPolicy& policy, Earth::HTTP::LatencyTracker* latency,
+                                  std::atomic<bool>* cancelled, const Earth::HTTP::SinkFactory& sink = {},
+                                  Earth::HTTP::RetryState* state = nullptr)
+    {
+        if (cancelled && *cancelled)
+        {
+            throw std::runtime_error("Request cancelled");
+        }
+
+        auto& stats = Earth::HTTP::GetStats();
+        bool resumed = state && state->Deadline != Clock::time_point();
+        if (!resumed)
+            stats.Requests++;
+
+        std::shared_ptr<Earth::HTTP::Transport> transport = Earth::HTTP::GetTransport();
+        Clock::time_point deadline = resumed ? state->Deadline : Clock::now() + policy.Deadline;
+        for (int retry = resumed ? state->Retries : 0;; ++retry)
+        {
+            Clock::time_point hedgeAt = Clock::time_point::max();
+            if (policy.Hedge && latency)
+            {
+                auto delay = std::max(latency->GetPercentile(0.95f, policy.HedgeDelay), policy.MinHedgeDelay);
+                hedgeAt = Clock::now() + delay;
+            }
+
+            Earth::HTTP::Response response;
+            try
+            {
+                response = transport->Send(url, etag, hedgeAt, deadline, latency, cancelled, sink);
+                stats.Bytes += response.Body.size();
+            }
+            catch (const std::exception& e)
+            {
+                if (cancelled && *cancelled)
+                    throw;
+                if (retry >= policy.MaxRetries || Clock::now() >= deadline)
+                {
+                    std::println(stderr, "{}", e.what());
+                    throw;
                 }
             }
 
-            curl_multi_remove_handle(multi_handle, curl);
-            curl_easy_cleanup(curl);
-            curl_multi_cleanup(multi_handle);
+            if (response.Status != 0 && (!IsRetryable(response.Status) || retry >= policy.MaxRetries))
+                return response;
+
+            std::chrono::milliseconds backoff = GetJitteredBackoff(policy, retry);
+            if (Clock::now() + backoff >= deadline)
+            {
+                if (response.Status != 0)
+                    return response;
+                Earth::HTTP::GetStats().Timeouts++;
+                throw std::runtime_error("Request deadline exceeded");
+            }
+
+            stats.Retries++;
+            if (state)
+            {
+                *state = {retry + 1, deadline};
+                throw Earth::HTTP::RetryLater(Clock::now() + backoff);
+            }
+            Backoff(backoff, cancelled);
+        }
+    }
+}
+
+namespace Earth::HTTP
+{
+    void LatencyTracker::Record(std::chrono::milliseconds latency)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Samples.size() < WINDOW_SIZE)
+        {
+            m_Samples.push_back(latency);
         }
         else
         {
-            if (curl)
-                curl_easy_cleanup(curl);
-            if (multi_handle)
-                curl_multi_cleanup(multi_handle);
-            throw std::runtime_error("Failed to initialize CURL");
+            m_Samples[m_Next] = latency;
+            m_Next = (m_Next + 1) % WINDOW_SIZE;
+        }
+    }
+
+    std::chrono::milliseconds LatencyTracker::GetPercentile(float percentile, std::chrono::milliseconds fallback) const
+    {
+        std::vector<std::chrono::milliseconds> samples;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (m_Samples.size() < MIN_SAMPLES)
+                return fallback;
+            samples = m_Samples;
+        }
+
+        size_t index = std::min(samples.size() - 1, (size_t)(percentile * samples.size()));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+
+    Stats& GetStats()
+    {
+        static Stats s_Stats;
+        return s_Stats;
+    }
+
+    Response CurlTransport::Send(const URL& url, const std::string& etag, Clock::time_point hedgeAt,
+                                 Clock::time_point deadline, LatencyTracker* latency, std::atomic<bool>* cancelled,
+                                 const SinkFactory& sink)
+    {
+        Attempt attempt(sink);
+        attempt.Add(url, etag);
+        return attempt.Run(url, etag, hedgeAt, deadline, latency, cancelled);
+    }
+
+    namespace
+    {
+        std::mutex s_TransportMutex;
+        std::shared_ptr<Transport> s_Transport = std::make_shared<CurlTransport>();
+    }
+
+    void SetTransport(std::shared_ptr<Transport> transport)
+    {
+        std::lock_guard<std::mutex> lock(s_TransportMutex);
+        s_Transport = std::move(transport);
+    }
+
+    std::shared_ptr<Transport> GetTransport()
+    {
+        std::lock_guard<std::mutex> lock(s_TransportMutex);
+        return s_Transport;
+    }
+
+    std::string Fetch(const URL& url, std::atomic<bool>* cancelled)
+    {
+        return Fetch(url, RequestPolicy(), nullptr, cancelled);
+    }
+
+    std::string Fetch(const URL& url, const RequestPolicy& policy, LatencyTracker* latency,
+                      std::atomic<bool>* cancelled)
+    {
+        Response response = Perform(url, "", policy, latency, cancelled);
+        if (response.Status != 200)
+        {
+            std::string errorMsg = std::format("HTTP request failed with status code: {}", response.Status);
+            std::println(stderr, "{}", errorMsg);
+            throw std::runtime_error(errorMsg);
         }
+        return std::move(response.Body);
+    }
 
-        return readBuffer;
+    Response Get(const URL& url, const RequestPolicy& policy, LatencyTracker* latency, std::atomic<bool>* cancelled,
+                 const SinkFactory& sink, RetryState* retry)
+    {
+        return Perform(url, "", policy, latency, cancelled, sink, retry);
+    }
+
+    Response FetchIfNoneMatch(const URL& url, const std::string& etag, std::atomic<bool>* cancelled)
+    {
+        return Perform(url, etag, RequestPolicy(), nullptr, cancelled);
     }
 }
@@ -3,9 +3,156 @@
 #include "URL.hpp"
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace Earth::HTTP
 {
+    // Consumes a response body while it downloads, for example to decode it as it arrives. Only the
+    // body of a 200 response is written to it.
+    class BodySink
+    {
+      public:
+        virtual ~BodySink() = default;
+
+        virtual void Write(std::span<const unsigned char> data) = 0;
+    };
+
+    // Makes a sink for every transfer, so retries and hedges never interleave their bytes.
+    using SinkFactory = std::function<std::unique_ptr<BodySink>()>;
+
+    struct Response
+    {
+        long Status = 0;
+        std::string Body;
+        std::string ETag;
+        // The sink of the transfer this response came from, if a factory was given.
+        std::unique_ptr<BodySink> Sink;
+    };
+
+    struct RequestPolicy
+    {
+        // Overall time allowed for a request, retries and hedges included.
+        std::chrono::milliseconds Deadline = std::chrono::seconds(30);
+        // Retries after a 429 or 5xx response, or a transport error.
+        int MaxRetries = 3;
+        // Backoff before retry n is drawn uniformly from [0, min(MaxBackoff, BaseBackoff * 2^n)].
+        std::chrono::milliseconds BaseBackoff = std::chrono::milliseconds(200);
+        std::chrono::milliseconds MaxBackoff = std::chrono::seconds(5);
+        // Send a duplicate request when the first is slower than the observed p95 latency. The delay
+        // is used as is until the latency tracker has enough samples.
+        bool Hedge = false;
+        std::chrono::milliseconds HedgeDelay = std::chrono::seconds(1);
+        std::chrono::milliseconds MinHedgeDelay = std::chrono::milliseconds(50);
+    };
+
+    // Where a request stands between attempts, so one that backed off can carry on later.
+    struct RetryState
+    {
+        // Retries made so far.
+        int Retries = 0;
+        // Set by the first attempt.
+        std::chrono::steady_clock::time_point Deadline;
+    };
+
+    // Thrown instead of sleeping out the backoff before a retry, for requests given a RetryState.
+    class RetryLater : public std::runtime_error
+    {
+      public:
+        explicit RetryLater(std::chrono::steady_clock::time_point notBefore)
+            : std::runtime_error("Request backing off before a retry"), NotBefore(notBefore)
+        {
+        }
+
+        std::chrono::steady_clock::time_point NotBefore;
+    };
+
+    // Rolling window of request latencies, shared by all requests to one host.
+    class LatencyTracker
+    {
+      public:
+        void Record(std::chrono::milliseconds latency);
+
+        // Latency below which `percentile` (0..1) of recent requests finished, or `fallback` if too
+        // few have been seen.
+        std::chrono::milliseconds GetPercentile(float percentile, std::chrono::milliseconds fallback) const;
+
+      private:
+        static constexpr size_t WINDOW_SIZE = 256;
+        static constexpr size_t MIN_SAMPLES = 20;
+
+        mutable std::mutex m_Mutex;
+        std::vector<std::chrono::milliseconds> m_Samples;
+        size_t m_Next = 0;
+    };
+
+    struct Stats
+    {
+        std::atomic<int> Requests = 0;
+        std::atomic<int> Hedges = 0;
+        std::atomic<int> HedgeWins = 0;
+        std::atomic<int> Retries = 0;
+        std::atomic<int> Timeouts = 0;
+        // Response bodies received, retried ones included.
+        std::atomic<uint64_t> Bytes = 0;
+    };
+
+    // Process-wide counters, for the Performance window.
+    Stats& GetStats();
+
+    // Carries out one attempt at a request; deadlines, retries and backoff are handled around it. The
+    // default goes over the network, others record or replay traffic (see HTTPArchive.hpp).
+    class Transport
+    {
+      public:
+        using Clock = std::chrono::steady_clock;
+
+        virtual ~Transport() = default;
+
+        // Returns the first response with a usable status, or a 429/5xx one if nothing better came.
+        // Throws on transport errors, cancellation and the deadline. A duplicate request is sent at
+        // `hedgeAt` if the first hasn't finished; time_point::max() never hedges. Completed requests
+        // feed `latency` when it is given.
+        virtual Response Send(const URL& url, const std::string& etag, Clock::time_point hedgeAt,
+                              Clock::time_point deadline, LatencyTracker* latency, std::atomic<bool>* cancelled,
+                              const SinkFactory& sink) = 0;
+    };
+
+    // Sends requests with libcurl.
+    class CurlTransport : public Transport
+    {
+      public:
+        Response Send(const URL& url, const std::string& etag, Clock::time_point hedgeAt, Clock::time_point deadline,
+                      LatencyTracker* latency, std::atomic<bool>* cancelled, const SinkFactory& sink) override;
+    };
+
+    // Transport used by every request from now on; a CurlTransport until set.
+    void SetTransport(std::shared_ptr<Transport> transport);
+    std::shared_ptr<Transport> GetTransport();
+
+    // Throws unless the server answers 200.
     std::string Fetch(const URL& url, std::atomic<bool>* cancelled = nullptr);
+
+    // Fetch with deadlines, retries and optional hedging. `latency` feeds the hedge delay and may be
+    // shared between requests; it is only required when `policy.Hedge` is set.
+    std::string Fetch(const URL& url, const RequestPolicy& policy, LatencyTracker* latency,
+                      std::atomic<bool>* cancelled = nullptr);
+
+    // Like Fetch, but returns whatever status the server ends up answering with. Transport errors and
+    // deadlines still throw. The body is still buffered in the response when `sink` is given. With
+    // `retry`, backoff isn't slept out on the calling thread: RetryLater is thrown instead, and calling
+    // Get again with the same state once its NotBefore has passed makes the next attempt.
+    Response Get(const URL& url, const RequestPolicy& policy, LatencyTracker* latency,
+                 std::atomic<bool>* cancelled = nullptr, const SinkFactory& sink = {}, RetryState* retry = nullptr);
+
+    // Conditional GET for revalidating a cached copy. Sends If-None-Match when `etag` is not empty and
+    // returns any HTTP status, including 304, instead of throwing. Transport errors still throw.
+    Response FetchIfNoneMatch(const URL& url, const std::string& etag, std::atomic<bool>* cancelled = nullptr);
 }
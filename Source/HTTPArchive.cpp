@@ -0,0 +1,292 @@
+#include "HTTPArchive.hpp"
+#include "Logger.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace Earth::HTTP
+{
+    static Logger s_Logger("HTTPArchive");
+
+    namespace
+    {
+        using Clock = Transport::Clock;
+
+        // Replayed bodies are handed to sinks in pieces of this size, as a socket would.
+        constexpr size_t CHUNK_SIZE = 16 * 1024;
+
+        // FNV-1a of the URL, stable across runs and machines.
+        uint64_t HashURL(const URL& url)
+        {
+            uint64_t hash = 14695981039346656037ull;
+            for (unsigned char c : url.Get())
+            {
+                hash ^= c;
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+        std::filesystem::path GetEntryPath(const std::filesystem::path& directory, const URL& url,
+                                           const char* extension)
+        {
+            return directory / std::format("{:016x}{}", HashURL(url), extension);
+        }
+
+        bool ReadFile(const std::filesystem::path& path, std::string& contents)
+        {
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open())
+                return false;
+
+            std::ostringstream stream;
+            stream << file.rdbuf();
+            contents = stream.str();
+            return true;
+        }
+
+        // Writes through a temporary file so a reader never sees half an entry, even when two
+        // workers record the same URL.
+        void WriteFile(const std::filesystem::path& path, const std::string& contents)
+        {
+            static std::atomic<uint32_t> s_Counter = 0;
+
+            std::filesystem::path temp = path;
+            temp += std::format(".{}.part", s_Counter++);
+            {
+                std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+                file.write(contents.data(), (std::streamsize)contents.size());
+                if (!file)
+                    throw std::runtime_error(std::format("Failed to write {}", temp.string()));
+            }
+            std::filesystem::rename(temp, path);
+        }
+
+        // Sleeps until `until`, throwing like a real transfer would if the request is cancelled or
+        // runs past its deadline first.
+        void WaitUntil(Clock::time_point until, Clock::time_point deadline, std::atomic<bool>* cancelled)
+        {
+            for (;;)
+            {
+                if (cancelled && *cancelled)
+                    throw std::runtime_error("Request cancelled");
+
+                Clock::time_point now = Clock::now();
+                if (now >= deadline)
+                {
+                    GetStats().Timeouts++;
+                    throw std::runtime_error("Request deadline exceeded");
+                }
+                if (now >= until)
+                    return;
+
+                Clock::time_point wakeAt = std::min({until, deadline, now + std::chrono::milliseconds(20)});
+                std::this_thread::sleep_until(wakeAt);
+            }
+        }
+    }
+
+    const std::vector<NetworkProfile>& GetNetworkProfiles()
+    {
+        using namespace std::chrono_literals;
+
+        static const std::vector<NetworkProfile> s_Profiles = {
+            {"Recorded", true},
+            {"Unlimited", false, 0ms, 0ms, 0, 0.0f},
+            {"Broadband", false, 20ms, 5ms, 50'000'000 / 8, 0.0f},
+            {"4G", false, 60ms, 20ms, 12'000'000 / 8, 0.005f},
+            {"3G", false, 200ms, 60ms, 1'600'000 / 8, 0.02f},
+            {"Lossy Satellite", false, 650ms, 150ms, 2'000'000 / 8, 0.08f},
+        };
+        return s_Profiles;
+    }
+
+    const NetworkProfile& FindNetworkProfile(const std::string& name)
+    {
+        for (const NetworkProfile& profile : GetNetworkProfiles())
+        {
+            if (profile.Name == name)
+                return profile;
+        }
+        throw std::runtime_error(std::format("Unknown network profile: {}", name));
+    }
+
+    RecordingTransport::RecordingTransport(std::shared_ptr<Transport> inner, std::filesystem::path directory)
+        : m_Inner(std::move(inner)), m_Directory(std::move(directory))
+    {
+        std::filesystem::create_directories(m_Directory);
+    }
+
+    Response RecordingTransport::Send(const URL& url, const std::string& etag, Clock::time_point hedgeAt,
+                                      Clock::time_point deadline, LatencyTracker* latency,
+                                      std::atomic<bool>* cancelled, const SinkFactory& sink)
+    {
+        Clock::time_point start = Clock::now();
+        Response response = m_Inner->Send(url, etag, hedgeAt, deadline, latency, cancelled, sink);
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+
+        if (response.Status == 304)
+            return response;
+
+        nlohmann::json metadata = {
+            {"status", response.Status},
+            {"etag", response.ETag},
+            {"milliseconds", duration.count()},
+        };
+
+        // Losing a recording is not worth failing the request over.
+        try
+        {
+            // The body goes first, so an entry is only visible once it is complete.
+            WriteFile(GetEntryPath(m_Directory, url, ".body"), response.Body);
+            WriteFile(GetEntryPath(m_Directory, url, ".json"), metadata.dump());
+        }
+        catch (const std::exception& e)
+        {
+            static LogRateLimit s_RecordLogLimit(5);
+            s_Logger.Error(s_RecordLogLimit, "Failed to record response: {}", e.what());
+        }
+        return response;
+    }
+
+    ReplayTransport::ReplayTransport(std::filesystem::path directory, NetworkProfile profile, uint32_t seed)
+        : m_Directory(std::move(directory)), m_Seed(seed), m_Profile(std::move(profile))
+    {
+        if (!std::filesystem::is_directory(m_Directory))
+            throw std::runtime_error(std::format("No recorded traffic in {}", m_Directory.string()));
+    }
+
+    void ReplayTransport::SetProfile(const NetworkProfile& profile)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Profile = profile;
+    }
+
+    NetworkProfile ReplayTransport::GetProfile() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_Profile;
+    }
+
+    std::optional<ReplayTransport::Entry> ReplayTransport::Load(const URL& url) const
+    {
+        std::string metadataText;
+        Entry entry;
+        if (!ReadFile(GetEntryPath(m_Directory, url, ".json"), metadataText) ||
+            !ReadFile(GetEntryPath(m_Directory, url, ".body"), entry.Body))
+            return std::nullopt;
+
+        nlohmann::json metadata = nlohmann::json::parse(metadataText);
+        entry.Status = metadata["status"].get<long>();
+        entry.ETag = metadata["etag"].get<std::string>();
+        entry.Duration = std::chrono::milliseconds(metadata["milliseconds"].get<long long>());
+        return entry;
+    }
+
+    Clock::time_point ReplayTransport::ReserveLink(size_t bytes, int64_t bytesPerSecond)
+    {
+        auto duration = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>((double)bytes / (double)bytesPerSecond));
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_LinkFreeAt = std::max(m_LinkFreeAt, Clock::now()) + duration;
+        return m_LinkFreeAt;
+    }
+
+    Response ReplayTransport::Send(const URL& url, const std::string& etag, Clock::time_point hedgeAt,
+                                   Clock::time_point deadline, LatencyTracker* latency, std::atomic<bool>* cancelled,
+                                   const SinkFactory& sink)
+    {
+        Clock::time_point start = Clock::now();
+
+        NetworkProfile profile;
+        uint32_t request;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            profile = m_Profile;
+            request = m_Requests[url.Get()]++;
+        }
+
+        uint64_t hash = HashURL(url);
+        std::seed_seq seed{(uint32_t)hash, (uint32_t)(hash >> 32), m_Seed, request};
+        std::mt19937 random(seed);
+
+        std::optional<Entry> entry = Load(url);
+
+        auto drawDelay = [&]() {
+            if (profile.UseRecordedTiming)
+                return entry ? entry->Duration : std::chrono::milliseconds(0);
+
+            std::chrono::milliseconds delay = profile.Latency;
+            if (profile.Jitter.count() > 0)
+            {
+                long long jitter = profile.Jitter.count();
+                delay += std::chrono::milliseconds(std::uniform_int_distribution<long long>(-jitter, jitter)(random));
+                delay = std::max(delay, std::chrono::milliseconds(0));
+            }
+            return delay;
+        };
+
+        // As with curl, a duplicate goes out at `hedgeAt` if the first request hasn't answered by then,
+        // and whichever answers first wins. It draws a latency of its own.
+        Clock::time_point sentAt = start;
+        Clock::time_point answerAt = start + drawDelay();
+        if (hedgeAt < answerAt)
+        {
+            Stats& stats = GetStats();
+            stats.Hedges++;
+            Clock::time_point hedgeAnswerAt = hedgeAt + drawDelay();
+            if (hedgeAnswerAt < answerAt)
+            {
+                stats.HedgeWins++;
+                sentAt = hedgeAt;
+                answerAt = hedgeAnswerAt;
+            }
+        }
+        WaitUntil(answerAt, deadline, cancelled);
+
+        if (std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < profile.FailureRate)
+            throw std::runtime_error("Emulated transport failure");
+
+        Response response;
+        if (!entry)
+        {
+            response.Status = 404;
+        }
+        else if (!etag.empty() && etag == entry->ETag && entry->Status == 200)
+        {
+            response.Status = 304;
+            response.ETag = entry->ETag;
+        }
+        else
+        {
+            response.Status = entry->Status;
+            response.ETag = entry->ETag;
+            if (sink)
+                response.Sink = sink();
+
+            std::string_view body = entry->Body;
+            for (size_t offset = 0; offset < body.size(); offset += CHUNK_SIZE)
+            {
+                std::string_view chunk = body.substr(offset, CHUNK_SIZE);
+                if (profile.BytesPerSecond > 0)
+                    WaitUntil(ReserveLink(chunk.size(), profile.BytesPerSecond), deadline, cancelled);
+
+                response.Body.append(chunk);
+                if (response.Sink && response.Status == 200)
+                    response.Sink->Write({(const unsigned char*)chunk.data(), chunk.size()});
+            }
+        }
+
+        if (latency)
+            latency->Record(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - sentAt));
+        return response;
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "HTTP.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Earth::HTTP
+{
+    // Network conditions emulated while replaying recorded traffic.
+    struct NetworkProfile
+    {
+        std::string Name;
+        // Wait as long as the recorded request took, instead of Latency and Jitter.
+        bool UseRecordedTiming = false;
+        // Time to first byte, varied uniformly by up to Jitter either way.
+        std::chrono::milliseconds Latency{0};
+        std::chrono::milliseconds Jitter{0};
+        // Throughput of the link, shared by every request in flight. 0 is unlimited.
+        int64_t BytesPerSecond = 0;
+        // Chance of a request failing with a transport error once its latency has passed.
+        float FailureRate = 0.0f;
+    };
+
+    // Built-in profiles, "Recorded" first.
+    const std::vector<NetworkProfile>& GetNetworkProfiles();
+    // Throws if no profile has this name.
+    const NetworkProfile& FindNetworkProfile(const std::string& name);
+
+    // Saves every response `inner` returns, and how long it took, to an archive directory that
+    // ReplayTransport serves from. Files are named by a hash of the URL, so API keys in it never end up
+    // on disk. 304s are not saved, so a replay without the client's cache still gets full bodies.
+    class RecordingTransport : public Transport
+    {
+      public:
+        RecordingTransport(std::shared_ptr<Transport> inner, std::filesystem::path directory);
+
+        Response Send(const URL& url, const std::string& etag, Clock::time_point hedgeAt, Clock::time_point deadline,
+                      LatencyTracker* latency, std::atomic<bool>* cancelled, const SinkFactory& sink) override;
+
+      private:
+        std::shared_ptr<Transport> m_Inner;
+        std::filesystem::path m_Directory;
+    };
+
+    // Serves responses from a RecordingTransport archive under an emulated NetworkProfile, without
+    // touching the network. Requests missing from the archive get a 404. Jitter and failures are drawn
+    // from a generator seeded by the URL and how often it was asked for, so a replay comes out the same
+    // whatever order the workers send requests in. Hedged duplicates get a latency of their own, but
+    // their bodies don't take up the link.
+    class ReplayTransport : public Transport
+    {
+      public:
+        ReplayTransport(std::filesystem::path directory, NetworkProfile profile, uint32_t seed = 0);
+
+        Response Send(const URL& url, const std::string& etag, Clock::time_point hedgeAt, Clock::time_point deadline,
+                      LatencyTracker* latency, std::atomic<bool>* cancelled, const SinkFactory& sink) override;
+
+        // Applies to requests sent from now on.
+        void SetProfile(const NetworkProfile& profile);
+        NetworkProfile GetProfile() const;
+
+      private:
+        struct Entry
+        {
+            long Status = 0;
+            std::string ETag;
+            std::chrono::milliseconds Duration{0};
+            std::string Body;
+        };
+
+        std::optional<Entry> Load(const URL& url) const;
+        // Books `bytes` on the shared link and returns when they will have arrived.
+        Clock::time_point ReserveLink(size_t bytes, int64_t bytesPerSecond);
+
+        std::filesystem::path m_Directory;
+        uint32_t m_Seed;
+
+        mutable std::mutex m_Mutex;
+        NetworkProfile m_Profile;
+        std::unordered_map<std::string, uint32_t> m_Requests;
+        Clock::time_point m_LinkFreeAt;
+    };
+}
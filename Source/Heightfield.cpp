@@ -0,0 +1,348 @@
+#include "Heightfield.hpp"
+#include "TerrainMesh.hpp"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define EARTH_HEIGHTFIELD_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define EARTH_HEIGHTFIELD_NEON
+#endif
+
+namespace Earth
+{
+    namespace
+    {
+        constexpr int TILE_SIZE = TerrainMesh::GRID_SIZE - 1;
+        // Levels of blocks above single cells, up to the whole tile.
+        constexpr int LEVEL_COUNT = std::countr_zero((unsigned)TILE_SIZE);
+
+        // Bilinear interpolation of four points from their corner heights and fractions.
+        inline void Interpolate4(const float* h00, const float* h10, const float* h01, const float* h11,
+                                 const float* fx, const float* fy, float* dst)
+        {
+#if defined(EARTH_HEIGHTFIELD_SSE)
+            __m128 x = _mm_loadu_ps(fx);
+            __m128 top = _mm_loadu_ps(h00);
+            top = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(h10), top), x));
+            __m128 bottom = _mm_loadu_ps(h01);
+            bottom = _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(h11), bottom), x));
+            _mm_storeu_ps(dst, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_loadu_ps(fy))));
+#elif defined(EARTH_HEIGHTFIELD_NEON)
+            float32x4_t x = vld1q_f32(fx);
+            float32x4_t top = vmlaq_f32(vld1q_f32(h00), vsubq_f32(vld1q_f32(h10), vld1q_f32(h00)), x);
+            float32x4_t bottom = vmlaq_f32(vld1q_f32(h01), vsubq_f32(vld1q_f32(h11), vld1q_f32(h01)), x);
+            vst1q_f32(dst, vmlaq_f32(top, vsubq_f32(bottom, top), vld1q_f32(fy)));
+#else
+            for (int i = 0; i < 4; ++i)
+            {
+                float top = h00[i] + (h10[i] - h00[i]) * fx[i];
+                float bottom = h01[i] + (h11[i] - h01[i]) * fx[i];
+                dst[i] = top + (bottom - top) * fy[i];
+            }
+#endif
+        }
+    }
+
+    Heightfield::Heightfield(int x, int y, int z, std::vector<float> heights) : m_Heights(std::move(heights))
+    {
+        constexpr int GRID_SIZE = TerrainMesh::GRID_SIZE;
+        if (m_Heights.size() != GRID_SIZE * GRID_SIZE)
+            throw std::runtime_error("Heightfield does not match the terrain grid size");
+
+        const double PI = glm::pi<double>();
+        double tiles = (double)(1 << z);
+        m_SinLongitude.resize(GRID_SIZE);
+        m_CosLongitude.resize(GRID_SIZE);
+        m_SinLatitude.resize(GRID_SIZE);
+        m_CosLatitude.resize(GRID_SIZE);
+        for (int i = 0; i < GRID_SIZE; ++i)
+        {
+            double u = (x + (double)i / TILE_SIZE) / tiles;
+            double v = (y + (double)i / TILE_SIZE) / tiles;
+            double longitude = u * 2.0 * PI - PI;
+            double latitude = std::atan(std::sinh(PI * (1.0 - 2.0 * v)));
+            m_SinLongitude[i] = std::sin(longitude);
+            m_CosLongitude[i] = std::cos(longitude);
+            m_SinLatitude[i] = std::sin(latitude);
+            m_CosLatitude[i] = std::cos(latitude);
+        }
+
+        // Blocks of 2x2 cells take their range from the 3x3 heights they span, larger blocks from
+        // their four children.
+        m_Levels.resize(LEVEL_COUNT);
+        for (int level = 1; level <= LEVEL_COUNT; ++level)
+        {
+            int blocks = TILE_SIZE >> level;
+            std::vector<Range>& ranges = m_Levels[level - 1];
+            ranges.resize((size_t)blocks * blocks);
+
+            for (int by = 0; by < blocks; ++by)
+            {
+                for (int bx = 0; bx < blocks; ++bx)
+                {
+                    Range range = {std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()};
+                    if (level == 1)
+                    {
+                        for (int gy = by * 2; gy <= by * 2 + 2; ++gy)
+                        {
+                            for (int gx = bx * 2; gx <= bx * 2 + 2; ++gx)
+                            {
+                                float height = m_Heights[gy * GRID_SIZE + gx];
+                                range = {std::min(range.Min, height), std::max(range.Max, height)};
+                            }
+                        }
+                    }
+                    else
+                    {
+                        for (int child = 0; child < 4; ++child)
+                        {
+                            Range childRange = GetRange(level - 1, bx * 2 + (child & 1), by * 2 + (child >> 1));
+                            range = {std::min(range.Min, childRange.Min), std::max(range.Max, childRange.Max)};
+                        }
+                    }
+                    ranges[(size_t)by * blocks + bx] = range;
+                }
+            }
+        }
+    }
+
+    std::optional<double> Heightfield::Intersect(const Ray& ray, double maxDistance, const glm::dvec4& rect) const
+    {
+        // The tested part of the tile in grid units, as (min.x, min.y, max.x, max.y)
+        glm::dvec4 clip(rect.z, rect.w, rect.z + rect.x, rect.w + rect.y);
+        clip *= (double)TILE_SIZE;
+        auto overlaps = [&](int level, int bx, int by) {
+            int size = 1 << level;
+            return bx * size < clip.z && (bx + 1) * size > clip.x && by * size < clip.w && (by + 1) * size > clip.y;
+        };
+
+        struct Block
+        {
+            int Level, X, Y;
+            double Distance;
+        };
+        // Each visited block pushes at most four children, so the stack stays shallow.
+        std::array<Block, LEVEL_COUNT * 3 + 1> stack;
+        int count = 0;
+
+        std::optional<double> root = IntersectBounds(ray, LEVEL_COUNT, 0, 0);
+        if (!root || *root >= maxDistance)
+            return std::nullopt;
+        stack[count++] = {LEVEL_COUNT, 0, 0, *root};
+
+        std::optional<double> nearest;
+        double limit = maxDistance;
+        while (count > 0)
+        {
+            Block block = stack[--count];
+            if (block.Distance >= limit)
+                continue;
+
+            // The bounds of single cells would cost as much as their triangles.
+            if (block.Level == 1)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    int gx = block.X * 2 + (i & 1);
+                    int gy = block.Y * 2 + (i >> 1);
+                    if (!overlaps(0, gx, gy))
+                        continue;
+
+                    std::optional<double> distance = IntersectCell(ray, gx, gy, clip);
+                    if (distance && *distance < limit)
+                    {
+                        nearest = distance;
+                        limit = *distance;
+                    }
+                }
+                continue;
+            }
+
+            // Children are pushed far to near, so the nearest is visited first and a hit there
+            // prunes the others.
+            std::array<Block, 4> children;
+            int childCount = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                int level = block.Level - 1;
+                int bx = block.X * 2 + (i & 1);
+                int by = block.Y * 2 + (i >> 1);
+                if (!overlaps(level, bx, by))
+                    continue;
+
+                std::optional<double> distance = IntersectBounds(ray, level, bx, by);
+                if (distance && *distance < limit)
+                    children[childCount++] = {level, bx, by, *distance};
+            }
+            std::sort(children.begin(), children.begin() + childCount,
+                      [](const Block& a, const Block& b) { return a.Distance > b.Distance; });
+            for (int i = 0; i < childCount; ++i)
+                stack[count++] = children[i];
+        }
+        return nearest;
+    }
+
+    float Heightfield::GetHeight(const glm::dvec2& uv) const
+    {
+        constexpr int GRID_SIZE = TerrainMesh::GRID_SIZE;
+
+        glm::dvec2 position = glm::clamp(uv, 0.0, 1.0) * (double)TILE_SIZE;
+        int x = std::min((int)position.x, TILE_SIZE - 1);
+        int y = std::min((int)position.y, TILE_SIZE - 1);
+        float fx = (float)(position.x - x);
+        float fy = (float)(position.y - y);
+
+        const float* row = &m_Heights[(size_t)y * GRID_SIZE + x];
+        float top = row[0] + (row[1] - row[0]) * fx;
+        float bottom = row[GRID_SIZE] + (row[GRID_SIZE + 1] - row[GRID_SIZE]) * fx;
+        return top + (bottom - top) * fy;
+    }
+
+    void Heightfield::GetHeights(std::span<const glm::vec2> uvs, std::span<float> heights) const
+    {
+        constexpr int GRID_SIZE = TerrainMesh::GRID_SIZE;
+
+        // Corners are gathered one point at a time; a short last batch repeats its final point.
+        size_t count = std::min(uvs.size(), heights.size());
+        for (size_t first = 0; first < count; first += 4)
+        {
+            float h00[4], h10[4], h01[4], h11[4], fx[4], fy[4], result[4];
+            size_t batch = std::min<size_t>(4, count - first);
+            for (size_t i = 0; i < 4; ++i)
+            {
+                glm::vec2 position = glm::clamp(uvs[first + std::min(i, batch - 1)], 0.0f, 1.0f) * (float)TILE_SIZE;
+                int x = std::min((int)position.x, TILE_SIZE - 1);
+                int y = std::min((int)position.y, TILE_SIZE - 1);
+
+                const float* row = &m_Heights[(size_t)y * GRID_SIZE + x];
+                h00[i] = row[0];
+                h10[i] = row[1];
+                h01[i] = row[GRID_SIZE];
+                h11[i] = row[GRID_SIZE + 1];
+                fx[i] = position.x - (float)x;
+                fy[i] = position.y - (float)y;
+            }
+
+            Interpolate4(h00, h10, h01, h11, fx, fy, result);
+            std::copy_n(result, batch, heights.begin() + first);
+        }
+    }
+
+    size_t Heightfield::GetSize() const
+    {
+        size_t size = m_Heights.size() * sizeof(float);
+        for (const std::vector<Range>& ranges : m_Levels)
+            size += ranges.size() * sizeof(Range);
+        size += (m_SinLongitude.size() + m_CosLongitude.size() + m_SinLatitude.size() + m_CosLatitude.size()) *
+                sizeof(double);
+        return size;
+    }
+
+    glm::dvec3 Heightfield::GetDirection(int gx, int gy) const
+    {
+        // Matches Mercator::UVToPosition
+        return glm::dvec3(m_CosLatitude[gy] * m_SinLongitude[gx], m_SinLatitude[gy],
+                          m_CosLatitude[gy] * m_CosLongitude[gx]);
+    }
+
+    glm::dvec3 Heightfield::GetPosition(int gx, int gy) const
+    {
+        double height = m_Heights[(size_t)gy * TerrainMesh::GRID_SIZE + gx];
+        return GetDirection(gx, gy) * (1.0 + height / EARTH_RADIUS);
+    }
+
+    Heightfield::Range Heightfield::GetRange(int level, int bx, int by) const
+    {
+        int blocks = TILE_SIZE >> level;
+        return m_Levels[level - 1][(size_t)by * blocks + bx];
+    }
+
+    std::optional<double> Heightfield::IntersectBounds(const Ray& ray, int level, int bx, int by) const
+    {
+        int size = 1 << level;
+        int x0 = bx * size, y0 = by * size;
+        int x1 = x0 + size, y1 = y0 + size;
+
+        // The block's surface lies between two radii and within an angle of its center direction.
+        // Distance from the center falls off monotonically along meridians and parallels away from
+        // it, so the widest angle is at a corner.
+        glm::dvec3 center = GetDirection(x0 + size / 2, y0 + size / 2);
+        double cosAngle = std::min({glm::dot(center, GetDirection(x0, y0)), glm::dot(center, GetDirection(x1, y0)),
+                                    glm::dot(center, GetDirection(x0, y1)), glm::dot(center, GetDirection(x1, y1))});
+
+        Range range = GetRange(level, bx, by);
+        double minRadius = 1.0 + range.Min / EARTH_RADIUS;
+        double maxRadius = 1.0 + range.Max / EARTH_RADIUS;
+        double middle = (minRadius + maxRadius) * 0.5;
+        auto distanceSquared = [&](double radius) {
+            return radius * radius + middle * middle - 2.0 * radius * middle * cosAngle;
+        };
+        double boundRadiusSquared = std::max(distanceSquared(minRadius), distanceSquared(maxRadius));
+
+        glm::dvec3 offset = ray.Origin - center * middle;
+        double b = glm::dot(offset, ray.Direction);
+        double c = glm::dot(offset, offset) - boundRadiusSquared;
+        double discriminant = b * b - c;
+        if (discriminant < 0.0)
+            return std::nullopt;
+
+        double root = std::sqrt(discriminant);
+        if (-b + root < 0.0)
+            return std::nullopt;
+        return std::max(-b - root, 0.0);
+    }
+
+    std::optional<double> Heightfield::IntersectCell(const Ray& ray, int gx, int gy, const glm::dvec4& clip) const
+    {
+        const std::array<glm::ivec2, 4> corners = {
+            glm::ivec2(gx, gy), glm::ivec2(gx + 1, gy), glm::ivec2(gx + 1, gy + 1), glm::ivec2(gx, gy + 1)};
+        std::array<glm::dvec3, 4> positions;
+        for (int i = 0; i < 4; ++i)
+            positions[i] = GetPosition(corners[i].x, corners[i].y);
+
+        std::optional<double> nearest;
+        for (int triangle = 0; triangle < 2; ++triangle)
+        {
+            // Split along the (gx, gy)-(gx + 1, gy + 1) diagonal
+            int a = 0, b = triangle + 1, c = triangle + 2;
+
+            // Möller-Trumbore
+            glm::dvec3 edge1 = positions[b] - positions[a];
+            glm::dvec3 edge2 = positions[c] - positions[a];
+            glm::dvec3 p = glm::cross(ray.Direction, edge2);
+            double determinant = glm::dot(edge1, p);
+            if (std::abs(determinant) < 1e-30)
+                continue;
+
+            double inverse = 1.0 / determinant;
+            glm::dvec3 s = ray.Origin - positions[a];
+            double u = glm::dot(s, p) * inverse;
+            if (u < 0.0 || u > 1.0)
+                continue;
+            glm::dvec3 q = glm::cross(s, edge1);
+            double v = glm::dot(ray.Direction, q) * inverse;
+            if (v < 0.0 || u + v > 1.0)
+                continue;
+            double distance = glm::dot(edge2, q) * inverse;
+            if (distance < 0.0 || (nearest && distance >= *nearest))
+                continue;
+
+            glm::dvec2 grid = glm::dvec2(corners[a]) * (1.0 - u - v) + glm::dvec2(corners[b]) * u +
+                              glm::dvec2(corners[c]) * v;
+            if (grid.x < clip.x || grid.x > clip.z || grid.y < clip.y || grid.y > clip.w)
+                continue;
+            nearest = distance;
+        }
+        return nearest;
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Ray.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace Earth
+{
+    // The decoded heights of a terrain tile, kept on the CPU for picking and collision. A pyramid of
+    // per-block minimum and maximum heights (a maximum mipmap) bounds the surface, so a ray only
+    // visits the few blocks it passes close to instead of every triangle in the tile.
+    class Heightfield
+    {
+      public:
+        // Meters per globe unit, as in the vertex shader.
+        static constexpr double EARTH_RADIUS = 6371000.0;
+
+        // `heights` holds TerrainMesh::GRID_SIZE^2 heights in meters, as from TerrainMesh::DecodeHeights.
+        Heightfield(int x, int y, int z, std::vector<float> heights);
+
+        // Distance along `ray` to the first point where it enters the surface, or nothing if it misses
+        // or only hits beyond `maxDistance`. Only the part of the tile in `rect` is tested, given in tile
+        // UV as (scale.x, scale.y, offset.x, offset.y) like the rects of Renderer::DrawTile.
+        std::optional<double> Intersect(const Ray& ray, double maxDistance,
+                                        const glm::dvec4& rect = glm::dvec4(1.0, 1.0, 0.0, 0.0)) const;
+
+        // Height in meters at a tile UV, interpolated the way the vertex shader does.
+        float GetHeight(const glm::dvec2& uv) const;
+        // GetHeight for many points at once, interpolating four at a time with SIMD where available.
+        void GetHeights(std::span<const glm::vec2> uvs, std::span<float> heights) const;
+
+        float GetMinHeight() const
+        {
+            return m_Levels.back()[0].Min;
+        }
+        float GetMaxHeight() const
+        {
+            return m_Levels.back()[0].Max;
+        }
+
+        // Memory held, for the memory budget.
+        size_t GetSize() const;
+
+      private:
+        struct Range
+        {
+            float Min;
+            float Max;
+        };
+
+        // Direction from the globe's center through grid point (gx, gy).
+        glm::dvec3 GetDirection(int gx, int gy) const;
+        glm::dvec3 GetPosition(int gx, int gy) const;
+        // Height range of the block of 2^level by 2^level grid cells at (bx, by).
+        Range GetRange(int level, int bx, int by) const;
+        // Distance along `ray` to where it enters a sphere bounding the block, or nothing if it
+        // misses the sphere.
+        std::optional<double> IntersectBounds(const Ray& ray, int level, int bx, int by) const;
+        // Tests the two triangles of grid cell (gx, gy), keeping hits inside the grid rectangle `clip`.
+        std::optional<double> IntersectCell(const Ray& ray, int gx, int gy, const glm::dvec4& clip) const;
+
+        std::vector<float> m_Heights;
+        // m_Levels[i] holds the ranges of blocks of 2^(i + 1) cells; single cells are read from
+        // m_Heights directly. The last level is the whole tile.
+        std::vector<std::vector<Range>> m_Levels;
+        // Grid lines follow meridians and parallels, so a grid point's direction is a product of these.
+        std::vector<double> m_SinLongitude, m_CosLongitude;
+        std::vector<double> m_SinLatitude, m_CosLatitude;
+    };
+}
@@ -0,0 +1,259 @@
+#include "HeightfieldCache.hpp"
+#include "Image.hpp"
+#include "Logger.hpp"
+#include "Mercator.hpp"
+#include "TerrainMesh.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+namespace Earth
+{
+    static Logger s_Logger("HeightfieldCache");
+
+    namespace
+    {
+        // Registered heightfields lapse when their tile drops them; the map is swept this often.
+        constexpr size_t PURGE_INTERVAL = 256;
+
+        struct Sample
+        {
+            uint64_t Key;
+            uint32_t Index;
+            glm::dvec2 UV;
+        };
+
+        // A run of samples on the same tile.
+        struct Group
+        {
+            size_t Begin, End;
+            glm::ivec2 Tile;
+        };
+
+        // Tiles a waiting query fetches, shared with the workers helping it. Workers that start after
+        // the query has taken every tile find nothing left, so the query never waits on the queue.
+        struct FetchBatch
+        {
+            std::shared_ptr<TileSource> Source;
+            std::vector<glm::ivec2> Tiles;
+            int Zoom;
+            std::atomic<size_t> Next = 0;
+
+            std::mutex Mutex;
+            std::condition_variable Done;
+            size_t Finished = 0;
+            std::vector<std::shared_ptr<const Heightfield>> Results;
+        };
+
+        std::shared_ptr<const Heightfield> Load(TileSource& source, glm::ivec2 tile, int zoom)
+        {
+            try
+            {
+                if (!source.Covers(tile.x, tile.y, zoom))
+                    return nullptr;
+                TileData data = source.Fetch(tile.x, tile.y, zoom);
+                if (data.IsEmpty())
+                    return nullptr;
+
+                Image image(data.GetBytes());
+                return std::make_shared<const Heightfield>(tile.x, tile.y, zoom, TerrainMesh::DecodeHeights(image));
+            }
+            catch (const std::exception& e)
+            {
+                static LogRateLimit s_ErrorLogLimit(5);
+                s_Logger.Error(s_ErrorLogLimit, "Failed to fetch terrain {}/{}/{}: {}", zoom, tile.x, tile.y,
+                               e.what());
+                return nullptr;
+            }
+        }
+
+        void FetchTiles(FetchBatch& batch)
+        {
+            for (size_t i; (i = batch.Next++) < batch.Tiles.size();)
+            {
+                std::shared_ptr<const Heightfield> heightfield = Load(*batch.Source, batch.Tiles[i], batch.Zoom);
+
+                std::lock_guard<std::mutex> lock(batch.Mutex);
+                batch.Results[i] = std::move(heightfield);
+                if (++batch.Finished == batch.Tiles.size())
+                    batch.Done.notify_all();
+            }
+        }
+    }
+
+    HeightfieldCache::HeightfieldCache(ThreadPool& threadPool) : m_ThreadPool(threadPool)
+    {
+    }
+
+    void HeightfieldCache::Insert(int x, int y, int z, std::shared_ptr<const Heightfield> heightfield)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_Mutex);
+        m_Entries[GetKey(x, y, z)] = heightfield;
+
+        if (++m_InsertsSincePurge >= PURGE_INTERVAL)
+        {
+            std::erase_if(m_Entries, [](const auto& entry) { return entry.second.expired(); });
+            m_InsertsSincePurge = 0;
+        }
+    }
+
+    void HeightfieldCache::SetSource(std::shared_ptr<TileSource> source)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_Mutex);
+        m_Source = std::move(source);
+    }
+
+    std::vector<float> HeightfieldCache::SampleElevations(std::span<const LonLat> points, int zoom, bool wait)
+    {
+        std::shared_ptr<TileSource> source;
+        {
+            std::shared_lock<std::shared_mutex> lock(m_Mutex);
+            source = m_Source;
+        }
+        if (source)
+            zoom = std::min(zoom, source->GetMaxZoom());
+        zoom = std::clamp(zoom, 0, TileSource::MAX_ZOOM);
+
+        // Sorting by tile brings the points of each tile together.
+        int tiles = 1 << zoom;
+        std::vector<Sample> samples(points.size());
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            glm::dvec2 uv = Mercator::LonLatToUV(points[i].Lon, points[i].Lat);
+            int x = std::clamp((int)(uv.x * tiles), 0, tiles - 1);
+            int y = std::clamp((int)(uv.y * tiles), 0, tiles - 1);
+            samples[i] = {GetKey(x, y, zoom), (uint32_t)i, uv};
+        }
+        std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) { return a.Key < b.Key; });
+
+        std::vector<Group> groups;
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            if (groups.empty() || samples[groups.back().Begin].Key != samples[i].Key)
+            {
+                glm::ivec2 tile = glm::clamp(glm::ivec2(samples[i].UV * (double)tiles), 0, tiles - 1);
+                groups.push_back({i, i, tile});
+            }
+            groups.back().End = i + 1;
+        }
+
+        // Holds what this query fetched until it has sampled them; m_Fetched may drop them sooner.
+        std::vector<std::shared_ptr<const Heightfield>> fetched;
+        if (wait && source)
+        {
+            std::vector<glm::ivec2> missing;
+            {
+                std::shared_lock<std::shared_mutex> lock(m_Mutex);
+                for (const Group& group : groups)
+                {
+                    auto it = m_Entries.find(GetKey(group.Tile.x, group.Tile.y, zoom));
+                    if (it == m_Entries.end() || it->second.expired())
+                        missing.push_back(group.Tile);
+                }
+            }
+            fetched = Fetch(source, std::move(missing), zoom);
+        }
+
+        // Resolved up front, so the lock isn't held while interpolating.
+        std::vector<std::shared_ptr<const Heightfield>> heightfields(groups.size());
+        std::vector<int> zooms(groups.size());
+        {
+            std::shared_lock<std::shared_mutex> lock(m_Mutex);
+            for (size_t i = 0; i < groups.size(); ++i)
+            {
+                zooms[i] = zoom;
+                heightfields[i] = Find(groups[i].Tile.x, groups[i].Tile.y, zooms[i]);
+            }
+        }
+
+        std::vector<float> heights(points.size(), 0.0f);
+        std::vector<glm::vec2> uvs;
+        std::vector<float> groupHeights;
+        for (size_t i = 0; i < groups.size(); ++i)
+        {
+            const Group& group = groups[i];
+            if (!heightfields[i])
+                continue;
+
+            // Tile UVs within the tile or ancestor that was found
+            int levels = zoom - zooms[i];
+            glm::dvec2 origin(group.Tile.x >> levels, group.Tile.y >> levels);
+            double scale = (double)(1 << zooms[i]);
+
+            size_t count = group.End - group.Begin;
+            uvs.resize(count);
+            groupHeights.resize(count);
+            for (size_t j = 0; j < count; ++j)
+                uvs[j] = glm::vec2(samples[group.Begin + j].UV * scale - origin);
+
+            heightfields[i]->GetHeights(uvs, groupHeights);
+            for (size_t j = 0; j < count; ++j)
+                heights[samples[group.Begin + j].Index] = groupHeights[j];
+        }
+
+        if (!fetched.empty())
+        {
+            std::unique_lock<std::shared_mutex> lock(m_Mutex);
+            for (std::shared_ptr<const Heightfield>& heightfield : fetched)
+                m_Fetched.push_back(std::move(heightfield));
+            while (m_Fetched.size() > FETCHED_CAPACITY)
+                m_Fetched.pop_front();
+        }
+        return heights;
+    }
+
+    size_t HeightfieldCache::GetCount() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_Mutex);
+        return std::count_if(m_Entries.begin(), m_Entries.end(),
+                             [](const auto& entry) { return !entry.second.expired(); });
+    }
+
+    std::shared_ptr<const Heightfield> HeightfieldCache::Find(int x, int y, int& z) const
+    {
+        for (; z >= 0; --z, x >>= 1, y >>= 1)
+        {
+            auto it = m_Entries.find(GetKey(x, y, z));
+            if (it == m_Entries.end())
+                continue;
+            if (std::shared_ptr<const Heightfield> heightfield = it->second.lock())
+                return heightfield;
+        }
+        return nullptr;
+    }
+
+    std::vector<std::shared_ptr<const Heightfield>> HeightfieldCache::Fetch(std::shared_ptr<TileSource> source,
+                                                                            std::vector<glm::ivec2> tiles, int zoom)
+    {
+        if (tiles.empty())
+            return {};
+
+        auto batch = std::make_shared<FetchBatch>();
+        batch->Source = std::move(source);
+        batch->Tiles = std::move(tiles);
+        batch->Zoom = zoom;
+        batch->Results.resize(batch->Tiles.size());
+
+        size_t helpers = std::min(MAX_PARALLEL_FETCHES, batch->Tiles.size()) - 1;
+        for (size_t i = 0; i < helpers; ++i)
+            m_ThreadPool.Enqueue([batch] { FetchTiles(*batch); });
+        FetchTiles(*batch);
+        {
+            std::unique_lock<std::mutex> lock(batch->Mutex);
+            batch->Done.wait(lock, [&] { return batch->Finished == batch->Tiles.size(); });
+        }
+
+        std::vector<std::shared_ptr<const Heightfield>> fetched;
+        std::unique_lock<std::shared_mutex> lock(m_Mutex);
+        for (size_t i = 0; i < batch->Tiles.size(); ++i)
+        {
+            if (!batch->Results[i])
+                continue;
+            m_Entries[GetKey(batch->Tiles[i].x, batch->Tiles[i].y, zoom)] = batch->Results[i];
+            fetched.push_back(std::move(batch->Results[i]));
+        }
+        return fetched;
+    }
+}
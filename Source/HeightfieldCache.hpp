@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Heightfield.hpp"
+#include "ThreadPool.hpp"
+#include "TileSource.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace Earth
+{
+    // A point on the globe in degrees.
+    struct LonLat
+    {
+        double Lon = 0.0;
+        double Lat = 0.0;
+    };
+
+    // Answers elevation queries on the CPU from the heightfields of resident terrain tiles, for route
+    // profiles and placing overlays. Tiles register their heightfields as they upload and the cache only
+    // holds weak references to them, so an entry lapses once its tile is evicted. Safe to query from any
+    // thread.
+    class HeightfieldCache
+    {
+      public:
+        // Heightfields fetched for waiting queries are kept for later ones, up to this many.
+        static constexpr size_t FETCHED_CAPACITY = 32;
+        // Tiles a waiting query fetches at once, counting the calling thread.
+        static constexpr size_t MAX_PARALLEL_FETCHES = 8;
+
+        // Waiting queries fetch missing tiles on `threadPool`.
+        HeightfieldCache(ThreadPool& threadPool);
+
+        void Insert(int x, int y, int z, std::shared_ptr<const Heightfield> heightfield);
+
+        // Where waiting queries fetch missing tiles from. Its max zoom also caps the zoom of queries.
+        void SetSource(std::shared_ptr<TileSource> source);
+
+        // Heights in meters at `points`, from tiles at `zoom` or the nearest resident ancestor. Points
+        // are grouped by tile, so each tile is looked up once per call however many points fall on it.
+        // With `wait`, tiles at `zoom` that aren't resident are fetched and decoded first, blocking the
+        // caller, so call it from a worker rather than the main thread. Points without any terrain get 0.
+        std::vector<float> SampleElevations(std::span<const LonLat> points, int zoom = TileSource::MAX_ZOOM,
+                                            bool wait = false);
+
+        // Tiles registered and still alive.
+        size_t GetCount() const;
+
+      private:
+        static uint64_t GetKey(int x, int y, int z)
+        {
+            return ((uint64_t)z << 58) | ((uint64_t)y << 29) | (uint64_t)x;
+        }
+        // The heightfield of the tile or its nearest resident ancestor, with the zoom it was found at.
+        // Callers hold m_Mutex.
+        std::shared_ptr<const Heightfield> Find(int x, int y, int& z) const;
+        // Fetches and decodes tiles at `zoom` on the workers and registers them. The caller takes
+        // tiles too, so a query made from a worker finishes even when every other worker is busy.
+        // Returns the heightfields fetched, which only the caller holds until it retains them.
+        std::vector<std::shared_ptr<const Heightfield>> Fetch(std::shared_ptr<TileSource> source,
+                                                              std::vector<glm::ivec2> tiles, int zoom);
+
+        ThreadPool& m_ThreadPool;
+        mutable std::shared_mutex m_Mutex;
+        std::unordered_map<uint64_t, std::weak_ptr<const Heightfield>> m_Entries;
+        // Keeps fetched heightfields alive, which no tile owns. Oldest first.
+        std::deque<std::shared_ptr<const Heightfield>> m_Fetched;
+        std::shared_ptr<TileSource> m_Source;
+        size_t m_InsertsSincePurge = 0;
+    };
+}
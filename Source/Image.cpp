@@ -1,102 +1,95 @@
 #include "Image.hpp"
+#include "ImageDecoder.hpp"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
 #include <webp/decode.h>
 
+#include <cstring>
 #include <stdexcept>
-#include <vector>
 
 namespace Earth
 {
-    Image::Image(const std::string& data, bool flipVertically)
+    Image::Image(std::span<const unsigned char> data, bool flipVertically)
     {
-        // Check if it is WebP
-        if (WebPGetInfo(reinterpret_cast<const uint8_t*>(data.data()), data.size(), &m_Width, &m_Height))
-        {
-            m_Channels = 4;
-            m_Data = WebPDecodeRGBA(reinterpret_cast<const uint8_t*>(data.data()), data.size(), &m_Width, &m_Height);
-            m_IsWebP = true;
-
-            if (!m_Data)
-            {
-                throw std::runtime_error("Failed to decode WebP image");
-            }
+        ImageDecoder* decoder = ImageDecoders::Find(data);
+        if (!decoder)
+            throw std::runtime_error("Unsupported image format");
 
-            if (flipVertically)
-            {
-                int stride = m_Width * m_Channels;
-                std::vector<unsigned char> row(stride);
-                for (int y = 0; y < m_Height / 2; ++y)
-                {
-                    unsigned char* top = m_Data + y * stride;
-                    unsigned char* bottom = m_Data + (m_Height - 1 - y) * stride;
-                    memcpy(row.data(), top, stride);
-                    memcpy(top, bottom, stride);
-                    memcpy(bottom, row.data(), stride);
-                }
-            }
-        }
-        else
-        {
-            stbi_set_flip_vertically_on_load(flipVertically);
+        decoder->GetInfo(data, m_Width, m_Height);
+        m_Pixels.resize((size_t)m_Width * m_Height * 4);
+        decoder->Decode(data, m_Pixels, flipVertically);
+    }
 
-            m_Data = stbi_load_from_memory(reinterpret_cast<const unsigned char*>(data.data()),
-                                           static_cast<int>(data.size()), &m_Width, &m_Height, &m_Channels, 0);
+    Image::Image(std::vector<unsigned char> pixels, int width, int height)
+        : m_Width(width), m_Height(height), m_Pixels(std::move(pixels))
+    {
+    }
 
-            if (!m_Data)
-            {
-                throw std::runtime_error(std::string("Failed to load image from memory: ") + stbi_failure_reason());
-            }
-        }
+    std::vector<unsigned char> Image::TakePixels()
+    {
+        m_Width = 0;
+        m_Height = 0;
+        return std::move(m_Pixels);
     }
 
-    Image::Image(Image&& other) noexcept
-        : m_Width(other.m_Width), m_Height(other.m_Height), m_Channels(other.m_Channels), m_Data(other.m_Data),
-          m_IsWebP(other.m_IsWebP)
+    ImageStream::~ImageStream()
     {
-        other.m_Data = nullptr;
-        other.m_Width = 0;
-        other.m_Height = 0;
-        other.m_Channels = 0;
-        other.m_IsWebP = false;
+        if (m_Decoder)
+            WebPIDelete(m_Decoder);
     }
 
-    Image& Image::operator=(Image&& other) noexcept
+    void ImageStream::Append(std::span<const unsigned char> data)
     {
-        if (this != &other)
+        if (m_State == State::Header)
         {
-            if (m_Data)
+            m_Header.insert(m_Header.end(), data.begin(), data.end());
+
+            // "RIFF" <size> "WEBP"
+            constexpr size_t SIGNATURE_SIZE = 12;
+            if (m_Header.size() < SIGNATURE_SIZE)
+                return;
+            if (std::memcmp(m_Header.data(), "RIFF", 4) != 0 || std::memcmp(m_Header.data() + 8, "WEBP", 4) != 0)
             {
-                if (m_IsWebP)
-                    WebPFree(m_Data);
-                else
-                    stbi_image_free(m_Data);
+                m_State = State::Unsupported;
+                m_Header = {};
+                return;
             }
 
-            m_Width = other.m_Width;
-            m_Height = other.m_Height;
-            m_Channels = other.m_Channels;
-            m_Data = other.m_Data;
-            m_IsWebP = other.m_IsWebP;
-
-            other.m_Data = nullptr;
-            other.m_Width = 0;
-            other.m_Height = 0;
-            other.m_Channels = 0;
-            other.m_IsWebP = false;
+            // The dimensions follow within the first few dozen bytes.
+            if (!WebPGetInfo(m_Header.data(), m_Header.size(), &m_Width, &m_Height))
+                return;
+
+            StartDecoding();
+            data = m_Header;
         }
-        return *this;
+
+        if (m_State != State::Decoding)
+            return;
+
+        VP8StatusCode status = WebPIAppend(m_Decoder, data.data(), data.size());
+        if (status == VP8_STATUS_OK)
+            m_State = State::Complete;
+        else if (status != VP8_STATUS_SUSPENDED)
+            m_State = State::Unsupported;
+
+        if (m_State != State::Header)
+            m_Header = {};
     }
 
-    Image::~Image()
+    Image ImageStream::TakeImage()
     {
-        if (m_Data)
-        {
-            if (m_IsWebP)
-                WebPFree(m_Data);
-            else
-                stbi_image_free(m_Data);
-        }
+        if (m_State != State::Complete)
+            throw std::runtime_error("Image stream is not complete");
+
+        m_State = State::Unsupported;
+        return Image(std::move(m_Output), m_Width, m_Height);
+    }
+
+    void ImageStream::StartDecoding()
+    {
+        // Decode straight into the buffer the Image will own, so finishing needs no copy.
+        size_t stride = (size_t)m_Width * 4;
+        m_Output.resize(stride * m_Height);
+        m_Decoder = WebPINewRGB(MODE_RGBA, m_Output.data(), m_Output.size(), (int)stride);
+        m_State = m_Decoder ? State::Decoding : State::Unsupported;
     }
 }
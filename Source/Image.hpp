@@ -1,18 +1,19 @@
 #pragma once
 
-#include <string>
+#include <span>
+#include <vector>
+
+struct WebPIDecoder;
 
 namespace Earth
 {
+    // A decoded image, always RGBA8 with tightly packed rows.
     class Image
     {
       public:
         Image() = default;
-        Image(const std::string& data, bool flipVertically = false);
-        Image(Image&& other) noexcept;
-        Image& operator=(Image&& other) noexcept;
-
-        ~Image();
+        // Decodes with the first ImageDecoders entry that accepts the data.
+        Image(std::span<const unsigned char> data, bool flipVertically = false);
 
         int GetWidth() const
         {
@@ -24,18 +25,65 @@ namespace Earth
         }
         int GetChannels() const
         {
-            return m_Channels;
+            return 4;
         }
         const unsigned char* GetData() const
         {
-            return m_Data;
+            return m_Pixels.data();
         }
 
+        // Moves the pixels out, leaving the image empty.
+        std::vector<unsigned char> TakePixels();
+
       private:
+        friend class ImageStream;
+
+        Image(std::vector<unsigned char> pixels, int width, int height);
+
+        int m_Width = 0;
+        int m_Height = 0;
+        std::vector<unsigned char> m_Pixels;
+    };
+
+    // Decodes an image while its bytes arrive, so decoding overlaps the download. WebP is decoded
+    // incrementally; anything else is left for the caller to decode from the complete bytes.
+    class ImageStream
+    {
+      public:
+        ImageStream() = default;
+        ~ImageStream();
+
+        ImageStream(const ImageStream&) = delete;
+        ImageStream& operator=(const ImageStream&) = delete;
+
+        void Append(std::span<const unsigned char> data);
+
+        // True once the last byte of a streamable image has been decoded.
+        bool IsComplete() const
+        {
+            return m_State == State::Complete;
+        }
+        // Hands over the decoded image. Only valid when IsComplete().
+        Image TakeImage();
+
+      private:
+        enum class State
+        {
+            Header,
+            Decoding,
+            Complete,
+            // Not a streamable format, or invalid data
+            Unsupported
+        };
+
+        void StartDecoding();
+
+        State m_State = State::Header;
+        // Bytes held back until the header says how large the output is
+        std::vector<unsigned char> m_Header;
+        WebPIDecoder* m_Decoder = nullptr;
+        std::vector<unsigned char> m_Output;
         int m_Width = 0;
         int m_Height = 0;
-        int m_Channels = 0;
-        unsigned char* m_Data = nullptr;
-        bool m_IsWebP = false;
     };
 }
@@ -0,0 +1,310 @@
+#include "ImageDecoder.hpp"
+
+#include <spng.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <turbojpeg.h>
+#include <webp/decode.h>
+
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <string>
+
+namespace Earth
+{
+    namespace
+    {
+        bool HasSignature(std::span<const unsigned char> data, std::span<const unsigned char> signature,
+                          size_t offset = 0)
+        {
+            return data.size() >= offset + signature.size() &&
+                   std::memcmp(data.data() + offset, signature.data(), signature.size()) == 0;
+        }
+
+        void CheckOutputSize(std::span<unsigned char> output, int width, int height)
+        {
+            if (output.size() != (size_t)width * height * 4)
+                throw std::runtime_error("Image output buffer does not match the image size");
+        }
+
+        // libjpeg-turbo, with SIMD IDCT and color conversion.
+        class TurboJPEGDecoder : public ImageDecoder
+        {
+          public:
+            const char* GetName() const override
+            {
+                return "JPEG (libjpeg-turbo)";
+            }
+
+            bool CanDecode(std::span<const unsigned char> data) const override
+            {
+                static constexpr unsigned char SIGNATURE[] = {0xFF, 0xD8, 0xFF};
+                return HasSignature(data, SIGNATURE);
+            }
+
+            void GetInfo(std::span<const unsigned char> data, int& width, int& height) const override
+            {
+                int subsampling = 0;
+                int colorspace = 0;
+                tjhandle handle = GetHandle();
+                if (tjDecompressHeader3(handle, data.data(), (unsigned long)data.size(), &width, &height, &subsampling,
+                                        &colorspace) != 0)
+                    throw std::runtime_error(std::format("Failed to read JPEG header: {}", tjGetErrorStr2(handle)));
+            }
+
+          protected:
+            void DecodeRGBA(std::span<const unsigned char> data, std::span<unsigned char> output,
+                            bool flipVertically) override
+            {
+                int width = 0;
+                int height = 0;
+                GetInfo(data, width, height);
+                CheckOutputSize(output, width, height);
+
+                // The default accurate IDCT: with SIMD it costs little more than TJFLAG_FASTDCT, which
+                // visibly blurs fine detail in satellite imagery.
+                int flags = flipVertically ? TJFLAG_BOTTOMUP : 0;
+                if (tjDecompress2(GetHandle(), data.data(), (unsigned long)data.size(), output.data(), width,
+                                  width * 4, height, TJPF_RGBA, flags) != 0)
+                    throw std::runtime_error(std::format("Failed to decode JPEG: {}", tjGetErrorStr2(GetHandle())));
+            }
+
+          private:
+            // Handles are not thread-safe, so each worker keeps its own.
+            static tjhandle GetHandle()
+            {
+                thread_local std::unique_ptr<void, int (*)(tjhandle)> s_Handle(tjInitDecompress(), tjDestroy);
+                if (!s_Handle)
+                    throw std::runtime_error("Failed to initialize TurboJPEG");
+                return s_Handle.get();
+            }
+        };
+
+        class SPNGDecoder : public ImageDecoder
+        {
+          public:
+            const char* GetName() const override
+            {
+                return "PNG (libspng)";
+            }
+
+            bool CanDecode(std::span<const unsigned char> data) const override
+            {
+                static constexpr unsigned char SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+                return HasSignature(data, SIGNATURE);
+            }
+
+            void GetInfo(std::span<const unsigned char> data, int& width, int& height) const override
+            {
+                Context context(data);
+                spng_ihdr header;
+                Check(spng_get_ihdr(context.Get(), &header));
+                width = (int)header.width;
+                height = (int)header.height;
+            }
+
+          protected:
+            void DecodeRGBA(std::span<const unsigned char> data, std::span<unsigned char> output,
+                            bool flipVertically) override
+            {
+                Context context(data);
+                spng_ihdr header;
+                Check(spng_get_ihdr(context.Get(), &header));
+                CheckOutputSize(output, (int)header.width, (int)header.height);
+
+                // Decoding row by row lets each row land where the orientation wants it. Interlaced
+                // images visit rows several times, filling in one pass's pixels each time.
+                Check(spng_decode_image(context.Get(), nullptr, 0, SPNG_FMT_RGBA8,
+                                        SPNG_DECODE_TRNS | SPNG_DECODE_PROGRESSIVE));
+
+                size_t stride = (size_t)header.width * 4;
+                int result = 0;
+                do
+                {
+                    spng_row_info row;
+                    result = spng_get_row_info(context.Get(), &row);
+                    if (result != 0)
+                        break;
+
+                    uint32_t y = flipVertically ? header.height - 1 - row.row_num : row.row_num;
+                    result = spng_decode_row(context.Get(), output.data() + y * stride, stride);
+                } while (result == 0);
+
+                if (result != SPNG_EOI)
+                    Check(result);
+            }
+
+          private:
+            class Context
+            {
+              public:
+                Context(std::span<const unsigned char> data) : m_Context(spng_ctx_new(0))
+                {
+                    if (!m_Context)
+                        throw std::runtime_error("Failed to create PNG decoder");
+                    Check(spng_set_png_buffer(m_Context, data.data(), data.size()));
+                }
+                ~Context()
+                {
+                    spng_ctx_free(m_Context);
+                }
+
+                Context(const Context&) = delete;
+                Context& operator=(const Context&) = delete;
+
+                spng_ctx* Get() const
+                {
+                    return m_Context;
+                }
+
+              private:
+                spng_ctx* m_Context;
+            };
+
+            static void Check(int result)
+            {
+                if (result != 0)
+                    throw std::runtime_error(std::format("Failed to decode PNG: {}", spng_strerror(result)));
+            }
+        };
+
+        class WebPDecoder : public ImageDecoder
+        {
+          public:
+            const char* GetName() const override
+            {
+                return "WebP (libwebp)";
+            }
+
+            bool CanDecode(std::span<const unsigned char> data) const override
+            {
+                static constexpr unsigned char RIFF[] = {'R', 'I', 'F', 'F'};
+                static constexpr unsigned char WEBP[] = {'W', 'E', 'B', 'P'};
+                return HasSignature(data, RIFF) && HasSignature(data, WEBP, 8);
+            }
+
+            void GetInfo(std::span<const unsigned char> data, int& width, int& height) const override
+            {
+                if (!WebPGetInfo(data.data(), data.size(), &width, &height))
+                    throw std::runtime_error("Failed to read WebP header");
+            }
+
+          protected:
+            void DecodeRGBA(std::span<const unsigned char> data, std::span<unsigned char> output,
+                            bool flipVertically) override
+            {
+                WebPDecoderConfig config;
+                if (!WebPInitDecoderConfig(&config))
+                    throw std::runtime_error("Incompatible libwebp version");
+
+                int width = 0;
+                int height = 0;
+                GetInfo(data, width, height);
+                CheckOutputSize(output, width, height);
+
+                config.options.flip = flipVertically;
+                config.output.colorspace = MODE_RGBA;
+                config.output.is_external_memory = 1;
+                config.output.u.RGBA.rgba = output.data();
+                config.output.u.RGBA.stride = width * 4;
+                config.output.u.RGBA.size = output.size();
+
+                VP8StatusCode status = WebPDecode(data.data(), data.size(), &config);
+                WebPFreeDecBuffer(&config.output);
+                if (status != VP8_STATUS_OK)
+                    throw std::runtime_error(std::format("Failed to decode WebP image: status {}", (int)status));
+            }
+        };
+
+        // Fallback for the formats stb_image knows that no faster decoder claimed.
+        class STBDecoder : public ImageDecoder
+        {
+          public:
+            const char* GetName() const override
+            {
+                return "Other (stb_image)";
+            }
+
+            bool CanDecode(std::span<const unsigned char> data) const override
+            {
+                int width, height, channels;
+                return stbi_info_from_memory(data.data(), (int)data.size(), &width, &height, &channels) != 0;
+            }
+
+            void GetInfo(std::span<const unsigned char> data, int& width, int& height) const override
+            {
+                int channels = 0;
+                if (!stbi_info_from_memory(data.data(), (int)data.size(), &width, &height, &channels))
+                    throw std::runtime_error(std::string("Failed to read image header: ") + stbi_failure_reason());
+            }
+
+          protected:
+            void DecodeRGBA(std::span<const unsigned char> data, std::span<unsigned char> output,
+                            bool flipVertically) override
+            {
+                stbi_set_flip_vertically_on_load_thread(flipVertically);
+
+                int width, height, channels;
+                unsigned char* pixels =
+                    stbi_load_from_memory(data.data(), (int)data.size(), &width, &height, &channels, 4);
+                if (!pixels)
+                    throw std::runtime_error(std::string("Failed to load image from memory: ") + stbi_failure_reason());
+
+                std::unique_ptr<unsigned char, void (*)(void*)> owner(pixels, stbi_image_free);
+                CheckOutputSize(output, width, height);
+                std::memcpy(output.data(), pixels, (size_t)width * height * 4);
+            }
+        };
+
+        std::vector<std::unique_ptr<ImageDecoder>>& GetDecoders()
+        {
+            static std::vector<std::unique_ptr<ImageDecoder>> s_Decoders = []() {
+                std::vector<std::unique_ptr<ImageDecoder>> decoders;
+                decoders.push_back(std::make_unique<TurboJPEGDecoder>());
+                decoders.push_back(std::make_unique<SPNGDecoder>());
+                decoders.push_back(std::make_unique<WebPDecoder>());
+                decoders.push_back(std::make_unique<STBDecoder>());
+                return decoders;
+            }();
+            return s_Decoders;
+        }
+    }
+
+    void ImageDecoder::Decode(std::span<const unsigned char> data, std::span<unsigned char> output,
+                              bool flipVertically)
+    {
+        auto start = std::chrono::steady_clock::now();
+        DecodeRGBA(data, output, flipVertically);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        m_Stats.Images++;
+        m_Stats.Pixels += output.size() / 4;
+        m_Stats.Nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    }
+
+    namespace ImageDecoders
+    {
+        const std::vector<std::unique_ptr<ImageDecoder>>& GetAll()
+        {
+            return GetDecoders();
+        }
+
+        void Register(std::unique_ptr<ImageDecoder> decoder)
+        {
+            auto& decoders = GetDecoders();
+            decoders.insert(decoders.begin(), std::move(decoder));
+        }
+
+        ImageDecoder* Find(std::span<const unsigned char> data)
+        {
+            for (auto& decoder : GetDecoders())
+            {
+                if (decoder->CanDecode(data))
+                    return decoder.get();
+            }
+            return nullptr;
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace Earth
+{
+    // Decodes one image format straight into memory owned by the caller, always as tightly packed
+    // RGBA8 rows.
+    class ImageDecoder
+    {
+      public:
+        struct Stats
+        {
+            std::atomic<uint64_t> Images = 0;
+            std::atomic<uint64_t> Pixels = 0;
+            std::atomic<uint64_t> Nanoseconds = 0;
+
+            float GetMegapixelsPerSecond() const
+            {
+                return Nanoseconds ? (float)Pixels * 1000.0f / (float)Nanoseconds : 0.0f;
+            }
+        };
+
+        virtual ~ImageDecoder() = default;
+
+        virtual const char* GetName() const = 0;
+        // Whether `data` looks like this decoder's format.
+        virtual bool CanDecode(std::span<const unsigned char> data) const = 0;
+        // Reads the dimensions from the header. Throws if the data is not a valid image.
+        virtual void GetInfo(std::span<const unsigned char> data, int& width, int& height) const = 0;
+
+        // Decodes into `output`, which must be exactly width * height * 4 bytes. With `flipVertically`
+        // the bottom row comes first. Throws on errors.
+        void Decode(std::span<const unsigned char> data, std::span<unsigned char> output, bool flipVertically);
+
+        const Stats& GetStats() const
+        {
+            return m_Stats;
+        }
+
+      protected:
+        virtual void DecodeRGBA(std::span<const unsigned char> data, std::span<unsigned char> output,
+                                bool flipVertically) = 0;
+
+      private:
+        Stats m_Stats;
+    };
+
+    namespace ImageDecoders
+    {
+        // All decoders in the order they are tried: TurboJPEG, libspng, libwebp, then stb_image for
+        // anything else.
+        const std::vector<std::unique_ptr<ImageDecoder>>& GetAll();
+
+        // Adds a decoder that is tried before the built-in ones. Not thread-safe; register decoders
+        // before any image is decoded.
+        void Register(std::unique_ptr<ImageDecoder> decoder);
+
+        // The first decoder that accepts `data`, or nullptr.
+        ImageDecoder* Find(std::span<const unsigned char> data);
+    }
+}
@@ -0,0 +1,90 @@
+#include "LODGovernor.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Earth
+{
+    namespace
+    {
+        // Time constant of the input smoothing, so a single slow frame or burst of requests doesn't
+        // swing the threshold.
+        constexpr float SMOOTHING_SECONDS = 0.5f;
+
+        // Below this pressure on every goal there is room to refine.
+        constexpr float HEADROOM = 0.8f;
+
+        // Rates in e-folds per second at full pressure. Overload hurts more than softness, so the
+        // governor backs off faster than it refines.
+        constexpr float COARSEN_RATE = 1.5f;
+        constexpr float REFINE_RATE = 0.3f;
+
+        // Longest step taken at once, so the first frame after an idle wait doesn't jump.
+        constexpr float MAX_STEP_SECONDS = 0.1f;
+    }
+
+    void LODGovernor::Update(const Measurements& measurements, float deltaTime)
+    {
+        if (deltaTime <= 0.0f)
+            return;
+
+        float rate = 0.0f;
+        if (m_HasSamples && measurements.DownloadedBytes >= m_LastDownloadedBytes)
+            rate = (float)(measurements.DownloadedBytes - m_LastDownloadedBytes) / deltaTime;
+        m_LastDownloadedBytes = measurements.DownloadedBytes;
+
+        float alpha = m_HasSamples ? 1.0f - std::exp(-deltaTime / SMOOTHING_SECONDS) : 1.0f;
+        m_FrameMs += (measurements.FrameMs - m_FrameMs) * alpha;
+        m_PendingLoads += ((float)measurements.PendingLoads - m_PendingLoads) * alpha;
+        m_BytesPerSecond += (rate - m_BytesPerSecond) * alpha;
+        m_HasSamples = true;
+
+        m_Pressures[(size_t)Goal::FrameTime] = m_FrameMs / std::max(m_Targets.FrameMs, 0.1f);
+        m_Pressures[(size_t)Goal::Backlog] = m_PendingLoads / (float)std::max(m_Targets.PendingLoads, 1);
+        m_Pressures[(size_t)Goal::Memory] = measurements.MemoryUse / std::max(m_Targets.MemoryUse, 0.01f);
+        m_Pressures[(size_t)Goal::Bandwidth] =
+            m_Targets.MegabytesPerSecond > 0.0f ? m_BytesPerSecond / (m_Targets.MegabytesPerSecond * 1024 * 1024)
+                                                : 0.0f;
+
+        auto limiting = std::max_element(m_Pressures.begin(), m_Pressures.end());
+        m_LimitingGoal = (Goal)(limiting - m_Pressures.begin());
+        float pressure = *limiting;
+
+        if (!m_Enabled)
+        {
+            m_Threshold = DEFAULT_THRESHOLD;
+            m_IsAdjusting = false;
+            return;
+        }
+
+        // Step in log space, proportional to how far off target the worst goal is, capped at the
+        // full rate.
+        float step = 0.0f;
+        if (pressure > 1.0f)
+            step = COARSEN_RATE * std::min(std::log(pressure), 1.0f);
+        else if (pressure < HEADROOM)
+            step = -REFINE_RATE * std::min(std::log(HEADROOM / std::max(pressure, 0.01f)), 1.0f);
+
+        step *= std::min(deltaTime, MAX_STEP_SECONDS);
+        float threshold = std::clamp(m_Threshold * std::exp(step), MIN_THRESHOLD, MAX_THRESHOLD);
+        m_IsAdjusting = threshold != m_Threshold;
+        m_Threshold = threshold;
+    }
+
+    const char* LODGovernor::GetGoalName(Goal goal)
+    {
+        switch (goal)
+        {
+        case Goal::FrameTime:
+            return "Frame time";
+        case Goal::Backlog:
+            return "Backlog";
+        case Goal::Memory:
+            return "Memory";
+        case Goal::Bandwidth:
+            return "Bandwidth";
+        default:
+            return "Unknown";
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace Earth
+{
+    // Closed-loop control of the quadtree's split threshold (screen-space error in pixels). Whichever
+    // goal is furthest over its target coarsens the globe; when all of them have headroom it refines
+    // again. Between the two it holds still, so the threshold doesn't hunt.
+    class LODGovernor
+    {
+      public:
+        // Fixed threshold while the governor is disabled, and where it starts.
+        static constexpr float DEFAULT_THRESHOLD = 250.0f;
+        static constexpr float MIN_THRESHOLD = 100.0f;
+        static constexpr float MAX_THRESHOLD = 1000.0f;
+
+        enum class Goal
+        {
+            FrameTime,
+            Backlog,
+            Memory,
+            Bandwidth,
+            Count,
+        };
+
+        struct Targets
+        {
+            // CPU or GPU time spent on a frame, whichever is longer, excluding the wait for vsync.
+            float FrameMs = 12.0f;
+            // Tiles being fetched, decoded or waiting for upload.
+            int PendingLoads = 96;
+            // Fraction of the tightest memory budget limit in use.
+            float MemoryUse = 0.9f;
+            // Download rate; 0 is unlimited.
+            float MegabytesPerSecond = 0.0f;
+        };
+
+        struct Measurements
+        {
+            float FrameMs = 0.0f;
+            int PendingLoads = 0;
+            float MemoryUse = 0.0f;
+            // Total downloaded so far; the governor derives the rate.
+            uint64_t DownloadedBytes = 0;
+        };
+
+        // Call once per drawn frame.
+        void Update(const Measurements& measurements, float deltaTime);
+
+        float GetThreshold() const
+        {
+            return m_Threshold;
+        }
+        // Whether the threshold is still moving, so on-demand rendering keeps drawing until it settles.
+        bool IsAdjusting() const
+        {
+            return m_IsAdjusting;
+        }
+
+        bool IsEnabled() const
+        {
+            return m_Enabled;
+        }
+        void SetEnabled(bool enabled)
+        {
+            m_Enabled = enabled;
+        }
+
+        Targets& GetTargets()
+        {
+            return m_Targets;
+        }
+
+        // Smoothed measurement over target for each goal; above 1 means over target.
+        float GetPressure(Goal goal) const
+        {
+            return m_Pressures[(size_t)goal];
+        }
+        // The goal with the highest pressure.
+        Goal GetLimitingGoal() const
+        {
+            return m_LimitingGoal;
+        }
+        static const char* GetGoalName(Goal goal);
+
+        float GetFrameMs() const
+        {
+            return m_FrameMs;
+        }
+        float GetBytesPerSecond() const
+        {
+            return m_BytesPerSecond;
+        }
+
+      private:
+        Targets m_Targets;
+        bool m_Enabled = true;
+
+        float m_Threshold = DEFAULT_THRESHOLD;
+        bool m_IsAdjusting = false;
+        std::array<float, (size_t)Goal::Count> m_Pressures = {};
+        Goal m_LimitingGoal = Goal::FrameTime;
+
+        // Smoothed inputs
+        float m_FrameMs = 0.0f;
+        float m_PendingLoads = 0.0f;
+        float m_BytesPerSecond = 0.0f;
+        uint64_t m_LastDownloadedBytes = 0;
+        bool m_HasSamples = false;
+    };
+}
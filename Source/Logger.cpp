@@ -4,7 +4,10 @@
 #include <spdlog/sinks/base_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
+#include <condition_variable>
+#include <deque>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 namespace Earth
@@ -43,6 +46,60 @@ namespace Earth
 
         std::shared_ptr<spdlog::sinks::stdout_color_sink_mt> s_ConsoleSink;
         std::shared_ptr<ImGuiSink<std::mutex>> s_ImGuiSink;
+
+        std::vector<std::shared_ptr<spdlog::logger>> s_Loggers;
+        std::mutex s_LoggersMutex;
+        std::atomic<int> s_Level = spdlog::level::info;
+
+        std::deque<std::function<void()>> s_AsyncQueue;
+        std::mutex s_AsyncMutex;
+        std::condition_variable s_AsyncCondition;
+        std::thread s_AsyncThread;
+        std::atomic<bool> s_Async = false;
+        bool s_AsyncStop = true;
+
+        void RunAsyncQueue()
+        {
+            for (;;)
+            {
+                std::deque<std::function<void()>> tasks;
+                {
+                    std::unique_lock<std::mutex> lock(s_AsyncMutex);
+                    s_AsyncCondition.wait(lock, [] { return s_AsyncStop || !s_AsyncQueue.empty(); });
+                    if (s_AsyncQueue.empty())
+                        return;
+                    std::swap(tasks, s_AsyncQueue);
+                }
+
+                for (auto& task : tasks)
+                    task();
+            }
+        }
+
+        const char* const s_LevelNames[] = {"Trace", "Debug", "Info", "Warn", "Error", "Fatal"};
+    }
+
+    LogRateLimit::LogRateLimit(int maxMessages, std::chrono::milliseconds interval)
+        : m_MaxMessages(maxMessages),
+          m_Interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval).count())
+    {
+    }
+
+    bool LogRateLimit::Acquire(int& suppressed)
+    {
+        Ticks now = std::chrono::steady_clock::now().time_since_epoch().count();
+        Ticks windowStart = m_WindowStart.load(std::memory_order_relaxed);
+        if (now - windowStart >= m_Interval && m_WindowStart.compare_exchange_strong(windowStart, now))
+            m_Count = 0;
+
+        if (m_Count.fetch_add(1, std::memory_order_relaxed) < m_MaxMessages)
+        {
+            suppressed = m_Suppressed.exchange(0);
+            return true;
+        }
+
+        m_Suppressed++;
+        return false;
     }
 
     void Logger::Init()
@@ -54,6 +111,86 @@ namespace Earth
         s_ImGuiSink->set_pattern("[%T] [%l] %n: %v");
     }
 
+    void Logger::Shutdown()
+    {
+        SetAsync(false);
+
+        std::lock_guard<std::mutex> lock(s_LoggersMutex);
+        for (auto& logger : s_Loggers)
+            logger->flush();
+    }
+
+    void Logger::SetLevel(Level level)
+    {
+        s_Level = level;
+
+        std::lock_guard<std::mutex> lock(s_LoggersMutex);
+        for (auto& logger : s_Loggers)
+            logger->set_level(level);
+    }
+
+    Logger::Level Logger::GetLevel()
+    {
+        return static_cast<Level>(s_Level.load());
+    }
+
+    void Logger::SetAsync(bool async)
+    {
+        if (async == s_Async)
+            return;
+
+        if (async)
+        {
+            {
+                std::lock_guard<std::mutex> lock(s_AsyncMutex);
+                s_AsyncStop = false;
+            }
+            s_AsyncThread = std::thread(RunAsyncQueue);
+            s_Async = true;
+        }
+        else
+        {
+            // Stop accepting new messages first, then let the thread drain what is queued.
+            s_Async = false;
+            {
+                std::lock_guard<std::mutex> lock(s_AsyncMutex);
+                s_AsyncStop = true;
+            }
+            s_AsyncCondition.notify_one();
+            s_AsyncThread.join();
+
+            // A message that saw async mode just before the switch can be queued after the thread's
+            // last look at the queue.
+            std::deque<std::function<void()>> tasks;
+            {
+                std::lock_guard<std::mutex> lock(s_AsyncMutex);
+                std::swap(tasks, s_AsyncQueue);
+            }
+            for (auto& task : tasks)
+                task();
+        }
+    }
+
+    bool Logger::IsAsync()
+    {
+        return s_Async.load(std::memory_order_relaxed);
+    }
+
+    void Logger::Enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(s_AsyncMutex);
+            // Once the queue is stopping, nothing is left to drain it after this, so log in place.
+            if (!s_AsyncStop)
+            {
+                s_AsyncQueue.push_back(std::move(task));
+                s_AsyncCondition.notify_one();
+                return;
+            }
+        }
+        task();
+    }
+
     void Logger::Draw(bool* p_open)
     {
         if (!ImGui::Begin("Log", p_open))
@@ -68,6 +205,20 @@ namespace Earth
             s_LogMessages.clear();
         }
         ImGui::SameLine();
+
+        int level = GetLevel();
+        ImGui::SetNextItemWidth(80.0f);
+        if (ImGui::Combo("Level", &level, s_LevelNames, IM_ARRAYSIZE(s_LevelNames)))
+            SetLevel(static_cast<Level>(level));
+        if (level < CompiledLevel && ImGui::IsItemHovered())
+            ImGui::SetTooltip("Messages below %s are compiled out of this build", s_LevelNames[CompiledLevel]);
+        ImGui::SameLine();
+
+        bool async = IsAsync();
+        if (ImGui::Checkbox("Async", &async))
+            SetAsync(async);
+        ImGui::SameLine();
+
         s_Filter.Draw("Filter", -100.0f);
 
         ImGui::Separator();
@@ -131,6 +282,9 @@ namespace Earth
         sinks.push_back(s_ImGuiSink);
 
         m_Logger = std::make_shared<spdlog::logger>(std::string(name), sinks.begin(), sinks.end());
-        m_Logger->set_level(spdlog::level::trace);
+        m_Logger->set_level(GetLevel());
+
+        std::lock_guard<std::mutex> lock(s_LoggersMutex);
+        s_Loggers.push_back(m_Logger);
     }
 }
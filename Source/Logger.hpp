@@ -3,50 +3,194 @@
 #include <spdlog/fmt/ostr.h>
 #include <spdlog/spdlog.h>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
 #include <string_view>
+#include <tuple>
+#include <type_traits>
+
+// Minimum level compiled into the binary (0 = trace, 1 = debug, 2 = info, 3 = warn, 4 = error, 5 = fatal).
+// Logger calls below it skip formatting and dispatch, but their arguments are still evaluated at the
+// call site. The EARTH_LOG_* macros below drop the whole call, arguments included.
+#ifndef EARTH_LOG_LEVEL
+#define EARTH_LOG_LEVEL 0
+#endif
+
+// Logs through `logger` when `severity` is compiled in, e.g. EARTH_LOG_DEBUG(s_Logger, limit, "{}", Describe()).
+// Use these where computing the arguments costs something.
+#define EARTH_LOG_AT(severity, method, logger, ...)                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (::spdlog::level::severity >= ::Earth::Logger::CompiledLevel)                                     \
+            (logger).method(__VA_ARGS__);                                                                              \
+    } while (0)
+#define EARTH_LOG_DEBUG(logger, ...) EARTH_LOG_AT(debug, Debug, logger, __VA_ARGS__)
+#define EARTH_LOG_INFO(logger, ...) EARTH_LOG_AT(info, Info, logger, __VA_ARGS__)
+#define EARTH_LOG_WARN(logger, ...) EARTH_LOG_AT(warn, Warn, logger, __VA_ARGS__)
+#define EARTH_LOG_ERROR(logger, ...) EARTH_LOG_AT(err, Error, logger, __VA_ARGS__)
 
 namespace Earth
 {
+    // Caps a call site at a number of messages per interval. Declare one as a static next to a
+    // hot-path log call and pass it as the first argument.
+    class LogRateLimit
+    {
+      public:
+        LogRateLimit(int maxMessages, std::chrono::milliseconds interval = std::chrono::seconds(1));
+
+        // Returns true if the message may be logged. `suppressed` receives the number of messages
+        // dropped since the last one that was allowed through.
+        bool Acquire(int& suppressed);
+
+      private:
+        using Ticks = std::chrono::steady_clock::duration::rep;
+
+        const int m_MaxMessages;
+        const Ticks m_Interval;
+        std::atomic<Ticks> m_WindowStart = 0;
+        std::atomic<int> m_Count = 0;
+        std::atomic<int> m_Suppressed = 0;
+    };
+
     class Logger
     {
       public:
+        using Level = spdlog::level::level_enum;
+
+        static constexpr Level CompiledLevel = static_cast<Level>(EARTH_LOG_LEVEL);
+
         static void Init();
+        static void Shutdown();
         static void Draw(bool* p_open = nullptr);
 
+        // Runtime level shared by all loggers. Levels below CompiledLevel stay stripped.
+        static void SetLevel(Level level);
+        static Level GetLevel();
+
+        // In async mode messages are formatted and written on a background thread, so the
+        // calling thread only copies the arguments.
+        static void SetAsync(bool async);
+        static bool IsAsync();
+
         Logger(std::string_view name);
 
         template <typename... Args>
         void Debug(spdlog::format_string_t<Args...> fmt, Args&&... args)
         {
-            m_Logger->debug(fmt, std::forward<Args>(args)...);
+            Log<spdlog::level::debug>(fmt, std::forward<Args>(args)...);
+        }
+
+        template <typename... Args>
+        void Debug(LogRateLimit& limit, spdlog::format_string_t<Args...> fmt, Args&&... args)
+        {
+            LogLimited<spdlog::level::debug>(limit, fmt, std::forward<Args>(args)...);
         }
 
         template <typename... Args>
         void Info(spdlog::format_string_t<Args...> fmt, Args&&... args)
         {
-            m_Logger->info(fmt, std::forward<Args>(args)...);
+            Log<spdlog::level::info>(fmt, std::forward<Args>(args)...);
+        }
+
+        template <typename... Args>
+        void Info(LogRateLimit& limit, spdlog::format_string_t<Args...> fmt, Args&&... args)
+        {
+            LogLimited<spdlog::level::info>(limit, fmt, std::forward<Args>(args)...);
         }
 
         template <typename... Args>
         void Warn(spdlog::format_string_t<Args...> fmt, Args&&... args)
         {
-            m_Logger->warn(fmt, std::forward<Args>(args)...);
+            Log<spdlog::level::warn>(fmt, std::forward<Args>(args)...);
+        }
+
+        template <typename... Args>
+        void Warn(LogRateLimit& limit, spdlog::format_string_t<Args...> fmt, Args&&... args)
+        {
+            LogLimited<spdlog::level::warn>(limit, fmt, std::forward<Args>(args)...);
         }
 
         template <typename... Args>
         void Error(spdlog::format_string_t<Args...> fmt, Args&&... args)
         {
-            m_Logger->error(fmt, std::forward<Args>(args)...);
+            Log<spdlog::level::err>(fmt, std::forward<Args>(args)...);
+        }
+
+        template <typename... Args>
+        void Error(LogRateLimit& limit, spdlog::format_string_t<Args...> fmt, Args&&... args)
+        {
+            LogLimited<spdlog::level::err>(limit, fmt, std::forward<Args>(args)...);
         }
 
         template <typename... Args>
         void Fatal(spdlog::format_string_t<Args...> fmt, Args&&... args)
         {
-            m_Logger->critical(fmt, std::forward<Args>(args)...);
+            Log<spdlog::level::critical>(fmt, std::forward<Args>(args)...);
         }
 
       private:
+        static void Enqueue(std::function<void()> task);
+
+        // Arguments are copied for the async queue; anything that may point at the caller's
+        // memory (C strings, string views) is copied into an owning string.
+        template <typename T>
+        static auto Capture(T&& value)
+        {
+            using Decayed = std::decay_t<T>;
+            if constexpr (std::is_same_v<Decayed, const char*> || std::is_same_v<Decayed, char*> ||
+                          std::is_same_v<Decayed, std::string_view>)
+                return std::string(value);
+            else
+                return Decayed(std::forward<T>(value));
+        }
+
+        template <Level L, typename... Args>
+        void Log(spdlog::format_string_t<Args...> fmt, Args&&... args)
+        {
+            if constexpr (L >= CompiledLevel)
+            {
+                if (!m_Logger->should_log(L))
+                    return;
+
+                if (!IsAsync())
+                {
+                    m_Logger->log(L, fmt, std::forward<Args>(args)...);
+                    return;
+                }
+
+                Enqueue([logger = m_Logger, time = spdlog::log_clock::now(), format = fmt::string_view(fmt),
+                         captured = std::make_tuple(Capture(std::forward<Args>(args))...)]() {
+                    std::apply(
+                        [&](const auto&... values) {
+                            std::string message = fmt::vformat(format, fmt::make_format_args(values...));
+                            logger->log(time, spdlog::source_loc{}, L, spdlog::string_view_t(message));
+                        },
+                        captured);
+                });
+            }
+        }
+
+        template <Level L, typename... Args>
+        void LogLimited(LogRateLimit& limit, spdlog::format_string_t<Args...> fmt, Args&&... args)
+        {
+            if constexpr (L >= CompiledLevel)
+            {
+                if (!m_Logger->should_log(L))
+                    return;
+
+                int suppressed = 0;
+                if (!limit.Acquire(suppressed))
+                    return;
+
+                if (suppressed > 0)
+                    Log<L>("({} similar messages suppressed)", suppressed);
+                Log<L>(fmt, std::forward<Args>(args)...);
+            }
+        }
+
         std::shared_ptr<spdlog::logger> m_Logger;
     };
 }
@@ -0,0 +1,229 @@
+#include "MBTiles.hpp"
+
+#include <sqlite3.h>
+
+#include <cstdio>
+#include <format>
+#include <stdexcept>
+
+namespace Earth
+{
+    MBTilesSource::MBTilesSource(const std::string& path)
+    {
+        if (sqlite3_open_v2(path.c_str(), &m_Database, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) !=
+            SQLITE_OK)
+        {
+            std::string error = sqlite3_errmsg(m_Database);
+            sqlite3_close(m_Database);
+            throw std::runtime_error(std::format("Failed to open {}: {}", path, error));
+        }
+
+        sqlite3_exec(m_Database, "PRAGMA mmap_size = 1073741824;", nullptr, nullptr, nullptr);
+
+        const char* sql = "SELECT tile_data FROM tiles WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?";
+        if (sqlite3_prepare_v2(m_Database, sql, -1, &m_Query, nullptr) != SQLITE_OK)
+        {
+            std::string error = sqlite3_errmsg(m_Database);
+            sqlite3_close(m_Database);
+            throw std::runtime_error(std::format("{} is not an MBTiles archive: {}", path, error));
+        }
+
+        // Indexed by the primary key, so these are single seeks.
+        sqlite3_stmt* zoom = nullptr;
+        const char* zoomSQL = "SELECT MIN(zoom_level), MAX(zoom_level) FROM tiles";
+        if (sqlite3_prepare_v2(m_Database, zoomSQL, -1, &zoom, nullptr) == SQLITE_OK)
+        {
+            if (sqlite3_step(zoom) == SQLITE_ROW && sqlite3_column_type(zoom, 0) != SQLITE_NULL)
+            {
+                m_MinZoom = sqlite3_column_int(zoom, 0);
+                m_MaxZoom = sqlite3_column_int(zoom, 1);
+            }
+            sqlite3_finalize(zoom);
+        }
+
+        // "west,south,east,north", optional in the spec.
+        sqlite3_stmt* bounds = nullptr;
+        const char* boundsSQL = "SELECT value FROM metadata WHERE name = 'bounds'";
+        if (sqlite3_prepare_v2(m_Database, boundsSQL, -1, &bounds, nullptr) == SQLITE_OK)
+        {
+            if (sqlite3_step(bounds) == SQLITE_ROW && sqlite3_column_type(bounds, 0) == SQLITE_TEXT)
+            {
+                const char* text = (const char*)sqlite3_column_text(bounds, 0);
+                double west, south, east, north;
+                if (std::sscanf(text, "%lf,%lf,%lf,%lf", &west, &south, &east, &north) == 4)
+                    m_Bounds = {west, south, east, north};
+            }
+            sqlite3_finalize(bounds);
+        }
+    }
+
+    MBTilesSource::~MBTilesSource()
+    {
+        sqlite3_finalize(m_Query);
+        sqlite3_close(m_Database);
+    }
+
+    TileData MBTilesSource::Fetch(int x, int y, int z, std::atomic<bool>* cancelled, const HTTP::SinkFactory& sink)
+    {
+        // MBTiles rows use TMS numbering, with y increasing northwards.
+        int row = (1 << z) - 1 - y;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        sqlite3_reset(m_Query);
+        sqlite3_bind_int(m_Query, 1, z);
+        sqlite3_bind_int(m_Query, 2, x);
+        sqlite3_bind_int(m_Query, 3, row);
+
+        int result = sqlite3_step(m_Query);
+        if (result == SQLITE_DONE)
+            return TileData();
+        if (result != SQLITE_ROW)
+            throw std::runtime_error(std::format("MBTiles query failed: {}", sqlite3_errmsg(m_Database)));
+
+        const char* blob = static_cast<const char*>(sqlite3_column_blob(m_Query, 0));
+        int size = sqlite3_column_bytes(m_Query, 0);
+        return TileData(std::string(blob, blob + size));
+    }
+
+    MBTilesWriter::MBTilesWriter(const std::string& path)
+    {
+        if (sqlite3_open_v2(path.c_str(), &m_Database, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) !=
+            SQLITE_OK)
+        {
+            std::string error = sqlite3_errmsg(m_Database);
+            sqlite3_close(m_Database);
+            throw std::runtime_error(std::format("Failed to open {}: {}", path, error));
+        }
+
+        try
+        {
+            Execute("PRAGMA journal_mode = WAL;");
+            Execute("CREATE TABLE IF NOT EXISTS metadata (name TEXT PRIMARY KEY, value TEXT);");
+            Execute("CREATE TABLE IF NOT EXISTS tiles (zoom_level INTEGER, tile_column INTEGER, tile_row INTEGER, "
+                    "tile_data BLOB, PRIMARY KEY (zoom_level, tile_column, tile_row));");
+
+            auto prepare = [&](const char* sql, sqlite3_stmt** statement) {
+                if (sqlite3_prepare_v2(m_Database, sql, -1, statement, nullptr) != SQLITE_OK)
+                    throw std::runtime_error(std::format("Failed to prepare query: {}", sqlite3_errmsg(m_Database)));
+            };
+            prepare("SELECT 1 FROM tiles WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?", &m_Exists);
+            prepare("INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)",
+                    &m_Insert);
+            prepare("INSERT OR REPLACE INTO metadata (name, value) VALUES (?, ?)", &m_Metadata);
+        }
+        catch (...)
+        {
+            sqlite3_finalize(m_Exists);
+            sqlite3_finalize(m_Insert);
+            sqlite3_finalize(m_Metadata);
+            sqlite3_close(m_Database);
+            throw;
+        }
+    }
+
+    MBTilesWriter::~MBTilesWriter()
+    {
+        try
+        {
+            Flush();
+        }
+        catch (const std::exception&)
+        {
+            // Nothing left to report to; the uncommitted batch is re-seeded on the next run.
+        }
+        sqlite3_finalize(m_Exists);
+        sqlite3_finalize(m_Insert);
+        sqlite3_finalize(m_Metadata);
+        sqlite3_close(m_Database);
+    }
+
+    bool MBTilesWriter::Contains(int x, int y, int z)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        sqlite3_reset(m_Exists);
+        sqlite3_bind_int(m_Exists, 1, z);
+        sqlite3_bind_int(m_Exists, 2, x);
+        sqlite3_bind_int(m_Exists, 3, (1 << z) - 1 - y);
+        return sqlite3_step(m_Exists) == SQLITE_ROW;
+    }
+
+    void MBTilesWriter::Write(int x, int y, int z, std::span<const unsigned char> data)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (!m_InTransaction)
+        {
+            Execute("BEGIN;");
+            m_InTransaction = true;
+        }
+
+        sqlite3_reset(m_Insert);
+        sqlite3_bind_int(m_Insert, 1, z);
+        sqlite3_bind_int(m_Insert, 2, x);
+        sqlite3_bind_int(m_Insert, 3, (1 << z) - 1 - y);
+        sqlite3_bind_blob(m_Insert, 4, data.data(), (int)data.size(), SQLITE_TRANSIENT);
+        if (sqlite3_step(m_Insert) != SQLITE_DONE)
+        {
+            // Only this tile fails; the batch stays open for the next write unless SQLite dropped it.
+            std::string message = sqlite3_errmsg(m_Database);
+            sqlite3_reset(m_Insert);
+            SyncTransaction();
+            throw std::runtime_error(std::format("Failed to write tile: {}", message));
+        }
+
+        if (++m_PendingWrites >= 256)
+            Commit();
+    }
+
+    void MBTilesWriter::SetMetadata(const std::string& name, const std::string& value)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        sqlite3_reset(m_Metadata);
+        sqlite3_bind_text(m_Metadata, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(m_Metadata, 2, value.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(m_Metadata) != SQLITE_DONE)
+            throw std::runtime_error(std::format("Failed to write metadata: {}", sqlite3_errmsg(m_Database)));
+    }
+
+    void MBTilesWriter::Flush()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_InTransaction)
+            Commit();
+    }
+
+    void MBTilesWriter::Commit()
+    {
+        try
+        {
+            Execute("COMMIT;");
+        }
+        catch (const std::exception&)
+        {
+            SyncTransaction();
+            throw;
+        }
+        m_InTransaction = false;
+        m_PendingWrites = 0;
+    }
+
+    void MBTilesWriter::SyncTransaction()
+    {
+        if (sqlite3_get_autocommit(m_Database))
+        {
+            m_InTransaction = false;
+            m_PendingWrites = 0;
+        }
+    }
+
+    void MBTilesWriter::Execute(const char* sql)
+    {
+        char* error = nullptr;
+        if (sqlite3_exec(m_Database, sql, nullptr, nullptr, &error) != SQLITE_OK)
+        {
+            std::string message = error ? error : "unknown error";
+            sqlite3_free(error);
+            throw std::runtime_error(std::format("SQLite error: {}", message));
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "TileSource.hpp"
+
+#include <mutex>
+#include <span>
+#include <string>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace Earth
+{
+    // Reads tiles from an MBTiles (SQLite) archive. SQLite's memory-mapped I/O is enabled, but blobs
+    // are only valid until the next step, so each tile is copied once into its TileData.
+    class MBTilesSource : public TileSource
+    {
+      public:
+        MBTilesSource(const std::string& path);
+        ~MBTilesSource();
+
+        MBTilesSource(const MBTilesSource&) = delete;
+        MBTilesSource& operator=(const MBTilesSource&) = delete;
+
+        TileData Fetch(int x, int y, int z, std::atomic<bool>* cancelled = nullptr,
+                       const HTTP::SinkFactory& sink = {}) override;
+
+        int GetMinZoom() const override
+        {
+            return m_MinZoom;
+        }
+        int GetMaxZoom() const override
+        {
+            return m_MaxZoom;
+        }
+        TileBounds GetBounds() const override
+        {
+            return m_Bounds;
+        }
+
+      private:
+        sqlite3* m_Database = nullptr;
+        sqlite3_stmt* m_Query = nullptr;
+        int m_MinZoom = 0;
+        int m_MaxZoom = MAX_ZOOM;
+        TileBounds m_Bounds;
+        std::mutex m_Mutex;
+    };
+
+    // Writes tiles into an MBTiles archive, creating the schema if needed. Safe to call from
+    // several threads; writes are batched into transactions.
+    class MBTilesWriter
+    {
+      public:
+        MBTilesWriter(const std::string& path);
+        ~MBTilesWriter();
+
+        MBTilesWriter(const MBTilesWriter&) = delete;
+        MBTilesWriter& operator=(const MBTilesWriter&) = delete;
+
+        bool Contains(int x, int y, int z);
+        void Write(int x, int y, int z, std::span<const unsigned char> data);
+        void SetMetadata(const std::string& name, const std::string& value);
+
+        // Commits any batched writes.
+        void Flush();
+
+      private:
+        void Execute(const char* sql);
+        // Commits the open batch. Callers hold m_Mutex.
+        void Commit();
+        // SQLite rolls a transaction back by itself after some errors; picks up whether it is still open.
+        void SyncTransaction();
+
+        sqlite3* m_Database = nullptr;
+        sqlite3_stmt* m_Exists = nullptr;
+        sqlite3_stmt* m_Insert = nullptr;
+        sqlite3_stmt* m_Metadata = nullptr;
+        int m_PendingWrites = 0;
+        bool m_InTransaction = false;
+        std::mutex m_Mutex;
+    };
+}
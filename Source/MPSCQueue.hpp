@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+namespace Earth
+{
+    // Unbounded lock-free queue for many producers and a single consumer, after Dmitry Vyukov's MPSC
+    // design. Push is an allocation, one exchange and one store. Pop never blocks, but may report the
+    // queue empty while a producer is halfway through a push; that item shows up on a later Pop.
+    template <class T>
+    class MPSCQueue
+    {
+      public:
+        MPSCQueue() : m_Head(new Node()), m_Tail(m_Head.load(std::memory_order_relaxed))
+        {
+        }
+
+        ~MPSCQueue()
+        {
+            while (Pop())
+            {
+            }
+            delete m_Tail;
+        }
+
+        MPSCQueue(const MPSCQueue&) = delete;
+        MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+        // Safe from any thread.
+        void Push(T value)
+        {
+            Node* node = new Node();
+            node->Value.emplace(std::move(value));
+            Node* previous = m_Head.exchange(node, std::memory_order_acq_rel);
+            previous->Next.store(node, std::memory_order_release);
+        }
+
+        // Consumer thread only.
+        std::optional<T> Pop()
+        {
+            Node* tail = m_Tail;
+            Node* next = tail->Next.load(std::memory_order_acquire);
+            if (!next)
+                return std::nullopt;
+
+            // `next` becomes the new stub node once its value is taken.
+            std::optional<T> value = std::move(next->Value);
+            next->Value.reset();
+            m_Tail = next;
+            delete tail;
+            return value;
+        }
+
+        // Pops everything currently visible, calling `f` on each item. Returns the number of items.
+        template <class F>
+        size_t Drain(F&& f)
+        {
+            size_t count = 0;
+            while (std::optional<T> value = Pop())
+            {
+                f(std::move(*value));
+                count++;
+            }
+            return count;
+        }
+
+      private:
+        struct Node
+        {
+            std::atomic<Node*> Next = nullptr;
+            std::optional<T> Value;
+        };
+
+        // Producers append at the head, the consumer takes from the tail.
+        std::atomic<Node*> m_Head;
+        Node* m_Tail;
+    };
+}
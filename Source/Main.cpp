@@ -1,12 +1,23 @@
 #include "Camera.hpp"
+#include "DynamicResolution.hpp"
 #include "Framebuffer.hpp"
+#include "HTTP.hpp"
+#include "HTTPArchive.hpp"
+#include "Heightfield.hpp"
+#include "HeightfieldCache.hpp"
+#include "ImageDecoder.hpp"
+#include "LODGovernor.hpp"
 #include "Logger.hpp"
+#include "MemoryBudget.hpp"
 #include "Mercator.hpp"
 #include "Quadtree.hpp"
 #include "Renderer.hpp"
 #include "ThreadPool.hpp"
 #include "TileJSON.hpp"
+#include "TileSource.hpp"
 #include "Tileset.hpp"
+#include "UploadScheduler.hpp"
+#include "VertexCache.hpp"
 
 #include "backends/imgui_impl_opengl3.h"
 #include "backends/imgui_impl_sdl3.h"
@@ -18,18 +29,24 @@
 #include <dotenv.h>
 
 #include <SDL3/SDL_events.h>
+#include <SDL3/SDL_hints.h>
 #include <SDL3/SDL_init.h>
 #include <SDL3/SDL_keycode.h>
 #include <SDL3/SDL_main.h>
 #include <SDL3/SDL_timer.h>
 #include <SDL3/SDL_video.h>
 
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <algorithm>
+#include <cmath>
+#include <filesystem>
 #include <format>
 #include <fstream>
+#include <future>
 #include <memory>
+#include <optional>
 #include <print>
 #include <string>
 #include <vector>
@@ -52,18 +69,244 @@ namespace
     std::unique_ptr<Earth::Tileset> s_SatelliteTileset;
     std::unique_ptr<Earth::Tileset> s_TerrainTileset;
     std::unique_ptr<Earth::Quadtree> s_Quadtree;
+    // A second, zoomed out view of the camera's surroundings. Its quadtree shares the tilesets, so it
+    // only loads the tiles the main view doesn't already hold.
+    std::unique_ptr<Earth::Quadtree> s_OverviewQuadtree;
+    std::unique_ptr<Earth::Camera> s_OverviewCamera;
+    std::unique_ptr<Earth::Framebuffer> s_OverviewFramebuffer;
+    // How much farther out the overview camera is than the main one
+    constexpr float OVERVIEW_ZOOM_OUT = 8.0f;
     std::unique_ptr<Earth::Camera> s_Camera;
-    std::unique_ptr<Earth::Framebuffer> s_Framebuffer;
+    std::unique_ptr<Earth::DynamicResolution> s_DynamicResolution;
     std::unique_ptr<Earth::ThreadPool> s_ThreadPool;
+    std::unique_ptr<Earth::UploadScheduler> s_UploadScheduler;
+    std::unique_ptr<Earth::MemoryBudget> s_MemoryBudget;
+    // Elevation queries against the terrain tiles, see Earth::HeightfieldCache
+    std::unique_ptr<Earth::HeightfieldCache> s_HeightfieldCache;
+    float s_UploadBudgetMs = 2.0f;
+    int s_MinMipSize = 1;
+    float s_MeshErrorPixels = 2.0f;
+    // Only redraw when something changed, sleeping on events otherwise
+    bool s_OnDemandRendering = false;
+    // Frame rate limit while drawing, 0 for none
+    int s_MaxFrameRate = 0;
+    int s_MaxRequestsPerHost = 6;
+    // Memory limits in MB, indexed by Earth::MemoryCategory
+    int s_MemoryLimitsMB[] = {64, 256, 1024};
+    // Adapts the quadtree's split threshold to these targets, see Earth::LODGovernor
+    Earth::LODGovernor s_LODGovernor;
+    bool s_AdaptiveLOD = true;
+    float s_TargetFrameMs = 12.0f;
+    int s_TargetPendingLoads = 96;
+    int s_TargetMemoryPercent = 90;
+    float s_TargetBandwidthMBps = 0.0f;
+    // Scales the viewport's render resolution to keep the scene's GPU time on target, see
+    // Earth::DynamicResolution
+    bool s_DynamicResolutionEnabled = true;
+    float s_TargetSceneMs = 8.0f;
+    float s_MinResolutionScale = 0.5f;
+    float s_MaxResolutionScale = 1.0f;
     bool s_ShowLog = true;
     bool s_ShowPerformance = true;
     bool s_ShowLocation = true;
+    bool s_ShowOverview = false;
     bool s_ViewportFocused = false;
     bool s_ViewportHovered = false;
+    // Mouse position over the viewport image, and what it points at on the globe
+    std::optional<glm::vec2> s_CursorPosition;
+    std::optional<glm::dvec3> s_CursorPick;
+    float s_PickMicroseconds = 0.0f;
+    // How far the camera is kept above the loaded terrain
+    constexpr float CAMERA_CLEARANCE_METERS = 20.0f;
     std::vector<float> s_FrameTimes;
     std::vector<float> s_LoadingTilesHistory;
     std::vector<float> s_LoadedTilesHistory;
 
+    // Low-zoom tiles shipped with the app so the globe can be drawn before any network request returns
+    std::shared_ptr<Earth::TileSource> s_SatelliteBasePack;
+    std::shared_ptr<Earth::TileSource> s_TerrainBasePack;
+    std::future<std::shared_ptr<Earth::TileSource>> s_SatelliteSource;
+    std::future<std::shared_ptr<Earth::TileSource>> s_TerrainSource;
+
+    // Set when HTTP_REPLAY serves recorded traffic, so the network profile can be switched live
+    std::shared_ptr<Earth::HTTP::ReplayTransport> s_ReplayTransport;
+
+    // Event pushed by the workers so the main loop notices finished tiles while it sleeps
+    Uint32 s_WakeEventType = 0;
+    // After input the UI needs a few frames to settle (hover state, window sizes)
+    constexpr int SETTLE_FRAMES = 3;
+    int s_FramesToDraw = SETTLE_FRAMES;
+    Uint64 s_LastFrameTicks = 0;
+    std::string s_MainCallbackRate;
+
+    // Safe to call from any thread.
+    void Wake()
+    {
+        SDL_Event event;
+        SDL_zero(event);
+        event.type = s_WakeEventType;
+        SDL_PushEvent(&event);
+    }
+
+    // In on-demand mode, switches SDL between waiting for events and calling SDL_AppIterate at the
+    // frame rate cap, depending on whether the next frame would differ from the last one.
+    void UpdateMainCallbackRate()
+    {
+        bool active = s_FramesToDraw > 0 || s_Camera->IsAnimating() || s_UploadScheduler->GetDeferred() > 0 ||
+                      s_LODGovernor.IsAdjusting();
+        std::string rate = s_OnDemandRendering && !active ? "waitevent" : std::to_string(s_MaxFrameRate);
+        if (rate != s_MainCallbackRate)
+        {
+            SDL_SetHint(SDL_HINT_MAIN_CALLBACK_RATE, rate.c_str());
+            s_MainCallbackRate = rate;
+        }
+    }
+
+    // HTTP_RECORD saves all traffic to a directory and HTTP_REPLAY serves it back offline under the
+    // NETWORK_PROFILE conditions, so pipeline changes can be compared on identical traffic.
+    void ConfigureTransport()
+    {
+        const char* record = std::getenv("HTTP_RECORD");
+        const char* replay = std::getenv("HTTP_REPLAY");
+        const char* profileName = std::getenv("NETWORK_PROFILE");
+
+        try
+        {
+            if (replay && *replay)
+            {
+                const auto& profile =
+                    Earth::HTTP::FindNetworkProfile(profileName && *profileName ? profileName : "Recorded");
+                s_ReplayTransport = std::make_shared<Earth::HTTP::ReplayTransport>(replay, profile);
+                Earth::HTTP::SetTransport(s_ReplayTransport);
+                s_Logger.Info("Replaying HTTP traffic from {} with the {} profile", replay, profile.Name);
+            }
+            else if (record && *record)
+            {
+                Earth::HTTP::SetTransport(
+                    std::make_shared<Earth::HTTP::RecordingTransport>(Earth::HTTP::GetTransport(), record));
+                s_Logger.Info("Recording HTTP traffic to {}", record);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            s_Logger.Error("Failed to set up HTTP record/replay: {}", e.what());
+        }
+    }
+
+    // Prefers a local archive named by `archiveEnv`, falling back to the MapTiler tileset.
+    std::shared_ptr<Earth::TileSource> CreateTileSource(const char* archiveEnv, const char* tilesetName)
+    {
+        if (const char* archive = std::getenv(archiveEnv); archive && *archive)
+        {
+            s_Logger.Info("Using tile archive {}", archive);
+            return Earth::OpenTileArchive(archive);
+        }
+
+        const char* mapTilerKey = std::getenv("MAPTILER_KEY");
+        if (!mapTilerKey || !*mapTilerKey)
+        {
+            s_Logger.Error("MAPTILER_KEY not set in .env and no {} given", archiveEnv);
+            return nullptr;
+        }
+
+        Earth::URL url = std::format("https://api.maptiler.com/tiles/{}/tiles.json?key={}", tilesetName, mapTilerKey);
+        Earth::TileJSON tileJSON(url, "Cache/TileJSON");
+        auto tiles = tileJSON.GetJson()["tiles"];
+        if (tiles.empty())
+            return nullptr;
+
+        std::vector<Earth::URL> urls;
+        for (const auto& tile : tiles)
+            urls.push_back(tile.get<std::string>());
+
+        auto source = std::make_shared<Earth::HTTPTileSource>(urls);
+        source->SetZoomRange(tileJSON.GetMinZoom(), tileJSON.GetMaxZoom());
+        source->SetBounds(tileJSON.GetBounds());
+        return source;
+    }
+
+    std::shared_ptr<Earth::TileSource> OpenBasePack(const char* name)
+    {
+        std::string path = std::format("Assets/BasePack/{}.mbtiles", name);
+        if (!std::filesystem::exists(path))
+            return nullptr;
+
+        try
+        {
+            return Earth::OpenTileArchive(path);
+        }
+        catch (const std::exception& e)
+        {
+            s_Logger.Error("Failed to open base pack {}: {}", path, e.what());
+            return nullptr;
+        }
+    }
+
+    void CreateScene(std::shared_ptr<Earth::TileSource> satSource, std::shared_ptr<Earth::TileSource> terrainSource)
+    {
+        // Holds references into the tilesets being replaced; recreated on demand.
+        s_OverviewQuadtree.reset();
+
+        Earth::TileOptions satelliteOptions;
+        satelliteOptions.GenerateMipmaps = true;
+        satelliteOptions.MinMipSize = s_MinMipSize;
+        satelliteOptions.Compress = true;
+        s_SatelliteTileset = std::make_unique<Earth::Tileset>(satSource, *s_ThreadPool, *s_UploadScheduler,
+                                                              *s_MemoryBudget, satelliteOptions);
+
+        Earth::TileOptions terrainOptions;
+        terrainOptions.Meshes = &s_Renderer->GetMeshPool();
+        terrainOptions.MeshErrorPixels = s_MeshErrorPixels;
+        terrainOptions.Heightfields = s_HeightfieldCache.get();
+        s_HeightfieldCache->SetSource(terrainSource);
+        s_TerrainTileset = std::make_unique<Earth::Tileset>(terrainSource, *s_ThreadPool, *s_UploadScheduler,
+                                                            *s_MemoryBudget, terrainOptions);
+        s_Quadtree = std::make_unique<Earth::Quadtree>(*s_SatelliteTileset, *s_TerrainTileset);
+    }
+
+    // Once both tile sources have been created on the workers, layers them over the base pack, or
+    // creates the scene if there was no base pack to start with.
+    void CheckTileSources()
+    {
+        if (!s_SatelliteSource.valid() || !s_TerrainSource.valid())
+            return;
+        if (s_SatelliteSource.wait_for(std::chrono::seconds(0)) != std::future_status::ready ||
+            s_TerrainSource.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return;
+
+        std::shared_ptr<Earth::TileSource> satSource, terrainSource;
+        try
+        {
+            satSource = s_SatelliteSource.get();
+            terrainSource = s_TerrainSource.get();
+        }
+        catch (const std::exception& e)
+        {
+            s_Logger.Error("Failed to fetch tileset: {}", e.what());
+        }
+        s_SatelliteSource = {};
+        s_TerrainSource = {};
+
+        if (!satSource || !terrainSource)
+            return;
+
+        if (s_SatelliteBasePack)
+            satSource = std::make_shared<Earth::LayeredTileSource>(s_SatelliteBasePack, satSource);
+        if (s_TerrainBasePack)
+            terrainSource = std::make_shared<Earth::LayeredTileSource>(s_TerrainBasePack, terrainSource);
+
+        if (s_Quadtree)
+        {
+            s_SatelliteTileset->SetSource(satSource);
+            s_TerrainTileset->SetSource(terrainSource);
+            s_HeightfieldCache->SetSource(terrainSource);
+        }
+        else
+        {
+            CreateScene(satSource, terrainSource);
+        }
+    }
+
     void LoadCameraSettings()
     {
         std::ifstream file("earth.ini");
@@ -118,6 +361,8 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char** argv)
 {
     curl_global_init(CURL_GLOBAL_ALL);
     dotenv::init();
+    ConfigureTransport();
+    Earth::Logger::SetAsync(true);
 
     if (!SDL_InitSubSystem(SDL_INIT_VIDEO))
     {
@@ -125,6 +370,8 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char** argv)
         return SDL_APP_FAILURE;
     }
 
+    s_WakeEventType = SDL_RegisterEvents(1);
+
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
@@ -146,49 +393,30 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char** argv)
     s_Renderer = std::make_unique<Earth::Renderer>();
     s_Camera = std::make_unique<Earth::Camera>(1280.0f, 720.0f);
     LoadCameraSettings();
-    s_Framebuffer = std::make_unique<Earth::Framebuffer>(1280, 720);
-    s_ThreadPool = std::make_unique<Earth::ThreadPool>(std::thread::hardware_concurrency());
-
-    if (const char* mapTilerKey = std::getenv("MAPTILER_KEY"))
-    {
-        try
-        {
-            Earth::URL satUrl =
-                std::format("https://api.maptiler.com/tiles/satellite-v2/tiles.json?key={}", mapTilerKey);
-            Earth::TileJSON satTileJSON(satUrl);
-            auto satTiles = satTileJSON.GetJson()["tiles"];
-
-            Earth::URL terrainUrl =
-                std::format("https://api.maptiler.com/tiles/terrain-rgb-v2/tiles.json?key={}", mapTilerKey);
-            Earth::TileJSON terrainTileJSON(terrainUrl);
-            auto terrainTiles = terrainTileJSON.GetJson()["tiles"];
-
-            if (!satTiles.empty() && !terrainTiles.empty())
-            {
-                Earth::URL satTileUrl = satTiles[0].get<std::string>();
-                Earth::URL terrainTileUrl = terrainTiles[0].get<std::string>();
-
-                s_SatelliteTileset = std::make_unique<Earth::Tileset>(satTileUrl, *s_ThreadPool, true);
-                s_TerrainTileset = std::make_unique<Earth::Tileset>(terrainTileUrl, *s_ThreadPool, false);
-                s_Quadtree = std::make_unique<Earth::Quadtree>(*s_SatelliteTileset, *s_TerrainTileset);
-            }
-        }
-        catch (const std::exception& e)
-        {
-            s_Logger.Error("Failed to fetch tileset: {}", e.what());
-        }
-    }
-    else
-    {
-        s_Logger.Error("MAPTILER_KEY not set in .env");
-    }
+    s_DynamicResolution = std::make_unique<Earth::DynamicResolution>(1280, 720);
+    s_OverviewCamera = std::make_unique<Earth::Camera>(320.0f, 320.0f);
+    s_OverviewFramebuffer = std::make_unique<Earth::Framebuffer>(320, 320);
+    s_ThreadPool = std::make_unique<Earth::ThreadPool>(std::thread::hardware_concurrency(), Wake);
+    s_UploadScheduler = std::make_unique<Earth::UploadScheduler>();
+    s_MemoryBudget = std::make_unique<Earth::MemoryBudget>();
+    s_HeightfieldCache = std::make_unique<Earth::HeightfieldCache>(*s_ThreadPool);
+
+    // Draw the base pack right away while the TileJSON requests run in parallel on the workers.
+    s_SatelliteBasePack = OpenBasePack("satellite");
+    s_TerrainBasePack = OpenBasePack("terrain");
+    if (s_SatelliteBasePack && s_TerrainBasePack)
+        CreateScene(s_SatelliteBasePack, s_TerrainBasePack);
+
+    s_SatelliteSource = s_ThreadPool->Enqueue([]() { return CreateTileSource("SATELLITE_ARCHIVE", "satellite-v2"); });
+    s_TerrainSource = s_ThreadPool->Enqueue([]() { return CreateTileSource("TERRAIN_ARCHIVE", "terrain-rgb-v2"); });
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
-    // Generate a plane mesh with 64x64 resolution (reused for all tiles)
+    // Drawn for tiles whose terrain mesh has not arrived yet
     Earth::Mesh planeMesh = Earth::Mercator::GeneratePlaneMesh(64);
-    s_Renderer->UploadMesh(planeMesh);
+    Earth::VertexCache::Optimize(planeMesh.Indices, planeMesh.Vertices.size());
+    s_Renderer->SetDefaultMesh(planeMesh);
 
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
@@ -206,12 +434,79 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char** argv)
             s_ShowPerformance = (bool)val;
         else if (sscanf(line, "ShowLocation=%d", &val) == 1)
             s_ShowLocation = (bool)val;
+        else if (sscanf(line, "ShowOverview=%d", &val) == 1)
+            s_ShowOverview = (bool)val;
+        else if (sscanf(line, "UploadBudgetMs=%f", &s_UploadBudgetMs) == 1)
+        {
+        }
+        else if (sscanf(line, "MinMipSize=%d", &s_MinMipSize) == 1)
+        {
+        }
+        else if (sscanf(line, "MeshErrorPixels=%f", &s_MeshErrorPixels) == 1)
+        {
+        }
+        else if (sscanf(line, "OnDemandRendering=%d", &val) == 1)
+            s_OnDemandRendering = (bool)val;
+        else if (sscanf(line, "MaxFrameRate=%d", &s_MaxFrameRate) == 1)
+        {
+        }
+        else if (sscanf(line, "MaxRequestsPerHost=%d", &s_MaxRequestsPerHost) == 1)
+        {
+        }
+        else if (sscanf(line, "MemoryLimitsMB=%d,%d,%d", &s_MemoryLimitsMB[0], &s_MemoryLimitsMB[1],
+                        &s_MemoryLimitsMB[2]) == 3)
+        {
+        }
+        else if (sscanf(line, "AdaptiveLOD=%d", &val) == 1)
+            s_AdaptiveLOD = (bool)val;
+        else if (sscanf(line, "TargetFrameMs=%f", &s_TargetFrameMs) == 1)
+        {
+        }
+        else if (sscanf(line, "TargetPendingLoads=%d", &s_TargetPendingLoads) == 1)
+        {
+        }
+        else if (sscanf(line, "TargetMemoryPercent=%d", &s_TargetMemoryPercent) == 1)
+        {
+        }
+        else if (sscanf(line, "TargetBandwidthMBps=%f", &s_TargetBandwidthMBps) == 1)
+        {
+        }
+        else if (sscanf(line, "DynamicResolution=%d", &val) == 1)
+            s_DynamicResolutionEnabled = (bool)val;
+        else if (sscanf(line, "TargetSceneMs=%f", &s_TargetSceneMs) == 1)
+        {
+        }
+        else if (sscanf(line, "ResolutionScale=%f,%f", &s_MinResolutionScale, &s_MaxResolutionScale) == 2)
+        {
+        }
+        else if (sscanf(line, "LogLevel=%d", &val) == 1)
+            Earth::Logger::SetLevel((Earth::Logger::Level)val);
+        else if (sscanf(line, "LogAsync=%d", &val) == 1)
+            Earth::Logger::SetAsync((bool)val);
     };
     ini_handler.WriteAllFn = [](ImGuiContext*, ImGuiSettingsHandler*, ImGuiTextBuffer* buf) {
         buf->appendf("[Earth][Settings]\n");
         buf->appendf("ShowLog=%d\n", s_ShowLog);
         buf->appendf("ShowPerformance=%d\n", s_ShowPerformance);
         buf->appendf("ShowLocation=%d\n", s_ShowLocation);
+        buf->appendf("ShowOverview=%d\n", s_ShowOverview);
+        buf->appendf("OnDemandRendering=%d\n", s_OnDemandRendering);
+        buf->appendf("MaxFrameRate=%d\n", s_MaxFrameRate);
+        buf->appendf("UploadBudgetMs=%.2f\n", s_UploadBudgetMs);
+        buf->appendf("MinMipSize=%d\n", s_MinMipSize);
+        buf->appendf("MeshErrorPixels=%.2f\n", s_MeshErrorPixels);
+        buf->appendf("MaxRequestsPerHost=%d\n", s_MaxRequestsPerHost);
+        buf->appendf("MemoryLimitsMB=%d,%d,%d\n", s_MemoryLimitsMB[0], s_MemoryLimitsMB[1], s_MemoryLimitsMB[2]);
+        buf->appendf("AdaptiveLOD=%d\n", s_AdaptiveLOD);
+        buf->appendf("TargetFrameMs=%.2f\n", s_TargetFrameMs);
+        buf->appendf("TargetPendingLoads=%d\n", s_TargetPendingLoads);
+        buf->appendf("TargetMemoryPercent=%d\n", s_TargetMemoryPercent);
+        buf->appendf("TargetBandwidthMBps=%.2f\n", s_TargetBandwidthMBps);
+        buf->appendf("DynamicResolution=%d\n", s_DynamicResolutionEnabled);
+        buf->appendf("TargetSceneMs=%.2f\n", s_TargetSceneMs);
+        buf->appendf("ResolutionScale=%.2f,%.2f\n", s_MinResolutionScale, s_MaxResolutionScale);
+        buf->appendf("LogLevel=%d\n", (int)Earth::Logger::GetLevel());
+        buf->appendf("LogAsync=%d\n", Earth::Logger::IsAsync());
         buf->appendf("\n");
     };
     ImGui::AddSettingsHandler(&ini_handler);
@@ -236,7 +531,29 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char** argv)
 
 SDL_AppResult SDL_AppIterate(void* appstate)
 {
-    Earth::Tile::ResetUploadStats();
+    Uint64 frameStart = SDL_GetTicksNS();
+    CheckTileSources();
+
+    s_UploadScheduler->SetBudget(s_UploadBudgetMs);
+    Earth::HTTPTileSource::SetMaxRequestsPerHost(s_MaxRequestsPerHost);
+    if (s_SatelliteTileset)
+        s_SatelliteTileset->SetMinMipSize(s_MinMipSize);
+    if (s_TerrainTileset)
+        s_TerrainTileset->SetMeshErrorPixels(s_MeshErrorPixels);
+    for (int i = 0; i < (int)Earth::MemoryCategory::Count; ++i)
+        s_MemoryBudget->SetLimit((Earth::MemoryCategory)i, (size_t)s_MemoryLimitsMB[i] * 1024 * 1024);
+    s_UploadScheduler->BeginFrame();
+
+    s_LODGovernor.SetEnabled(s_AdaptiveLOD);
+    Earth::LODGovernor::Targets& lodTargets = s_LODGovernor.GetTargets();
+    lodTargets.FrameMs = s_TargetFrameMs;
+    lodTargets.PendingLoads = s_TargetPendingLoads;
+    lodTargets.MemoryUse = s_TargetMemoryPercent / 100.0f;
+    lodTargets.MegabytesPerSecond = s_TargetBandwidthMBps;
+
+    s_DynamicResolution->SetEnabled(s_DynamicResolutionEnabled);
+    s_DynamicResolution->SetTargetMs(s_TargetSceneMs);
+    s_DynamicResolution->SetScaleRange(s_MinResolutionScale, s_MaxResolutionScale);
 
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
@@ -292,6 +609,9 @@ SDL_AppResult SDL_AppIterate(void* appstate)
             if (ImGui::MenuItem("Location", nullptr, &s_ShowLocation))
             {
             }
+            if (ImGui::MenuItem("Overview", nullptr, &s_ShowOverview))
+            {
+            }
             ImGui::EndMenu();
         }
         ImGui::EndMainMenuBar();
@@ -386,6 +706,111 @@ SDL_AppResult SDL_AppIterate(void* appstate)
 
                 ImGui::Plot("Tiles", tilesConf);
             }
+
+            ImGui::Separator();
+
+            ImGui::Checkbox("On-Demand Rendering", &s_OnDemandRendering);
+            ImGui::SliderInt("Frame Rate Cap", &s_MaxFrameRate, 0, 240, s_MaxFrameRate ? "%d fps" : "Uncapped");
+
+            ImGui::SliderFloat("Upload Budget", &s_UploadBudgetMs, 0.25f, 16.0f, "%.2f ms");
+            ImGui::SliderInt("Min Mip Size", &s_MinMipSize, 1, 64, "%d px", ImGuiSliderFlags_Logarithmic);
+            ImGui::Text("Uploads: %d last frame (%.2f ms), %d waiting", s_UploadScheduler->GetUploadsLastFrame(),
+                        s_UploadScheduler->GetSpentLastFrame(), s_UploadScheduler->GetDeferred());
+            ImGui::Text("Upload cost: %.2f ms/MB (%s)", s_UploadScheduler->GetCostPerMB(),
+                        s_UploadScheduler->HasGPUTimers() ? "GPU timers" : "CPU timers");
+
+            ImGui::Checkbox("Adaptive LOD", &s_AdaptiveLOD);
+            ImGui::SliderFloat("Target Frame Time", &s_TargetFrameMs, 2.0f, 50.0f, "%.1f ms");
+            ImGui::SliderInt("Target Pending Loads", &s_TargetPendingLoads, 8, 512, "%d", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderInt("Target Memory Use", &s_TargetMemoryPercent, 10, 100, "%d%%");
+            ImGui::SliderFloat("Target Bandwidth", &s_TargetBandwidthMBps, 0.0f, 100.0f,
+                               s_TargetBandwidthMBps > 0.0f ? "%.1f MB/s" : "Unlimited");
+            {
+                using Goal = Earth::LODGovernor::Goal;
+                ImGui::Text("Split threshold: %.0f px (%s), limited by %s", s_LODGovernor.GetThreshold(),
+                            !s_AdaptiveLOD                 ? "fixed"
+                            : s_LODGovernor.IsAdjusting() ? "adjusting"
+                                                          : "holding",
+                            Earth::LODGovernor::GetGoalName(s_LODGovernor.GetLimitingGoal()));
+                ImGui::Text("Pressure: frame %.2f (%.1f ms), backlog %.2f, memory %.2f, bandwidth %.2f (%.1f MB/s)",
+                            s_LODGovernor.GetPressure(Goal::FrameTime), s_LODGovernor.GetFrameMs(),
+                            s_LODGovernor.GetPressure(Goal::Backlog), s_LODGovernor.GetPressure(Goal::Memory),
+                            s_LODGovernor.GetPressure(Goal::Bandwidth),
+                            s_LODGovernor.GetBytesPerSecond() / (1024.0f * 1024.0f));
+            }
+
+            ImGui::Checkbox("Dynamic Resolution", &s_DynamicResolutionEnabled);
+            ImGui::SliderFloat("Target Scene Time", &s_TargetSceneMs, 1.0f, 33.0f, "%.1f ms");
+            ImGui::SliderFloat("Min Resolution Scale", &s_MinResolutionScale, Earth::DynamicResolution::MIN_SCALE,
+                               Earth::DynamicResolution::MAX_SCALE, "%.2f");
+            ImGui::SliderFloat("Max Resolution Scale", &s_MaxResolutionScale, Earth::DynamicResolution::MIN_SCALE,
+                               Earth::DynamicResolution::MAX_SCALE, "%.2f");
+            s_MaxResolutionScale = std::max(s_MaxResolutionScale, s_MinResolutionScale);
+            ImGui::Text("Resolution: %dx%d of %dx%d (%.0f%%), scene %.2f ms%s", s_DynamicResolution->GetSceneWidth(),
+                        s_DynamicResolution->GetSceneHeight(), s_DynamicResolution->GetWidth(),
+                        s_DynamicResolution->GetHeight(), s_DynamicResolution->GetScale() * 100.0f,
+                        s_DynamicResolution->GetSceneMs(),
+                        s_DynamicResolution->HasGPUTimers() ? "" : " (no GPU timers, fixed)");
+
+            ImGui::SliderFloat("Mesh Error", &s_MeshErrorPixels, 0.25f, 16.0f, "%.2f px", ImGuiSliderFlags_Logarithmic);
+            const Earth::MeshPool& meshPool = s_Renderer->GetMeshPool();
+            ImGui::Text("Mesh pool: %zu / %zu vertices, %zu / %zu indices", meshPool.GetUsedVertices(),
+                        meshPool.GetVertexCapacity(), meshPool.GetUsedIndices(), meshPool.GetIndexCapacity());
+            for (const auto& decoder : Earth::ImageDecoders::GetAll())
+            {
+                const auto& decodeStats = decoder->GetStats();
+                if (decodeStats.Images > 0)
+                    ImGui::Text("%s: %d images, %.1f MP/s", decoder->GetName(), (int)decodeStats.Images.load(),
+                                decodeStats.GetMegapixelsPerSecond());
+            }
+            bool measureVertexCache = Earth::VertexCache::IsMeasuring();
+            if (ImGui::Checkbox("Measure Vertex Cache", &measureVertexCache))
+                Earth::VertexCache::SetMeasuring(measureVertexCache);
+            if (measureVertexCache)
+            {
+                const auto& cacheStats = Earth::VertexCache::GetStats();
+                ImGui::Text("Vertex cache ACMR: %.3f (%.3f unoptimized, %d-entry FIFO)", cacheStats.GetACMRAfter(),
+                            cacheStats.GetACMRBefore(), Earth::VertexCache::CACHE_SIZE);
+            }
+
+            ImGui::SliderInt("Requests/Host", &s_MaxRequestsPerHost, 1, 32);
+            const auto& httpStats = Earth::HTTP::GetStats();
+            ImGui::Text("HTTP: %d requests, %d hedged (%d won), %d retries, %d timeouts", httpStats.Requests.load(),
+                        httpStats.Hedges.load(), httpStats.HedgeWins.load(), httpStats.Retries.load(),
+                        httpStats.Timeouts.load());
+            if (s_ReplayTransport)
+            {
+                std::string current = s_ReplayTransport->GetProfile().Name;
+                if (ImGui::BeginCombo("Network Profile", current.c_str()))
+                {
+                    for (const auto& profile : Earth::HTTP::GetNetworkProfiles())
+                    {
+                        if (ImGui::Selectable(profile.Name.c_str(), profile.Name == current))
+                            s_ReplayTransport->SetProfile(profile);
+                    }
+                    ImGui::EndCombo();
+                }
+            }
+
+            ImGui::Separator();
+
+            static const char* memoryNames[] = {"Encoded", "Decoded", "GPU"};
+            for (int i = 0; i < (int)Earth::MemoryCategory::Count; ++i)
+            {
+                auto category = (Earth::MemoryCategory)i;
+                float usedMB = s_MemoryBudget->GetUsage(category) / (1024.0f * 1024.0f);
+                std::string overlay = std::format("{:.0f} / {} MB", usedMB, s_MemoryLimitsMB[i]);
+
+                ImGui::PushID(i);
+                ImGui::ProgressBar(usedMB / std::max(1, s_MemoryLimitsMB[i]), ImVec2(-FLT_MIN, 0), overlay.c_str());
+                ImGui::SliderInt(memoryNames[i], &s_MemoryLimitsMB[i], 16, 4096, "%d MB", ImGuiSliderFlags_Logarithmic);
+                ImGui::PopID();
+            }
+            ImGui::Text("Evicted: %d, Rejected: %d last frame", s_MemoryBudget->GetEvictedLastFrame(),
+                        s_MemoryBudget->GetRejectedLastFrame());
+            if (s_Quadtree)
+                ImGui::Text("Shared between views: %zu imagery, %zu terrain tile requests",
+                            s_SatelliteTileset->GetSharedLoads(), s_TerrainTileset->GetSharedLoads());
         }
         ImGui::End();
     }
@@ -438,10 +863,76 @@ SDL_AppResult SDL_AppIterate(void* appstate)
             {
                 s_Camera->SetTargetPosition(glm::vec3(targetPosXYZ[0], targetPosXYZ[1], targetPosXYZ[2]));
             }
+
+            ImGui::Separator();
+
+            // What the mouse points at, picked against the loaded terrain
+            ImGui::Text("Cursor Lon/Lat/Elevation");
+            if (s_CursorPick)
+            {
+                glm::dvec2 uv = Earth::Mercator::PositionToUV(*s_CursorPick);
+                double lon = uv.x * 360.0 - 180.0;
+                double lat = glm::degrees(std::atan(std::sinh(glm::pi<double>() * (1.0 - 2.0 * uv.y))));
+                double elevation = (glm::length(*s_CursorPick) - 1.0) * Earth::Heightfield::EARTH_RADIUS;
+                ImGui::Text("%.5f, %.5f, %.1f m", lon, lat, elevation);
+
+                // Ground profile along the straight line in lon/lat from the look-at point
+                constexpr int PROFILE_SAMPLES = 256;
+                std::vector<Earth::LonLat> route(PROFILE_SAMPLES);
+                for (int i = 0; i < PROFILE_SAMPLES; ++i)
+                {
+                    double t = (double)i / (PROFILE_SAMPLES - 1);
+                    route[i] = {lookLonLat[0] + (lon - lookLonLat[0]) * t, lookLonLat[1] + (lat - lookLonLat[1]) * t};
+                }
+                std::vector<float> profile = s_HeightfieldCache->SampleElevations(route);
+                auto [lowest, highest] = std::minmax_element(profile.begin(), profile.end());
+
+                ImGui::PlotConfig profileConf;
+                profileConf.values.ys = profile.data();
+                profileConf.values.count = PROFILE_SAMPLES;
+                profileConf.scale.min = std::min(*lowest, 0.0f);
+                profileConf.scale.max = std::max(*highest, profileConf.scale.min + 1.0f);
+                profileConf.tooltip.show = true;
+                profileConf.tooltip.format = "%.0f: %.0f m";
+                profileConf.frame_size = ImVec2(ImGui::GetContentRegionAvail().x, 60);
+                ImGui::Plot("Profile", profileConf);
+            }
+            else
+            {
+                ImGui::TextDisabled(s_CursorPosition ? "Off the globe" : "Outside the viewport");
+            }
+            ImGui::TextDisabled("Picked in %.1f us", s_PickMicroseconds);
+        }
+        ImGui::End();
+    }
+
+    if (s_ShowOverview)
+    {
+        ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0f, 0.0f));
+        if (ImGui::Begin("Overview", &s_ShowOverview))
+        {
+            ImVec2 size = ImGui::GetContentRegionAvail();
+            if (size.x > 0 && size.y > 0)
+            {
+                s_OverviewFramebuffer->Resize((int)size.x, (int)size.y);
+                s_OverviewCamera->Resize(size.x, size.y);
+            }
+
+            uint64_t textureID = s_OverviewFramebuffer->GetTextureID();
+            ImGui::Image((ImTextureID)textureID,
+                         ImVec2(s_OverviewFramebuffer->GetWidth(), s_OverviewFramebuffer->GetHeight()), ImVec2(0, 1),
+                         ImVec2(1, 0));
         }
         ImGui::End();
+        ImGui::PopStyleVar();
     }
 
+    // Dropped while hidden so its tiles can be evicted
+    if (!s_ShowOverview)
+        s_OverviewQuadtree.reset();
+    else if (s_Quadtree && !s_OverviewQuadtree)
+        s_OverviewQuadtree = std::make_unique<Earth::Quadtree>(*s_SatelliteTileset, *s_TerrainTileset);
+
     ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0f, 0.0f));
     if (ImGui::Begin("Viewport"))
     {
@@ -451,43 +942,122 @@ SDL_AppResult SDL_AppIterate(void* appstate)
         ImVec2 viewportPanelSize = ImGui::GetContentRegionAvail();
         if (viewportPanelSize.x > 0 && viewportPanelSize.y > 0)
         {
-            s_Framebuffer->Resize((int)viewportPanelSize.x, (int)viewportPanelSize.y);
+            s_DynamicResolution->Resize((int)viewportPanelSize.x, (int)viewportPanelSize.y);
             s_Camera->Resize(viewportPanelSize.x, viewportPanelSize.y);
         }
 
-        uint64_t textureID = s_Framebuffer->GetTextureID();
-        ImGui::Image((ImTextureID)textureID, ImVec2(s_Framebuffer->GetWidth(), s_Framebuffer->GetHeight()),
+        uint64_t textureID = s_DynamicResolution->GetTextureID();
+        ImGui::Image((ImTextureID)textureID, ImVec2(s_DynamicResolution->GetWidth(), s_DynamicResolution->GetHeight()),
                      ImVec2(0, 1), ImVec2(1, 0));
+
+        s_CursorPosition.reset();
+        if (ImGui::IsItemHovered())
+        {
+            ImVec2 mouse = ImGui::GetIO().MousePos;
+            ImVec2 origin = ImGui::GetItemRectMin();
+            s_CursorPosition = glm::vec2(mouse.x - origin.x, mouse.y - origin.y);
+        }
     }
     ImGui::End();
     ImGui::PopStyleVar();
 
-    s_Framebuffer->Bind();
+    // Clamped so an animation doesn't jump after the loop has been idle
+    Uint64 now = SDL_GetTicksNS();
+    float deltaTime = s_LastFrameTicks ? (float)(now - s_LastFrameTicks) / 1e9f : 0.0f;
+    s_LastFrameTicks = now;
+    s_Camera->Update(std::min(deltaTime, 0.1f));
+
+    if (s_Quadtree)
+    {
+        s_SatelliteTileset->Update();
+        s_TerrainTileset->Update();
+
+        // Terrain can rise above the camera, which orbits a target at sea level.
+        glm::dvec2 cameraUV = Earth::Mercator::PositionToUV(glm::dvec3(s_Camera->GetPosition()));
+        float ground = s_Quadtree->GetElevation(cameraUV) + CAMERA_CLEARANCE_METERS;
+        s_Camera->KeepAbove((float)(1.0 + ground / Earth::Heightfield::EARTH_RADIUS));
+
+        s_Quadtree->Update(*s_Camera, s_LODGovernor.GetThreshold());
+        // Both views select their tiles before the budget is trimmed and the uploads go out, so a tile
+        // they share is ranked by whichever view needs it most.
+        if (s_OverviewQuadtree)
+        {
+            float targetLon, targetLat;
+            s_Camera->GetTargetLonLat(targetLon, targetLat);
+            float range = std::min(s_Camera->GetRange() * OVERVIEW_ZOOM_OUT, 4.0f);
+            s_OverviewCamera->SetOrbit(targetLon, targetLat, range, 0.0f, 0.0f);
+            s_OverviewQuadtree->Update(*s_OverviewCamera, s_LODGovernor.GetThreshold());
+        }
+        s_MemoryBudget->Trim();
+        // Ahead of the scene, whose timer query would otherwise overlap the upload timers.
+        s_UploadScheduler->Flush();
+    }
+
+    s_DynamicResolution->BeginScene();
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    s_Camera->Update(0.016f);
-
     if (s_Quadtree)
     {
-        s_Quadtree->Update(*s_Camera);
-
         glm::mat4 projection = s_Camera->GetProjectionMatrix();
         glm::mat4 view = s_Camera->GetViewMatrix();
         s_Quadtree->Draw(*s_Renderer, projection * view);
+
+        s_CursorPick.reset();
+        if (s_CursorPosition)
+        {
+            Uint64 pickStart = SDL_GetTicksNS();
+            Earth::Ray ray = s_Camera->GetRay(s_CursorPosition->x, s_CursorPosition->y);
+            if (std::optional<double> distance = s_Quadtree->Intersect(ray))
+                s_CursorPick = ray.Origin + ray.Direction * *distance;
+            s_PickMicroseconds = (float)(SDL_GetTicksNS() - pickStart) / 1e3f;
+        }
+    }
+    s_DynamicResolution->EndScene();
+
+    if (s_OverviewQuadtree)
+    {
+        s_OverviewFramebuffer->Bind();
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glm::mat4 overviewViewProjection = s_OverviewCamera->GetProjectionMatrix() * s_OverviewCamera->GetViewMatrix();
+        s_OverviewQuadtree->Draw(*s_Renderer, overviewViewProjection);
+        s_OverviewFramebuffer->Unbind();
     }
-    s_Framebuffer->Unbind();
 
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
+    // CPU time is measured before the swap, which waits for vsync or the GPU rather than doing frame
+    // work. The GPU's share comes from the scene timer, so a GPU-bound frame still counts as slow. That
+    // timer covers the main view's clear and tile draws at the scale they render at, and neither the
+    // uploads, which the upload budget governs, nor the upscale, overview and UI passes.
+    Earth::LODGovernor::Measurements lodMeasurements;
+    float cpuFrameMs = (float)(SDL_GetTicksNS() - frameStart) / 1e6f;
+    lodMeasurements.FrameMs = std::max(cpuFrameMs, s_DynamicResolution->GetSceneMs());
+    lodMeasurements.PendingLoads = Earth::Tile::s_LoadingTiles.load();
+    for (auto category : {Earth::MemoryCategory::Decoded, Earth::MemoryCategory::GPU})
+    {
+        float use = (float)s_MemoryBudget->GetUsage(category) / std::max<size_t>(1, s_MemoryBudget->GetLimit(category));
+        lodMeasurements.MemoryUse = std::max(lodMeasurements.MemoryUse, use);
+    }
+    lodMeasurements.DownloadedBytes = Earth::HTTP::GetStats().Bytes.load();
+    s_LODGovernor.Update(lodMeasurements, deltaTime);
+
     SDL_GL_SwapWindow(s_Window.get());
 
+    if (s_FramesToDraw > 0)
+        s_FramesToDraw--;
+    UpdateMainCallbackRate();
+
     return SDL_APP_CONTINUE;
 }
 
 SDL_AppResult SDL_AppEvent(void* appstate, SDL_Event* event)
 {
+    // Input, window changes and finished worker tasks all invalidate the frame
+    s_FramesToDraw = SETTLE_FRAMES;
+
     ImGui_ImplSDL3_ProcessEvent(event);
 
     if (s_Camera)
@@ -552,14 +1122,23 @@ void SDL_AppQuit(void* appstate, SDL_AppResult result)
 
     // Destroy scene objects before the thread pool to ensure
     // all Tiles are destroyed and their requests cancelled.
+    s_OverviewQuadtree.reset();
     s_Quadtree.reset();
     s_SatelliteTileset.reset();
     s_TerrainTileset.reset();
+    s_HeightfieldCache.reset();
+    s_UploadScheduler.reset();
     s_Camera.reset();
-    s_Framebuffer.reset();
+    s_OverviewCamera.reset();
+    s_DynamicResolution.reset();
+    s_OverviewFramebuffer.reset();
     s_Renderer.reset();
 
     s_Window.reset();
     s_ThreadPool.reset();
+    // Outlives the workers, which may still hold allocations
+    s_MemoryBudget.reset();
     curl_global_cleanup();
+
+    Earth::Logger::Shutdown();
 }
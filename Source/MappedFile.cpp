@@ -0,0 +1,54 @@
+#include "MappedFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+namespace Earth
+{
+    MappedFile::MappedFile(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error(std::format("Failed to open {}: {}", path, std::strerror(errno)));
+
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error(std::format("Failed to stat {}: {}", path, std::strerror(error)));
+        }
+
+        m_Size = (size_t)info.st_size;
+        if (m_Size > 0)
+        {
+            void* data = mmap(nullptr, m_Size, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                int error = errno;
+                close(fd);
+                throw std::runtime_error(std::format("Failed to map {}: {}", path, std::strerror(error)));
+            }
+
+            // Tile lookups jump around the file, so don't let the kernel read ahead.
+            madvise(data, m_Size, MADV_RANDOM);
+            m_Data = static_cast<const unsigned char*>(data);
+        }
+
+        // The mapping keeps the file referenced.
+        close(fd);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (m_Data)
+            munmap(const_cast<unsigned char*>(m_Data), m_Size);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+namespace Earth
+{
+    // Read-only memory mapping of a whole file.
+    class MappedFile
+    {
+      public:
+        MappedFile(const std::string& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::span<const unsigned char> GetBytes() const
+        {
+            return {m_Data, m_Size};
+        }
+
+        size_t GetSize() const
+        {
+            return m_Size;
+        }
+
+      private:
+        const unsigned char* m_Data = nullptr;
+        size_t m_Size = 0;
+    };
+}
@@ -0,0 +1,146 @@
+#include "MemoryBudget.hpp"
+#include "Logger.hpp"
+#include "Tileset.hpp"
+
+#include <algorithm>
+
+namespace Earth
+{
+    static Logger s_Logger("MemoryBudget");
+
+    MemoryBudget::Allocation::Allocation(MemoryBudget* budget, MemoryCategory category, size_t size)
+        : m_Budget(budget), m_Category(category), m_Size(size)
+    {
+        m_Budget->m_Usage[(size_t)m_Category].fetch_add(m_Size, std::memory_order_relaxed);
+    }
+
+    MemoryBudget::Allocation::Allocation(Allocation&& other) noexcept
+        : m_Budget(other.m_Budget), m_Category(other.m_Category), m_Size(other.m_Size)
+    {
+        other.m_Budget = nullptr;
+        other.m_Size = 0;
+    }
+
+    MemoryBudget::Allocation& MemoryBudget::Allocation::operator=(Allocation&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            m_Budget = other.m_Budget;
+            m_Category = other.m_Category;
+            m_Size = other.m_Size;
+            other.m_Budget = nullptr;
+            other.m_Size = 0;
+        }
+        return *this;
+    }
+
+    MemoryBudget::Allocation::~Allocation()
+    {
+        Release();
+    }
+
+    void MemoryBudget::Allocation::Release()
+    {
+        if (m_Budget)
+            m_Budget->m_Usage[(size_t)m_Category].fetch_sub(m_Size, std::memory_order_relaxed);
+        m_Budget = nullptr;
+        m_Size = 0;
+    }
+
+    MemoryBudget::MemoryBudget()
+    {
+        SetLimit(MemoryCategory::Encoded, 64ull * 1024 * 1024);
+        SetLimit(MemoryCategory::Decoded, 256ull * 1024 * 1024);
+        SetLimit(MemoryCategory::GPU, 1024ull * 1024 * 1024);
+    }
+
+    MemoryBudget::Allocation MemoryBudget::Allocate(MemoryCategory category, size_t size)
+    {
+        return Allocation(this, category, size);
+    }
+
+    bool MemoryBudget::IsOverBudget() const
+    {
+        for (size_t i = 0; i < (size_t)MemoryCategory::Count; ++i)
+        {
+            if (m_Usage[i].load(std::memory_order_relaxed) > m_Limits[i].load(std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    bool MemoryBudget::Admit(float priority)
+    {
+        if (!IsOverBudget() || priority > m_Watermark)
+            return true;
+
+        m_Rejected++;
+        return false;
+    }
+
+    void MemoryBudget::Track(const std::shared_ptr<Tile>& tile, float priority)
+    {
+        m_Residents.push_back({tile, priority});
+    }
+
+    void MemoryBudget::Trim()
+    {
+        m_RejectedLastFrame = m_Rejected;
+        m_Rejected = 0;
+        m_EvictedLastFrame = 0;
+
+        auto isOver = [this](MemoryCategory category) { return GetUsage(category) > GetLimit(category); };
+        auto byPriority = [](const Resident& a, const Resident& b) { return a.Priority < b.Priority; };
+
+        // A tile can be tracked more than once a frame, such as a terrain tile lent to overzoomed
+        // descendants. It is as important as its most important use.
+        auto byTile = [](const Resident& a, const Resident& b) { return a.Target.owner_before(b.Target); };
+        auto sameTile = [&](const Resident& a, const Resident& b) { return !byTile(a, b) && !byTile(b, a); };
+        std::sort(m_Residents.begin(), m_Residents.end(), [&](const Resident& a, const Resident& b) {
+            return byTile(a, b) || (!byTile(b, a) && a.Priority > b.Priority);
+        });
+        m_Residents.erase(std::unique(m_Residents.begin(), m_Residents.end(), sameTile), m_Residents.end());
+
+        if (isOver(MemoryCategory::Decoded) || isOver(MemoryCategory::GPU))
+        {
+            std::sort(m_Residents.begin(), m_Residents.end(), byPriority);
+
+            for (const auto& resident : m_Residents)
+            {
+                bool overDecoded = isOver(MemoryCategory::Decoded);
+                bool overGPU = isOver(MemoryCategory::GPU);
+                if (!overDecoded && !overGPU)
+                    break;
+
+                std::shared_ptr<Tile> tile = resident.Target.lock();
+                if (!tile)
+                    continue;
+
+                if ((overDecoded && tile->GetPendingSize() > 0) || (overGPU && tile->IsLoaded()))
+                {
+                    tile->Evict();
+                    m_Watermark = resident.Priority;
+                    m_EvictedLastFrame++;
+                }
+            }
+
+            static LogRateLimit s_EvictLogLimit(1, std::chrono::seconds(5));
+            s_Logger.Warn(s_EvictLogLimit, "Over memory budget, evicted {} tiles (priority <= {:.1f})",
+                          m_EvictedLastFrame, m_Watermark);
+        }
+        else if (IsOverBudget() && !m_Residents.empty())
+        {
+            // Only in-flight fetches are over, which can't be evicted. Hold back anything less
+            // important than what is already resident until they drain.
+            auto lowest = std::min_element(m_Residents.begin(), m_Residents.end(), byPriority);
+            m_Watermark = std::max(m_Watermark, lowest->Priority);
+        }
+        else if (!IsOverBudget())
+        {
+            m_Watermark = 0.0f;
+        }
+
+        m_Residents.clear();
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace Earth
+{
+    struct Tile;
+
+    enum class MemoryCategory
+    {
+        // Fetched tile bytes waiting to be decoded
+        Encoded,
+        // Decoded pixels waiting for upload
+        Decoded,
+        // Uploaded textures
+        GPU,
+        Count,
+    };
+
+    // Tracks tile memory per category against configurable limits. Resident tiles report themselves
+    // every frame with a priority; when a limit is exceeded the lowest-priority ones are evicted and
+    // new requests below them are rejected until usage drops.
+    class MemoryBudget
+    {
+      public:
+        // Bytes charged to a category, returned when the allocation is released or destroyed.
+        // Safe to create and destroy on worker threads.
+        class Allocation
+        {
+          public:
+            Allocation() = default;
+            Allocation(Allocation&& other) noexcept;
+            Allocation& operator=(Allocation&& other) noexcept;
+            ~Allocation();
+
+            Allocation(const Allocation&) = delete;
+            Allocation& operator=(const Allocation&) = delete;
+
+            void Release();
+
+            size_t GetSize() const
+            {
+                return m_Size;
+            }
+
+          private:
+            friend class MemoryBudget;
+            Allocation(MemoryBudget* budget, MemoryCategory category, size_t size);
+
+            MemoryBudget* m_Budget = nullptr;
+            MemoryCategory m_Category = MemoryCategory::Encoded;
+            size_t m_Size = 0;
+        };
+
+        MemoryBudget();
+
+        MemoryBudget(const MemoryBudget&) = delete;
+        MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+        Allocation Allocate(MemoryCategory category, size_t size);
+
+        size_t GetUsage(MemoryCategory category) const
+        {
+            return m_Usage[(size_t)category].load(std::memory_order_relaxed);
+        }
+        size_t GetLimit(MemoryCategory category) const
+        {
+            return m_Limits[(size_t)category].load(std::memory_order_relaxed);
+        }
+        void SetLimit(MemoryCategory category, size_t bytes)
+        {
+            m_Limits[(size_t)category].store(bytes, std::memory_order_relaxed);
+        }
+
+        bool IsOverBudget() const;
+
+        // Whether a new tile request may start. Over budget, only requests more important than the
+        // tiles that were last evicted are let through.
+        bool Admit(float priority);
+
+        // Reports a tile holding decoded or GPU memory. Called from the quadtree update each frame.
+        void Track(const std::shared_ptr<Tile>& tile, float priority);
+
+        // Evicts the lowest-priority tracked tiles until every category is back under its limit.
+        void Trim();
+
+        int GetEvictedLastFrame() const
+        {
+            return m_EvictedLastFrame;
+        }
+        int GetRejectedLastFrame() const
+        {
+            return m_RejectedLastFrame;
+        }
+
+      private:
+        struct Resident
+        {
+            std::weak_ptr<Tile> Target;
+            float Priority;
+        };
+
+        std::array<std::atomic<size_t>, (size_t)MemoryCategory::Count> m_Usage{};
+        std::array<std::atomic<size_t>, (size_t)MemoryCategory::Count> m_Limits{};
+
+        std::vector<Resident> m_Residents;
+        float m_Watermark = 0.0f;
+
+        int m_Rejected = 0;
+        int m_EvictedLastFrame = 0;
+        int m_RejectedLastFrame = 0;
+    };
+}
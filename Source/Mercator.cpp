@@ -45,6 +45,38 @@ namespace Earth::Mercator
         return glm::vec2(u, v);
     }
 
+    glm::dvec2 PositionToUV(const glm::dvec3& position)
+    {
+        const double PI = glm::pi<double>();
+        glm::dvec3 p = glm::normalize(position);
+
+        double longitude = std::atan2(p.x, p.z);
+        double latitude = std::asin(glm::clamp(p.y, -1.0, 1.0));
+
+        double u = (longitude + PI) / (2.0 * PI);
+
+        double mercatorY = std::log(std::tan(PI / 4.0 + latitude / 2.0));
+        double v = (1.0 - mercatorY / PI) / 2.0;
+
+        return glm::dvec2(u, v);
+    }
+
+    glm::dvec2 LonLatToUV(double lonDegrees, double latDegrees)
+    {
+        const double PI = glm::pi<double>();
+        const double MAX_LATITUDE = 85.05112877980659;
+
+        double longitude = glm::radians(lonDegrees);
+        double latitude = glm::radians(glm::clamp(latDegrees, -MAX_LATITUDE, MAX_LATITUDE));
+
+        double u = (longitude + PI) / (2.0 * PI);
+
+        double mercatorY = std::log(std::tan(PI / 4.0 + latitude / 2.0));
+        double v = (1.0 - mercatorY / PI) / 2.0;
+
+        return glm::dvec2(u, v);
+    }
+
     Mesh GeneratePlaneMesh(int resolution)
     {
         Mesh mesh;
@@ -54,15 +86,7 @@ namespace Earth::Mercator
         {
             for (int x = 0; x <= resolution; x++)
             {
-                glm::vec2 uv;
-                uv.x = (float)x / (float)resolution;
-                uv.y = (float)y / (float)resolution;
-
-                Vertex v;
-                v.UV = uv;
-                v.Position = glm::vec3(uv.x, uv.y, 0.0f); // Flat plane
-
-                mesh.Vertices.push_back(v);
+                mesh.Vertices.push_back(Vertex::FromUV((float)x / (float)resolution, (float)y / (float)resolution));
             }
         }
 
@@ -71,10 +95,10 @@ namespace Earth::Mercator
         {
             for (int x = 0; x < resolution; x++)
             {
-                uint32_t topLeft = y * (resolution + 1) + x;
-                uint32_t topRight = topLeft + 1;
-                uint32_t bottomLeft = (y + 1) * (resolution + 1) + x;
-                uint32_t bottomRight = bottomLeft + 1;
+                uint16_t topLeft = (uint16_t)(y * (resolution + 1) + x);
+                uint16_t topRight = topLeft + 1;
+                uint16_t bottomLeft = (uint16_t)((y + 1) * (resolution + 1) + x);
+                uint16_t bottomRight = bottomLeft + 1;
 
                 // Triangle 1
                 mesh.Indices.push_back(topLeft);
@@ -9,6 +9,12 @@ namespace Earth::Mercator
     // Converts a Web Mercator UV (0-1) to a 3D position on a sphere
     glm::vec3 UVToPosition(const glm::vec2& uv, float radius = 1.0f);
     glm::vec2 PositionToUV(const glm::vec3& position);
+    // Double precision version, for positions resolved to meters such as picked points.
+    glm::dvec2 PositionToUV(const glm::dvec3& position);
+
+    // Converts longitude/latitude in degrees to a Web Mercator UV (0-1). Latitude is clamped to the
+    // Mercator limit. Double precision keeps tile coordinates exact at deep zoom levels.
+    glm::dvec2 LonLatToUV(double lonDegrees, double latDegrees);
 
     Mesh GeneratePlaneMesh(int resolution);
 }
@@ -1,20 +1,36 @@
 #pragma once
 
-#include <glm/glm.hpp>
-
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace Earth
 {
+    // Tile vertices only need their position within the tile, so they are packed into 8 bytes. UVs
+    // are fixed point with UV_SCALE steps per tile, which keeps grid coordinates and shared tile
+    // edges exact.
     struct Vertex
     {
-        glm::vec3 Position;
-        glm::vec2 UV;
+        static constexpr float UV_SCALE = 32768.0f;
+
+        uint16_t U = 0;
+        uint16_t V = 0;
+        // Non-zero for skirt vertices, which are pushed below the surface.
+        uint16_t Skirt = 0;
+        uint16_t Padding = 0;
+
+        static Vertex FromUV(float u, float v, bool skirt = false)
+        {
+            return {(uint16_t)(u * UV_SCALE + 0.5f), (uint16_t)(v * UV_SCALE + 0.5f), (uint16_t)skirt, 0};
+        }
     };
 
+    // Indices are relative to the mesh's first vertex, so a mesh holds at most 65536 vertices.
     struct Mesh
     {
+        static constexpr size_t MAX_VERTICES = 65536;
+
         std::vector<Vertex> Vertices;
-        std::vector<uint32_t> Indices;
+        std::vector<uint16_t> Indices;
     };
 }
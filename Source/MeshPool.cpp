@@ -0,0 +1,184 @@
+#include "MeshPool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+namespace Earth
+{
+    MeshPool::Handle::Handle(Handle&& other) noexcept
+        : m_Pool(other.m_Pool), m_FirstVertex(other.m_FirstVertex), m_VertexCount(other.m_VertexCount),
+          m_FirstIndex(other.m_FirstIndex), m_IndexCount(other.m_IndexCount)
+    {
+        other.m_Pool = nullptr;
+    }
+
+    MeshPool::Handle& MeshPool::Handle::operator=(Handle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            m_Pool = other.m_Pool;
+            m_FirstVertex = other.m_FirstVertex;
+            m_VertexCount = other.m_VertexCount;
+            m_FirstIndex = other.m_FirstIndex;
+            m_IndexCount = other.m_IndexCount;
+            other.m_Pool = nullptr;
+        }
+        return *this;
+    }
+
+    MeshPool::Handle::~Handle()
+    {
+        Release();
+    }
+
+    void MeshPool::Handle::Release()
+    {
+        if (!m_Pool)
+            return;
+
+        Free(m_Pool->m_FreeVertices, m_FirstVertex, m_VertexCount);
+        Free(m_Pool->m_FreeIndices, m_FirstIndex, m_IndexCount);
+        m_Pool->m_UsedVertices -= m_VertexCount;
+        m_Pool->m_UsedIndices -= m_IndexCount;
+        m_Pool = nullptr;
+    }
+
+    MeshPool::MeshPool(size_t vertexCapacity, size_t indexCapacity)
+    {
+        glGenVertexArrays(1, &m_VAO);
+        Grow(vertexCapacity, indexCapacity);
+    }
+
+    MeshPool::~MeshPool()
+    {
+        glDeleteVertexArrays(1, &m_VAO);
+        glDeleteBuffers(1, &m_VBO);
+        glDeleteBuffers(1, &m_EBO);
+    }
+
+    MeshPool::Handle MeshPool::Allocate(const Mesh& mesh)
+    {
+        if (mesh.Vertices.empty() || mesh.Indices.empty())
+            throw std::runtime_error("Cannot allocate an empty mesh");
+
+        Handle handle;
+        handle.m_VertexCount = mesh.Vertices.size();
+        handle.m_IndexCount = mesh.Indices.size();
+
+        while (!TryAllocate(m_FreeVertices, handle.m_VertexCount, handle.m_FirstVertex))
+            Grow(std::max(m_VertexCapacity * 2, m_VertexCapacity + handle.m_VertexCount), m_IndexCapacity);
+        while (!TryAllocate(m_FreeIndices, handle.m_IndexCount, handle.m_FirstIndex))
+            Grow(m_VertexCapacity, std::max(m_IndexCapacity * 2, m_IndexCapacity + handle.m_IndexCount));
+
+        handle.m_Pool = this;
+        m_UsedVertices += handle.m_VertexCount;
+        m_UsedIndices += handle.m_IndexCount;
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, handle.m_FirstVertex * sizeof(Vertex), mesh.Vertices.size() * sizeof(Vertex),
+                        mesh.Vertices.data());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, handle.m_FirstIndex * sizeof(uint16_t),
+                        mesh.Indices.size() * sizeof(uint16_t), mesh.Indices.data());
+
+        return handle;
+    }
+
+    void MeshPool::Bind() const
+    {
+        glBindVertexArray(m_VAO);
+    }
+
+    bool MeshPool::TryAllocate(FreeList& freeList, size_t count, size_t& offset)
+    {
+        // First fit keeps long-lived meshes packed towards the start of the buffer.
+        for (auto it = freeList.begin(); it != freeList.end(); ++it)
+        {
+            if (it->second < count)
+                continue;
+
+            offset = it->first;
+            size_t remaining = it->second - count;
+            freeList.erase(it);
+            if (remaining > 0)
+                freeList.emplace(offset + count, remaining);
+            return true;
+        }
+        return false;
+    }
+
+    void MeshPool::Free(FreeList& freeList, size_t offset, size_t count)
+    {
+        auto next = freeList.lower_bound(offset);
+        if (next != freeList.end() && offset + count == next->first)
+        {
+            count += next->second;
+            next = freeList.erase(next);
+        }
+        if (next != freeList.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += count;
+                return;
+            }
+        }
+        freeList.emplace(offset, count);
+    }
+
+    void MeshPool::Grow(size_t vertexCapacity, size_t indexCapacity)
+    {
+        // Copies the old contents into new buffers; existing handles keep their offsets.
+        auto grow = [](GLuint& buffer, size_t oldSize, size_t newSize) {
+            GLuint newBuffer = 0;
+            glGenBuffers(1, &newBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+            if (buffer)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+                glDeleteBuffers(1, &buffer);
+            }
+            buffer = newBuffer;
+        };
+
+        if (vertexCapacity > m_VertexCapacity)
+        {
+            grow(m_VBO, m_VertexCapacity * sizeof(Vertex), vertexCapacity * sizeof(Vertex));
+            Free(m_FreeVertices, m_VertexCapacity, vertexCapacity - m_VertexCapacity);
+            m_VertexCapacity = vertexCapacity;
+        }
+        if (indexCapacity > m_IndexCapacity)
+        {
+            grow(m_EBO, m_IndexCapacity * sizeof(uint16_t), indexCapacity * sizeof(uint16_t));
+            Free(m_FreeIndices, m_IndexCapacity, indexCapacity - m_IndexCapacity);
+            m_IndexCapacity = indexCapacity;
+        }
+
+        SetupAttributes();
+    }
+
+    void MeshPool::SetupAttributes()
+    {
+        glBindVertexArray(m_VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+
+        // Attributes, converted to float unnormalized so the fixed point UVs stay exact
+        // 0: UV
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, U));
+
+        // 1: Skirt
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Skirt));
+
+        glBindVertexArray(0);
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+namespace Earth
+{
+    // All tile meshes share one vertex and one index buffer behind a single VAO, so switching tiles
+    // only changes the offsets passed to glDrawElementsBaseVertex. Buffers double in size when full.
+    class MeshPool
+    {
+      public:
+        // A mesh's place in the pool, returned to it on destruction.
+        class Handle
+        {
+          public:
+            Handle() = default;
+            Handle(Handle&& other) noexcept;
+            Handle& operator=(Handle&& other) noexcept;
+            ~Handle();
+
+            Handle(const Handle&) = delete;
+            Handle& operator=(const Handle&) = delete;
+
+            bool IsValid() const
+            {
+                return m_Pool != nullptr;
+            }
+            GLint GetBaseVertex() const
+            {
+                return (GLint)m_FirstVertex;
+            }
+            size_t GetFirstIndex() const
+            {
+                return m_FirstIndex;
+            }
+            GLsizei GetIndexCount() const
+            {
+                return (GLsizei)m_IndexCount;
+            }
+
+          private:
+            friend class MeshPool;
+
+            void Release();
+
+            MeshPool* m_Pool = nullptr;
+            size_t m_FirstVertex = 0;
+            size_t m_VertexCount = 0;
+            size_t m_FirstIndex = 0;
+            size_t m_IndexCount = 0;
+        };
+
+        MeshPool(size_t vertexCapacity = 1 << 20, size_t indexCapacity = 1 << 22);
+        ~MeshPool();
+
+        MeshPool(const MeshPool&) = delete;
+        MeshPool& operator=(const MeshPool&) = delete;
+
+        Handle Allocate(const Mesh& mesh);
+
+        void Bind() const;
+
+        size_t GetVertexCapacity() const
+        {
+            return m_VertexCapacity;
+        }
+        size_t GetUsedVertices() const
+        {
+            return m_UsedVertices;
+        }
+        size_t GetIndexCapacity() const
+        {
+            return m_IndexCapacity;
+        }
+        size_t GetUsedIndices() const
+        {
+            return m_UsedIndices;
+        }
+
+      private:
+        // Free ranges by offset, merged with their neighbours when returned.
+        using FreeList = std::map<size_t, size_t>;
+
+        static bool TryAllocate(FreeList& freeList, size_t count, size_t& offset);
+        static void Free(FreeList& freeList, size_t offset, size_t count);
+
+        void Grow(size_t vertexCapacity, size_t indexCapacity);
+        void SetupAttributes();
+
+        GLuint m_VAO = 0;
+        GLuint m_VBO = 0;
+        GLuint m_EBO = 0;
+        size_t m_VertexCapacity = 0;
+        size_t m_IndexCapacity = 0;
+        size_t m_UsedVertices = 0;
+        size_t m_UsedIndices = 0;
+        FreeList m_FreeVertices;
+        FreeList m_FreeIndices;
+    };
+}
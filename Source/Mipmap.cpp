@@ -0,0 +1,150 @@
+#include "Mipmap.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define EARTH_MIPMAP_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define EARTH_MIPMAP_NEON
+#endif
+
+namespace Earth::Mipmap
+{
+    namespace
+    {
+        constexpr int LINEAR_TO_SRGB_SIZE = 4096;
+
+        const std::array<float, 256>& GetSRGBToLinear()
+        {
+            static const std::array<float, 256> s_Table = []() {
+                std::array<float, 256> table;
+                for (int i = 0; i < 256; ++i)
+                {
+                    float c = i / 255.0f;
+                    table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+                }
+                return table;
+            }();
+            return s_Table;
+        }
+
+        const std::array<unsigned char, LINEAR_TO_SRGB_SIZE>& GetLinearToSRGB()
+        {
+            static const std::array<unsigned char, LINEAR_TO_SRGB_SIZE> s_Table = []() {
+                std::array<unsigned char, LINEAR_TO_SRGB_SIZE> table;
+                for (int i = 0; i < LINEAR_TO_SRGB_SIZE; ++i)
+                {
+                    float l = i / (float)(LINEAR_TO_SRGB_SIZE - 1);
+                    float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                    table[i] = (unsigned char)std::lround(std::clamp(c, 0.0f, 1.0f) * 255.0f);
+                }
+                return table;
+            }();
+            return s_Table;
+        }
+
+        // Level 0 expanded to 4 linear floats per pixel, so every pixel fits one SIMD register.
+        std::vector<float> ToLinear(const TextureLevel& level, int channels)
+        {
+            const auto& toLinear = GetSRGBToLinear();
+            size_t count = (size_t)level.Width * level.Height;
+
+            std::vector<float> linear(count * 4);
+            for (size_t i = 0; i < count; ++i)
+            {
+                const unsigned char* src = level.Data.data() + i * channels;
+                float* dst = linear.data() + i * 4;
+                dst[0] = toLinear[src[0]];
+                dst[1] = toLinear[src[1]];
+                dst[2] = toLinear[src[2]];
+                dst[3] = channels == 4 ? src[3] / 255.0f : 1.0f;
+            }
+            return linear;
+        }
+
+        TextureLevel ToLevel(const std::vector<float>& linear, int width, int height, int channels)
+        {
+            const auto& toSRGB = GetLinearToSRGB();
+            size_t count = (size_t)width * height;
+
+            TextureLevel level{width, height, std::vector<unsigned char>(count * channels)};
+            for (size_t i = 0; i < count; ++i)
+            {
+                const float* src = linear.data() + i * 4;
+                unsigned char* dst = level.Data.data() + i * channels;
+                for (int c = 0; c < 3; ++c)
+                    dst[c] = toSRGB[(int)(std::clamp(src[c], 0.0f, 1.0f) * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)];
+                if (channels == 4)
+                    dst[3] = (unsigned char)(std::clamp(src[3], 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+            return level;
+        }
+
+        // Averages the four source pixels starting at a, b (row y0) and c, d (row y1) into dst.
+        inline void Average4(const float* a, const float* b, const float* c, const float* d, float* dst)
+        {
+#if defined(EARTH_MIPMAP_SSE)
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)),
+                                    _mm_add_ps(_mm_loadu_ps(c), _mm_loadu_ps(d)));
+            _mm_storeu_ps(dst, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#elif defined(EARTH_MIPMAP_NEON)
+            float32x4_t sum = vaddq_f32(vaddq_f32(vld1q_f32(a), vld1q_f32(b)), vaddq_f32(vld1q_f32(c), vld1q_f32(d)));
+            vst1q_f32(dst, vmulq_n_f32(sum, 0.25f));
+#else
+            for (int i = 0; i < 4; ++i)
+                dst[i] = (a[i] + b[i] + c[i] + d[i]) * 0.25f;
+#endif
+        }
+
+        // 2x2 box filter, clamping at the edges for odd or 1-pixel dimensions.
+        std::vector<float> Downsample(const std::vector<float>& src, int width, int height, int outWidth,
+                                      int outHeight)
+        {
+            std::vector<float> dst((size_t)outWidth * outHeight * 4);
+            for (int y = 0; y < outHeight; ++y)
+            {
+                const float* row0 = src.data() + (size_t)std::min(y * 2, height - 1) * width * 4;
+                const float* row1 = src.data() + (size_t)std::min(y * 2 + 1, height - 1) * width * 4;
+                float* out = dst.data() + (size_t)y * outWidth * 4;
+
+                for (int x = 0; x < outWidth; ++x)
+                {
+                    int x0 = std::min(x * 2, width - 1) * 4;
+                    int x1 = std::min(x * 2 + 1, width - 1) * 4;
+                    Average4(row0 + x0, row0 + x1, row1 + x0, row1 + x1, out + x * 4);
+                }
+            }
+            return dst;
+        }
+    }
+
+    void Generate(TextureData& texture, int minSize)
+    {
+        if (texture.Levels.size() != 1 || texture.IsCompressed())
+            throw std::runtime_error("Mipmaps can only be generated from a single uncompressed level");
+
+        int channels = texture.Format == TextureFormat::RGBA8 ? 4 : 3;
+        int width = texture.Levels[0].Width;
+        int height = texture.Levels[0].Height;
+        minSize = std::max(1, minSize);
+
+        std::vector<float> linear = ToLinear(texture.Levels[0], channels);
+        while (width > 1 || height > 1)
+        {
+            int nextWidth = std::max(1, width / 2);
+            int nextHeight = std::max(1, height / 2);
+            if (std::min(nextWidth, nextHeight) < minSize)
+                break;
+
+            linear = Downsample(linear, width, height, nextWidth, nextHeight);
+            width = nextWidth;
+            height = nextHeight;
+            texture.Levels.push_back(ToLevel(linear, width, height, channels));
+        }
+    }
+}
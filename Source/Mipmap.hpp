@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Texture.hpp"
+
+namespace Earth::Mipmap
+{
+    // Appends a mip chain to an RGB8 or RGBA8 texture holding only level 0. Color is filtered in linear
+    // space (the data is treated as sRGB) with a 2x2 box filter; alpha is filtered as-is. The chain
+    // stops before either dimension drops below `minSize`.
+    void Generate(TextureData& texture, int minSize = 1);
+}
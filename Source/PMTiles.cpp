@@ -0,0 +1,265 @@
+#include "PMTiles.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+namespace Earth
+{
+    namespace
+    {
+        constexpr size_t HEADER_SIZE = 127;
+        constexpr int MAX_DIRECTORY_DEPTH = 4;
+        constexpr size_t MAX_CACHED_LEAVES = 256;
+
+        enum Compression : uint8_t
+        {
+            COMPRESSION_UNKNOWN = 0,
+            COMPRESSION_NONE = 1,
+            COMPRESSION_GZIP = 2,
+        };
+
+        uint64_t ReadU64(const unsigned char* p)
+        {
+            uint64_t value = 0;
+            for (int i = 7; i >= 0; --i)
+                value = (value << 8) | p[i];
+            return value;
+        }
+
+        // Header bounds are stored as degrees times 10^7.
+        double ReadDegrees(const unsigned char* p)
+        {
+            uint32_t value = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+            return (int32_t)value / 1e7;
+        }
+
+        class VarintReader
+        {
+          public:
+            VarintReader(std::span<const unsigned char> bytes) : m_Bytes(bytes)
+            {
+            }
+
+            uint64_t Read()
+            {
+                uint64_t value = 0;
+                for (int shift = 0; shift < 64; shift += 7)
+                {
+                    if (m_Pos >= m_Bytes.size())
+                        throw std::runtime_error("Truncated PMTiles directory");
+
+                    unsigned char byte = m_Bytes[m_Pos++];
+                    value |= (uint64_t)(byte & 0x7F) << shift;
+                    if (!(byte & 0x80))
+                        return value;
+                }
+                throw std::runtime_error("Malformed varint in PMTiles directory");
+            }
+
+          private:
+            std::span<const unsigned char> m_Bytes;
+            size_t m_Pos = 0;
+        };
+
+        std::string Gunzip(std::span<const unsigned char> compressed)
+        {
+            z_stream stream = {};
+            // 16 + MAX_WBITS accepts a gzip header
+            if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+                throw std::runtime_error("Failed to initialize zlib");
+
+            stream.next_in = const_cast<Bytef*>(compressed.data());
+            stream.avail_in = (uInt)compressed.size();
+
+            std::string output;
+            char buffer[16384];
+            int result;
+            do
+            {
+                stream.next_out = reinterpret_cast<Bytef*>(buffer);
+                stream.avail_out = sizeof(buffer);
+                result = inflate(&stream, Z_NO_FLUSH);
+                if (result != Z_OK && result != Z_STREAM_END)
+                {
+                    inflateEnd(&stream);
+                    throw std::runtime_error("Failed to decompress gzip data");
+                }
+                output.append(buffer, sizeof(buffer) - stream.avail_out);
+            } while (result != Z_STREAM_END);
+
+            inflateEnd(&stream);
+            return output;
+        }
+
+        // Rotates a quadrant so the Hilbert curve keeps its orientation, as in the PMTiles spec.
+        void Rotate(int64_t n, int64_t& x, int64_t& y, int64_t rx, int64_t ry)
+        {
+            if (ry == 0)
+            {
+                if (rx != 0)
+                {
+                    x = n - 1 - x;
+                    y = n - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+    }
+
+    PMTilesSource::PMTilesSource(const std::string& path) : m_File(std::make_shared<MappedFile>(path))
+    {
+        std::span<const unsigned char> bytes = m_File->GetBytes();
+        if (bytes.size() < HEADER_SIZE || std::memcmp(bytes.data(), "PMTiles", 7) != 0)
+            throw std::runtime_error(std::format("{} is not a PMTiles archive", path));
+        if (bytes[7] != 3)
+            throw std::runtime_error(std::format("{} has unsupported PMTiles version {}", path, bytes[7]));
+
+        const unsigned char* header = bytes.data();
+        m_RootOffset = ReadU64(header + 8);
+        m_RootLength = ReadU64(header + 16);
+        m_LeafOffset = ReadU64(header + 40);
+        m_TileDataOffset = ReadU64(header + 56);
+        m_InternalCompression = header[97];
+        m_TileCompression = header[98];
+        m_MinZoom = header[100];
+        m_MaxZoom = header[101];
+        m_Bounds.West = ReadDegrees(header + 102);
+        m_Bounds.South = ReadDegrees(header + 106);
+        m_Bounds.East = ReadDegrees(header + 110);
+        m_Bounds.North = ReadDegrees(header + 114);
+
+        if (m_InternalCompression != COMPRESSION_NONE && m_InternalCompression != COMPRESSION_GZIP)
+            throw std::runtime_error(
+                std::format("{} uses unsupported directory compression {}", path, m_InternalCompression));
+        if (m_TileCompression != COMPRESSION_NONE && m_TileCompression != COMPRESSION_UNKNOWN &&
+            m_TileCompression != COMPRESSION_GZIP)
+            throw std::runtime_error(std::format("{} uses unsupported tile compression {}", path, m_TileCompression));
+
+        m_Root = std::make_shared<const Directory>(ParseDirectory(m_RootOffset, m_RootLength));
+    }
+
+    uint64_t PMTilesSource::GetTileID(int x, int y, int z)
+    {
+        uint64_t id = ((1ull << (z * 2)) - 1) / 3;
+        int64_t tx = x;
+        int64_t ty = y;
+        for (int64_t a = z - 1; a >= 0; --a)
+        {
+            int64_t s = 1ll << a;
+            int64_t rx = s & tx;
+            int64_t ry = s & ty;
+            id += (uint64_t)((3 * rx) ^ ry) << a;
+            Rotate(s, tx, ty, rx, ry);
+        }
+        return id;
+    }
+
+    TileData PMTilesSource::Fetch(int x, int y, int z, std::atomic<bool>* cancelled, const HTTP::SinkFactory& sink)
+    {
+        if (z < m_MinZoom || z > m_MaxZoom)
+            return TileData();
+
+        uint64_t tileID = GetTileID(x, y, z);
+        std::shared_ptr<const Directory> directory = m_Root;
+
+        for (int depth = 0; depth < MAX_DIRECTORY_DEPTH; ++depth)
+        {
+            // Last entry with TileID <= tileID
+            auto it = std::upper_bound(directory->begin(), directory->end(), tileID,
+                                       [](uint64_t id, const Entry& entry) { return id < entry.TileID; });
+            if (it == directory->begin())
+                return TileData();
+
+            const Entry& entry = *(it - 1);
+            if (entry.RunLength == 0)
+            {
+                // Points at a leaf directory
+                directory = GetDirectory(m_LeafOffset + entry.Offset, entry.Length);
+                continue;
+            }
+
+            if (tileID - entry.TileID >= entry.RunLength)
+                return TileData();
+
+            std::span<const unsigned char> tile = GetRange(m_TileDataOffset + entry.Offset, entry.Length);
+            if (m_TileCompression == COMPRESSION_GZIP)
+                return TileData(Gunzip(tile));
+            return TileData(tile, m_File);
+        }
+
+        throw std::runtime_error("PMTiles directory nesting too deep");
+    }
+
+    std::shared_ptr<const PMTilesSource::Directory> PMTilesSource::GetDirectory(uint64_t offset, uint64_t length)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_LeavesMutex);
+            auto it = m_Leaves.find(offset);
+            if (it != m_Leaves.end())
+                return it->second;
+        }
+
+        // Parse outside the lock; two threads racing on the same leaf just parse it twice.
+        auto directory = std::make_shared<const Directory>(ParseDirectory(offset, length));
+
+        std::lock_guard<std::mutex> lock(m_LeavesMutex);
+        if (m_Leaves.size() >= MAX_CACHED_LEAVES)
+            m_Leaves.clear();
+        m_Leaves.emplace(offset, directory);
+        return directory;
+    }
+
+    PMTilesSource::Directory PMTilesSource::ParseDirectory(uint64_t offset, uint64_t length) const
+    {
+        std::span<const unsigned char> bytes = GetRange(offset, length);
+
+        std::string decompressed;
+        if (m_InternalCompression == COMPRESSION_GZIP)
+        {
+            decompressed = Gunzip(bytes);
+            bytes = {reinterpret_cast<const unsigned char*>(decompressed.data()), decompressed.size()};
+        }
+
+        // Columns are stored one after another: ids (delta coded), run lengths, lengths, offsets.
+        VarintReader reader(bytes);
+        uint64_t count = reader.Read();
+        if (count > bytes.size())
+            throw std::runtime_error("Malformed PMTiles directory");
+
+        Directory entries(count);
+
+        uint64_t lastID = 0;
+        for (auto& entry : entries)
+        {
+            lastID += reader.Read();
+            entry.TileID = lastID;
+        }
+        for (auto& entry : entries)
+            entry.RunLength = (uint32_t)reader.Read();
+        for (auto& entry : entries)
+            entry.Length = (uint32_t)reader.Read();
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            // Zero means "directly after the previous entry"
+            uint64_t value = reader.Read();
+            if (value == 0 && i > 0)
+                entries[i].Offset = entries[i - 1].Offset + entries[i - 1].Length;
+            else
+                entries[i].Offset = value - 1;
+        }
+
+        return entries;
+    }
+
+    std::span<const unsigned char> PMTilesSource::GetRange(uint64_t offset, uint64_t length) const
+    {
+        std::span<const unsigned char> bytes = m_File->GetBytes();
+        if (offset > bytes.size() || length > bytes.size() - offset)
+            throw std::runtime_error("PMTiles range out of bounds");
+        return bytes.subspan(offset, length);
+    }
+}
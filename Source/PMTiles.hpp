@@ -0,0 +1,72 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include "TileSource.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Earth
+{
+    // Reads tiles from a memory-mapped PMTiles v3 archive. Tile bytes are served straight out of the
+    // mapping; only directories are decoded, and those are cached.
+    class PMTilesSource : public TileSource
+    {
+      public:
+        PMTilesSource(const std::string& path);
+
+        TileData Fetch(int x, int y, int z, std::atomic<bool>* cancelled = nullptr,
+                       const HTTP::SinkFactory& sink = {}) override;
+
+        int GetMinZoom() const override
+        {
+            return m_MinZoom;
+        }
+        int GetMaxZoom() const override
+        {
+            return m_MaxZoom;
+        }
+        TileBounds GetBounds() const override
+        {
+            return m_Bounds;
+        }
+
+        // Hilbert-curve tile id used as the directory key.
+        static uint64_t GetTileID(int x, int y, int z);
+
+      private:
+        struct Entry
+        {
+            uint64_t TileID;
+            uint64_t Offset;
+            uint32_t Length;
+            uint32_t RunLength;
+        };
+
+        using Directory = std::vector<Entry>;
+
+        std::shared_ptr<const Directory> GetDirectory(uint64_t offset, uint64_t length);
+        Directory ParseDirectory(uint64_t offset, uint64_t length) const;
+        std::span<const unsigned char> GetRange(uint64_t offset, uint64_t length) const;
+
+        std::shared_ptr<MappedFile> m_File;
+
+        uint64_t m_RootOffset = 0;
+        uint64_t m_RootLength = 0;
+        uint64_t m_LeafOffset = 0;
+        uint64_t m_TileDataOffset = 0;
+        uint8_t m_InternalCompression = 0;
+        uint8_t m_TileCompression = 0;
+        int m_MinZoom = 0;
+        int m_MaxZoom = 0;
+        TileBounds m_Bounds;
+
+        std::shared_ptr<const Directory> m_Root;
+        std::unordered_map<uint64_t, std::shared_ptr<const Directory>> m_Leaves;
+        std::mutex m_LeavesMutex;
+    };
+}
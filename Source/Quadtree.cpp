@@ -1,11 +1,18 @@
 #include "Quadtree.hpp"
 #include "Mercator.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <glm/gtc/constants.hpp>
+#include <limits>
 
 namespace Earth
 {
+    namespace
+    {
+        constexpr float MERGE_RATIO = 0.8f;
+    }
+
     QuadtreeNode::QuadtreeNode(QuadtreeNode* parent, int x, int y, int z, Tileset& satelliteTileset,
                                Tileset& terrainTileset)
         : m_Parent(parent), m_X(x), m_Y(y), m_Z(z), m_SatelliteTileset(satelliteTileset),
@@ -17,8 +24,13 @@ namespace Earth
     {
     }
 
-    void QuadtreeNode::Update(const Camera& camera)
+    void QuadtreeNode::Update(const Camera& camera, float splitThreshold)
     {
+        // Past the terrain's max zoom or outside its bounds, elevation comes from the deepest ancestor
+        // that has it instead of a request that can only come back empty.
+        m_CoversTerrain = m_TerrainTileset.Covers(m_X, m_Y, m_Z);
+        m_InheritsTerrain = !m_CoversTerrain && m_Parent && (m_Parent->m_CoversTerrain || m_Parent->m_InheritsTerrain);
+
         m_IsVisible = CheckVisibility(camera);
 
         if (!m_IsVisible)
@@ -26,24 +38,37 @@ namespace Earth
             if (!m_Children.empty())
                 Merge();
             m_IsRenderable = false;
+            // Off-screen tiles are kept for when the camera turns back, but are the first to go.
+            TouchTiles(0.0f);
             return;
         }
 
+        if (m_SatelliteTile && m_SatelliteTile->IsEvicted())
+            m_SatelliteTile.reset();
+        if (m_TerrainTile && m_TerrainTile->IsEvicted())
+            m_TerrainTile.reset();
+
+        // Larger on screen means more important to load, upload and keep. Tiles hidden behind
+        // loaded children are only a fallback.
+        m_ScreenSpaceError = ComputeScreenSpaceError(camera);
+        float priority = m_AllChildrenRenderable ? 0.0f : m_ScreenSpaceError;
+
         if (!m_SatelliteTile)
-            m_SatelliteTile = m_SatelliteTileset.LoadTile(m_X, m_Y, m_Z);
-        if (!m_TerrainTile)
-            m_TerrainTile = m_TerrainTileset.LoadTile(m_X, m_Y, m_Z);
+            m_SatelliteTile = m_SatelliteTileset.LoadTile(m_X, m_Y, m_Z, priority);
+        if (!m_TerrainTile && m_CoversTerrain)
+            m_TerrainTile = m_TerrainTileset.LoadTile(m_X, m_Y, m_Z, priority);
 
         if (m_SatelliteTile)
         {
-            m_SatelliteTile->CheckLoad();
+            m_SatelliteTile->CheckLoad(priority);
         }
         if (m_TerrainTile)
         {
-            m_TerrainTile->CheckLoad();
+            m_TerrainTile->CheckLoad(priority);
         }
+        TouchTiles(priority);
 
-        if (ShouldSplit(camera))
+        if (ShouldSplit(splitThreshold))
         {
             if (m_Children.empty())
             {
@@ -53,7 +78,7 @@ namespace Earth
             bool childrenReady = true;
             for (auto& child : m_Children)
             {
-                child->Update(camera);
+                child->Update(camera, splitThreshold);
                 // If child is visible, it must be renderable to be considered ready.
                 // If child is NOT visible, it is considered ready (since it won't be drawn).
                 if (child->IsVisible() && !child->IsRenderable())
@@ -72,8 +97,11 @@ namespace Earth
             m_AllChildrenRenderable = false;
         }
 
-        m_IsRenderable = m_AllChildrenRenderable ||
-                         (m_SatelliteTile && m_SatelliteTile->IsLoaded() && m_TerrainTile && m_TerrainTile->IsLoaded());
+        // Whether the node has its final look: its own imagery and terrain, which is borrowed past the
+        // terrain's coverage, or none at all outside it.
+        const QuadtreeNode* terrainNode = FindTerrainNode();
+        bool terrainReady = m_CoversTerrain ? terrainNode == this : terrainNode || !m_InheritsTerrain;
+        m_IsRenderable = m_AllChildrenRenderable || (FindSatelliteNode() == this && terrainReady);
     }
 
     void QuadtreeNode::Draw(Renderer& renderer, const glm::mat4& viewProjection)
@@ -81,26 +109,117 @@ namespace Earth
         if (!m_IsVisible)
             return;
 
-        if (m_AllChildrenRenderable)
+        // Children stand in with an ancestor's tiles until their own arrive, so each one sharpens as
+        // soon as it loads instead of waiting for its slowest sibling.
+        if (!m_Children.empty())
         {
             for (auto& child : m_Children)
             {
                 child->Draw(renderer, viewProjection);
             }
+            return;
+        }
+
+        const QuadtreeNode* satelliteNode = FindSatelliteNode();
+        const QuadtreeNode* terrainNode = FindTerrainNode();
+        if (!satelliteNode || (!terrainNode && (m_CoversTerrain || m_InheritsTerrain)))
+            return;
+
+        satelliteNode->m_SatelliteTile->Bind(0);
+
+        // Another node's mesh spans its whole tile, so borrowed terrain is drawn on the plain grid.
+        const MeshPool::Handle* mesh = nullptr;
+        glm::vec4 elevationRect(1.0f, 1.0f, 0.0f, 0.0f);
+        if (terrainNode)
+        {
+            terrainNode->m_TerrainTile->Bind(1);
+            elevationRect = GetSubRect(*terrainNode);
+            if (terrainNode == this)
+                mesh = m_TerrainTile->GetMesh();
         }
         else
         {
-            if (m_SatelliteTile && m_TerrainTile)
-            {
-                m_SatelliteTile->Bind(0);
-                m_TerrainTile->Bind(1);
-                if (m_SatelliteTile->IsLoaded() && m_TerrainTile->IsLoaded())
-                {
-                    bool showGrid = false;
-                    renderer.DrawTile(viewProjection, m_X, m_Y, m_Z, showGrid);
-                }
-            }
+            renderer.BindFlatElevation(1);
         }
+
+        bool showGrid = false;
+        renderer.DrawTile(viewProjection, m_X, m_Y, m_Z, mesh, GetSubRect(*satelliteNode), elevationRect, showGrid);
+    }
+
+    void QuadtreeNode::Intersect(const Ray& ray, std::optional<double>& nearest) const
+    {
+        // The ray comes from the camera, so it can't reach culled nodes.
+        if (!m_IsVisible)
+            return;
+
+        if (!m_Children.empty())
+        {
+            for (auto& child : m_Children)
+                child->Intersect(ray, nearest);
+            return;
+        }
+
+        double maxDistance = nearest.value_or(std::numeric_limits<double>::max());
+        const QuadtreeNode* terrainNode = FindTerrainNode();
+        const Heightfield* heightfield = terrainNode ? terrainNode->m_TerrainTile->GetHeightfield() : nullptr;
+        if (heightfield)
+        {
+            glm::dvec4 rect(GetSubRect(*terrainNode));
+            std::optional<double> distance = heightfield->Intersect(ray, maxDistance, rect);
+            if (distance)
+                nearest = distance;
+            return;
+        }
+
+        // Without terrain the tile lies on the sea level sphere.
+        double b = glm::dot(ray.Origin, ray.Direction);
+        double c = glm::dot(ray.Origin, ray.Origin) - 1.0;
+        double discriminant = b * b - c;
+        if (discriminant < 0.0)
+            return;
+        double distance = -b - std::sqrt(discriminant);
+        if (distance < 0.0 || distance >= maxDistance)
+            return;
+
+        glm::dvec2 uv = Mercator::PositionToUV(ray.Origin + ray.Direction * distance) * (double)(1 << m_Z);
+        if (uv.x >= m_X && uv.x <= m_X + 1 && uv.y >= m_Y && uv.y <= m_Y + 1)
+            nearest = distance;
+    }
+
+    float QuadtreeNode::GetElevation(const glm::dvec2& uv) const
+    {
+        if (!m_Children.empty())
+        {
+            // Children are ordered row by row, see Split
+            glm::dvec2 position = uv * (double)(1 << (m_Z + 1));
+            int column = std::clamp((int)position.x - m_X * 2, 0, 1);
+            int row = std::clamp((int)position.y - m_Y * 2, 0, 1);
+            return m_Children[row * 2 + column]->GetElevation(uv);
+        }
+
+        const QuadtreeNode* terrainNode = FindTerrainNode();
+        const Heightfield* heightfield = terrainNode ? terrainNode->m_TerrainTile->GetHeightfield() : nullptr;
+        if (!heightfield)
+            return 0.0f;
+
+        glm::dvec2 position = uv * (double)(1 << terrainNode->m_Z);
+        return heightfield->GetHeight(position - glm::dvec2(terrainNode->m_X, terrainNode->m_Y));
+    }
+
+    bool QuadtreeNode::IsComplete() const
+    {
+        if (!m_IsVisible)
+            return true;
+
+        if (!m_Children.empty())
+            return std::all_of(m_Children.begin(), m_Children.end(),
+                               [](const auto& child) { return child->IsComplete(); });
+
+        // A missing tile was turned away by the memory budget and is requested again next Update.
+        bool satelliteDone = !m_SatelliteTileset.Covers(m_X, m_Y, m_Z) ||
+                             (m_SatelliteTile && !m_SatelliteTile->IsLoading());
+        bool terrainDone = !m_CoversTerrain || (m_TerrainTile && !m_TerrainTile->IsLoading());
+        return satelliteDone && terrainDone;
     }
 
     void QuadtreeNode::Split()
@@ -124,11 +243,67 @@ namespace Earth
         m_Children.clear();
     }
 
-    bool QuadtreeNode::ShouldSplit(const Camera& camera) const
+    void QuadtreeNode::TouchTiles(float priority)
+    {
+        if (m_SatelliteTile)
+            m_SatelliteTile->Touch(priority);
+        if (m_TerrainTile)
+            m_TerrainTile->Touch(priority);
+
+        // Borrowed tiles are as important as the tiles drawn with them, even when their own node is
+        // hidden behind them.
+        const QuadtreeNode* satelliteNode = FindSatelliteNode();
+        if (satelliteNode && satelliteNode != this)
+            satelliteNode->m_SatelliteTile->Touch(priority);
+        const QuadtreeNode* terrainNode = FindTerrainNode();
+        if (terrainNode && terrainNode != this)
+            terrainNode->m_TerrainTile->Touch(priority);
+    }
+
+    const QuadtreeNode* QuadtreeNode::FindSatelliteNode() const
+    {
+        for (const QuadtreeNode* node = this; node; node = node->m_Parent)
+        {
+            if (node->m_SatelliteTile && node->m_SatelliteTile->IsLoaded())
+                return node;
+        }
+        return nullptr;
+    }
+
+    const QuadtreeNode* QuadtreeNode::FindTerrainNode() const
+    {
+        for (const QuadtreeNode* node = this; node; node = node->m_Parent)
+        {
+            if (node->m_TerrainTile && node->m_TerrainTile->IsLoaded())
+                return node;
+        }
+        return nullptr;
+    }
+
+    glm::vec4 QuadtreeNode::GetSubRect(const QuadtreeNode& ancestor) const
     {
-        if (m_Z >= 21)
+        int levels = m_Z - ancestor.m_Z;
+        float scale = 1.0f / (float)(1 << levels);
+        int offsetX = m_X - (ancestor.m_X << levels);
+        int offsetY = m_Y - (ancestor.m_Y << levels);
+        return glm::vec4(scale, scale, (float)offsetX * scale, (float)offsetY * scale);
+    }
+
+    bool QuadtreeNode::ShouldSplit(float splitThreshold) const
+    {
+        // Terrain past its max zoom is borrowed from ancestors, so only the imagery limits the depth.
+        if (m_Z >= m_SatelliteTileset.GetMaxZoom())
             return false;
 
+        // Split nodes merge a little below the threshold, so nodes near it don't flip every frame.
+        bool isSplit = !m_Children.empty();
+        float threshold = isSplit ? splitThreshold * MERGE_RATIO : splitThreshold;
+
+        return m_ScreenSpaceError > threshold;
+    }
+
+    float QuadtreeNode::ComputeScreenSpaceError(const Camera& camera) const
+    {
         float scale = 1.0f / (float)(1 << m_Z);
         glm::vec3 camPos = camera.GetPosition();
 
@@ -152,13 +327,9 @@ namespace Earth
         minDist = std::max(minDist, 0.00001f);
 
         float tileWidth = glm::pi<float>() * 2.0f * scale;
-        float sse = (tileWidth * camera.GetHeight()) / (2.0f * minDist * std::tan(camera.GetFOV() / 2.0f));
-
-        bool isSplit = !m_Children.empty();
-        float threshold = isSplit ? 200.0f : 250.0f;
-
-        return sse > threshold;
+        return (tileWidth * camera.GetHeight()) / (2.0f * minDist * std::tan(camera.GetFOV() / 2.0f));
     }
+
     bool QuadtreeNode::CheckVisibility(const Camera& camera) const
     {
         if (m_Z < 1)
@@ -203,13 +374,30 @@ namespace Earth
         m_Root = std::make_unique<QuadtreeNode>(nullptr, 0, 0, 0, m_SatelliteTileset, m_TerrainTileset);
     }
 
-    void Quadtree::Update(const Camera& camera)
+    void Quadtree::Update(const Camera& camera, float splitThreshold)
     {
-        m_Root->Update(camera);
+        m_Root->Update(camera, splitThreshold);
     }
 
     void Quadtree::Draw(Renderer& renderer, const glm::mat4& viewProjection)
     {
         m_Root->Draw(renderer, viewProjection);
     }
+
+    std::optional<double> Quadtree::Intersect(const Ray& ray) const
+    {
+        std::optional<double> nearest;
+        m_Root->Intersect(ray, nearest);
+        return nearest;
+    }
+
+    float Quadtree::GetElevation(const glm::dvec2& uv) const
+    {
+        return m_Root->GetElevation(uv);
+    }
+
+    bool Quadtree::IsComplete() const
+    {
+        return m_Root->IsComplete();
+    }
 }
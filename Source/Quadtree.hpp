@@ -1,10 +1,12 @@
 #pragma once
 
 #include "Camera.hpp"
+#include "Ray.hpp"
 #include "Renderer.hpp"
 #include "Tileset.hpp"
 
 #include <memory>
+#include <optional>
 #include <vector>
 
 namespace Earth
@@ -15,8 +17,15 @@ namespace Earth
         QuadtreeNode(QuadtreeNode* parent, int x, int y, int z, Tileset& satelliteTileset, Tileset& terrainTileset);
         ~QuadtreeNode();
 
-        void Update(const Camera& camera);
+        // Nodes split while their screen-space error in pixels is above `splitThreshold`.
+        void Update(const Camera& camera, float splitThreshold);
         void Draw(Renderer& renderer, const glm::mat4& viewProjection);
+        // Picking against the surface as Draw shows it, see Quadtree.
+        void Intersect(const Ray& ray, std::optional<double>& nearest) const;
+        // `uv` must lie within this node.
+        float GetElevation(const glm::dvec2& uv) const;
+        // See Quadtree::IsComplete.
+        bool IsComplete() const;
 
         bool IsRenderable() const
         {
@@ -31,7 +40,14 @@ namespace Earth
       private:
         void Split();
         void Merge();
-        bool ShouldSplit(const Camera& camera) const;
+        void TouchTiles(float priority);
+        // Nearest node, starting with this one, whose tile is loaded and can stand in for this one's.
+        const QuadtreeNode* FindSatelliteNode() const;
+        const QuadtreeNode* FindTerrainNode() const;
+        // Part of `ancestor`'s textures this node covers, as (scale, offset) for Renderer::DrawTile.
+        glm::vec4 GetSubRect(const QuadtreeNode& ancestor) const;
+        bool ShouldSplit(float splitThreshold) const;
+        float ComputeScreenSpaceError(const Camera& camera) const;
         bool CheckVisibility(const Camera& camera) const;
 
         QuadtreeNode* m_Parent;
@@ -43,9 +59,13 @@ namespace Earth
         std::shared_ptr<Tile> m_TerrainTile;
         std::vector<std::unique_ptr<QuadtreeNode>> m_Children;
 
+        float m_ScreenSpaceError = 0.0f;
         bool m_IsRenderable = false;
         bool m_IsVisible = true;
         bool m_AllChildrenRenderable = false;
+        // Within the terrain tileset's zoom range and bounds, or below a node that is.
+        bool m_CoversTerrain = false;
+        bool m_InheritsTerrain = false;
     };
 
     class Quadtree
@@ -53,9 +73,21 @@ namespace Earth
       public:
         Quadtree(Tileset& satelliteTileset, Tileset& terrainTileset);
 
-        void Update(const Camera& camera);
+        void Update(const Camera& camera, float splitThreshold);
         void Draw(Renderer& renderer, const glm::mat4& viewProjection);
 
+        // Distance along `ray` to the first point it hits on the visible globe, or nothing if it misses.
+        // Loaded terrain is tested at full resolution through its heightfield, other tiles at sea level.
+        // Costs microseconds, so it is cheap enough for every frame.
+        std::optional<double> Intersect(const Ray& ray) const;
+        // Height in meters of the loaded terrain at a Mercator UV, or 0 where none has loaded. For
+        // keeping the camera out of the ground.
+        float GetElevation(const glm::dvec2& uv) const;
+
+        // Whether the last Update left nothing to wait for: every visible node has split as far as the
+        // threshold asked, and the tiles of the leaves have finished loading, or failed to.
+        bool IsComplete() const;
+
       private:
         Tileset& m_SatelliteTileset;
         Tileset& m_TerrainTileset;
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace Earth
+{
+    // A ray in globe space, where sea level is the unit sphere. Double precision, since a meter is
+    // only about 1.6e-7 units.
+    struct Ray
+    {
+        glm::dvec3 Origin;
+        // Unit length
+        glm::dvec3 Direction;
+    };
+}
@@ -6,54 +6,39 @@ namespace Earth
 {
     Renderer::Renderer() : m_Shader{"Assets/Shaders/Earth.vert.glsl", "Assets/Shaders/Earth.frag.glsl"}
     {
+        // Terrain-RGB encoding of 0 m: -10000 + (1 * 65536 + 134 * 256 + 160) * 0.1
+        const unsigned char seaLevel[4] = {1, 134, 160, 255};
+        glGenTextures(1, &m_FlatElevationTexture);
+        glBindTexture(GL_TEXTURE_2D, m_FlatElevationTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, seaLevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     }
 
     Renderer::~Renderer()
     {
-        if (m_VAO)
-            glDeleteVertexArrays(1, &m_VAO);
-        if (m_VBO)
-            glDeleteBuffers(1, &m_VBO);
-        if (m_EBO)
-            glDeleteBuffers(1, &m_EBO);
+        glDeleteTextures(1, &m_FlatElevationTexture);
     }
 
-    void Renderer::UploadMesh(const Mesh& mesh)
+    void Renderer::SetDefaultMesh(const Mesh& mesh)
     {
-        if (m_VAO == 0)
-            glGenVertexArrays(1, &m_VAO);
-        if (m_VBO == 0)
-            glGenBuffers(1, &m_VBO);
-        if (m_EBO == 0)
-            glGenBuffers(1, &m_EBO);
-
-        glBindVertexArray(m_VAO);
-
-        // VBO
-        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-        glBufferData(GL_ARRAY_BUFFER, mesh.Vertices.size() * sizeof(Vertex), mesh.Vertices.data(), GL_STATIC_DRAW);
-
-        // EBO
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.Indices.size() * sizeof(uint32_t), mesh.Indices.data(),
-                     GL_STATIC_DRAW);
-
-        // Attributes
-        // 0: Position
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
-
-        // 1: UV
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, UV));
-
-        glBindVertexArray(0);
+        m_DefaultMesh = m_MeshPool.Allocate(mesh);
+    }
 
-        m_IndexCount = (GLsizei)mesh.Indices.size();
+    void Renderer::BindFlatElevation(int slot)
+    {
+        glActiveTexture(GL_TEXTURE0 + slot);
+        glBindTexture(GL_TEXTURE_2D, m_FlatElevationTexture);
     }
 
-    void Renderer::DrawTile(const glm::mat4& viewProjection, int x, int y, int z, bool showGrid)
+    void Renderer::DrawTile(const glm::mat4& viewProjection, int x, int y, int z, const MeshPool::Handle* mesh,
+                            const glm::vec4& colorRect, const glm::vec4& elevationRect, bool showGrid)
     {
+        if (!mesh || !mesh->IsValid())
+            mesh = &m_DefaultMesh;
+        if (!mesh->IsValid())
+            return;
+
         m_Shader.Bind();
 
         GLint loc = glGetUniformLocation(m_Shader.GetRendererID(), "u_ViewProjection");
@@ -65,8 +50,11 @@ namespace Earth
         m_Shader.SetBool("u_ShowGrid", showGrid);
         m_Shader.SetInt("u_ColorTexture", 0);
         m_Shader.SetInt("u_ElevationTexture", 1);
+        m_Shader.SetFloat4("u_ColorRect", colorRect);
+        m_Shader.SetFloat4("u_ElevationRect", elevationRect);
 
-        glBindVertexArray(m_VAO);
-        glDrawElements(GL_TRIANGLES, m_IndexCount, GL_UNSIGNED_INT, 0);
+        m_MeshPool.Bind();
+        glDrawElementsBaseVertex(GL_TRIANGLES, mesh->GetIndexCount(), GL_UNSIGNED_SHORT,
+                                 (void*)(mesh->GetFirstIndex() * sizeof(uint16_t)), mesh->GetBaseVertex());
     }
 }
@@ -1,9 +1,11 @@
 #pragma once
 
+#include "GL.hpp"
 #include "Mesh.hpp"
+#include "MeshPool.hpp"
 #include "Shader.hpp"
 
-#include <OpenGL/gl3.h>
+#include <glm/glm.hpp>
 
 namespace Earth
 {
@@ -13,15 +15,31 @@ namespace Earth
         Renderer();
         ~Renderer();
 
-        void UploadMesh(const Mesh& mesh);
+        Renderer(const Renderer&) = delete;
+        Renderer& operator=(const Renderer&) = delete;
 
-        void DrawTile(const glm::mat4& viewProjection, int x, int y, int z, bool showGrid = false);
+        // Sets the mesh drawn for tiles that have no terrain mesh of their own.
+        void SetDefaultMesh(const Mesh& mesh);
+
+        // Binds a 1x1 elevation texture at sea level, for tiles with no terrain at all.
+        void BindFlatElevation(int slot);
+
+        // Draws `mesh`, or the default mesh when it is null. `colorRect` and `elevationRect` are the
+        // parts of the bound textures the tile covers, as (scale.x, scale.y, offset.x, offset.y), for
+        // tiles drawn with an ancestor's textures.
+        void DrawTile(const glm::mat4& viewProjection, int x, int y, int z, const MeshPool::Handle* mesh = nullptr,
+                      const glm::vec4& colorRect = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f),
+                      const glm::vec4& elevationRect = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f), bool showGrid = false);
+
+        MeshPool& GetMeshPool()
+        {
+            return m_MeshPool;
+        }
 
       private:
         Shader m_Shader;
-        GLuint m_VAO = 0;
-        GLuint m_VBO = 0;
-        GLuint m_EBO = 0;
-        GLsizei m_IndexCount = 0;
+        MeshPool m_MeshPool;
+        MeshPool::Handle m_DefaultMesh;
+        GLuint m_FlatElevationTexture = 0;
     };
 }
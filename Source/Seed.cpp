@@ -0,0 +1,525 @@
+#include "MBTiles.hpp"
+#include "Mercator.hpp"
+#include "ThreadPool.hpp"
+#include "TileJSON.hpp"
+#include "TileSource.hpp"
+
+#include <curl/curl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <print>
+#include <semaphore>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::string Source;
+        // Region outline as lon/lat degrees
+        std::vector<glm::dvec2> Polygon;
+        int MinZoom = 0;
+        int MaxZoom = -1;
+        std::string Output;
+        int Concurrency = 16;
+        // Requests in flight per tile host, 0 for no limit beyond Concurrency
+        int PerHost = 0;
+    };
+
+    struct Stats
+    {
+        std::atomic<uint64_t> Downloaded = 0;
+        std::atomic<uint64_t> Skipped = 0;
+        std::atomic<uint64_t> Missing = 0;
+        std::atomic<uint64_t> Failed = 0;
+        std::atomic<uint64_t> Bytes = 0;
+
+        uint64_t GetCompleted() const
+        {
+            return Downloaded + Skipped + Missing + Failed;
+        }
+    };
+
+    std::atomic<bool> s_Interrupted = false;
+
+    void PrintUsage()
+    {
+        std::println(stderr, "Downloads every tile covering a region into a z/x/y directory tree or an MBTiles");
+        std::println(stderr, "archive.");
+        std::println(stderr, "");
+        std::println(stderr, "Usage: earth-seed --source <url template|TileJSON url|archive> --zoom <min>-<max>");
+        std::println(stderr, "                  (--bbox <minLon,minLat,maxLon,maxLat> |");
+        std::println(stderr, "                   --polygon <lon,lat;lon,lat;...>)");
+        std::println(stderr, "                  --output <directory|file.mbtiles> [--concurrency <n>]");
+        std::println(stderr, "                  [--per-host <n>]");
+        std::println(stderr, "");
+        std::println(stderr, "--source takes a .pmtiles or .mbtiles archive, a URL template with {{z}}, {{x}} and");
+        std::println(stderr, "{{y}} placeholders (and optionally {{s}}), or any other URL, which must serve a");
+        std::println(stderr, "TileJSON document.");
+        std::println(stderr, "");
+        std::println(stderr, "Existing tiles in the output are skipped, so an interrupted run can be restarted.");
+    }
+
+    std::vector<double> ParseNumbers(const std::string& text, char separator)
+    {
+        std::vector<double> values;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, separator))
+            values.push_back(std::stod(item));
+        return values;
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc)
+                return false;
+            std::string value = argv[++i];
+
+            if (arg == "--source")
+            {
+                options.Source = value;
+            }
+            else if (arg == "--output")
+            {
+                options.Output = value;
+            }
+            else if (arg == "--concurrency")
+            {
+                options.Concurrency = std::max(1, std::stoi(value));
+            }
+            else if (arg == "--per-host")
+            {
+                options.PerHost = std::max(1, std::stoi(value));
+            }
+            else if (arg == "--zoom")
+            {
+                size_t dash = value.find('-');
+                options.MinZoom = std::stoi(value.substr(0, dash));
+                options.MaxZoom = dash == std::string::npos ? options.MinZoom : std::stoi(value.substr(dash + 1));
+            }
+            else if (arg == "--bbox")
+            {
+                std::vector<double> box = ParseNumbers(value, ',');
+                if (box.size() != 4)
+                    return false;
+                options.Polygon = {{box[0], box[1]}, {box[2], box[1]}, {box[2], box[3]}, {box[0], box[3]}};
+            }
+            else if (arg == "--polygon")
+            {
+                std::stringstream stream(value);
+                std::string point;
+                while (std::getline(stream, point, ';'))
+                {
+                    std::vector<double> lonLat = ParseNumbers(point, ',');
+                    if (lonLat.size() != 2)
+                        return false;
+                    options.Polygon.push_back({lonLat[0], lonLat[1]});
+                }
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        return !options.Source.empty() && !options.Output.empty() && options.Polygon.size() >= 3 &&
+               options.MinZoom >= 0 && options.MaxZoom >= options.MinZoom && options.MaxZoom <= 24;
+    }
+
+    bool PointInPolygon(const std::vector<glm::dvec2>& polygon, const glm::dvec2& p)
+    {
+        bool inside = false;
+        for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+        {
+            const glm::dvec2& a = polygon[i];
+            const glm::dvec2& b = polygon[j];
+            if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x)
+                inside = !inside;
+        }
+        return inside;
+    }
+
+    // Liang-Barsky clip of segment ab against the rectangle.
+    bool SegmentIntersectsRect(const glm::dvec2& a, const glm::dvec2& b, const glm::dvec2& min, const glm::dvec2& max)
+    {
+        glm::dvec2 d = b - a;
+        double t0 = 0.0, t1 = 1.0;
+        const double p[4] = {-d.x, d.x, -d.y, d.y};
+        const double q[4] = {a.x - min.x, max.x - a.x, a.y - min.y, max.y - a.y};
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (p[i] == 0.0)
+            {
+                if (q[i] < 0.0)
+                    return false;
+                continue;
+            }
+
+            double t = q[i] / p[i];
+            if (p[i] < 0.0)
+                t0 = std::max(t0, t);
+            else
+                t1 = std::min(t1, t);
+
+            if (t0 > t1)
+                return false;
+        }
+        return true;
+    }
+
+    bool PolygonIntersectsRect(const std::vector<glm::dvec2>& polygon, const glm::dvec2& min, const glm::dvec2& max)
+    {
+        if (PointInPolygon(polygon, (min + max) * 0.5))
+            return true;
+
+        for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+        {
+            if (SegmentIntersectsRect(polygon[j], polygon[i], min, max))
+                return true;
+        }
+        return false;
+    }
+
+    // Calls `f(x, y)` for every tile at zoom `z` that touches the polygon, given in Mercator UV.
+    template <typename F>
+    void ForEachCoveringTile(const std::vector<glm::dvec2>& polygonUV, int z, F&& f)
+    {
+        glm::dvec2 min(1.0), max(0.0);
+        for (const auto& p : polygonUV)
+        {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+
+        int n = 1 << z;
+        int minX = std::clamp((int)(min.x * n), 0, n - 1);
+        int maxX = std::clamp((int)(max.x * n), 0, n - 1);
+        int minY = std::clamp((int)(min.y * n), 0, n - 1);
+        int maxY = std::clamp((int)(max.y * n), 0, n - 1);
+
+        for (int y = minY; y <= maxY; ++y)
+        {
+            for (int x = minX; x <= maxX; ++x)
+            {
+                glm::dvec2 tileMin = glm::dvec2(x, y) / (double)n;
+                glm::dvec2 tileMax = glm::dvec2(x + 1, y + 1) / (double)n;
+                if (PolygonIntersectsRect(polygonUV, tileMin, tileMax))
+                {
+                    if (!f(x, y))
+                        return;
+                }
+            }
+        }
+    }
+
+    const char* GetExtension(std::span<const unsigned char> data)
+    {
+        if (data.size() >= 12 && std::memcmp(data.data(), "RIFF", 4) == 0 &&
+            std::memcmp(data.data() + 8, "WEBP", 4) == 0)
+            return "webp";
+        if (data.size() >= 8 && std::memcmp(data.data(), "\x89PNG", 4) == 0)
+            return "png";
+        if (data.size() >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF)
+            return "jpg";
+        return "bin";
+    }
+
+    class TileWriter
+    {
+      public:
+        virtual ~TileWriter() = default;
+
+        virtual bool Contains(int x, int y, int z) = 0;
+        virtual void Write(int x, int y, int z, std::span<const unsigned char> data) = 0;
+        virtual void Finish(const Options& options, const char* format) = 0;
+    };
+
+    class DirectoryTileWriter : public TileWriter
+    {
+      public:
+        DirectoryTileWriter(const std::filesystem::path& root) : m_Root(root)
+        {
+        }
+
+        bool Contains(int x, int y, int z) override
+        {
+            for (const char* extension : {"jpg", "png", "webp", "bin"})
+            {
+                if (std::filesystem::exists(GetPath(x, y, z, extension)))
+                    return true;
+            }
+            return false;
+        }
+
+        void Write(int x, int y, int z, std::span<const unsigned char> data) override
+        {
+            std::filesystem::path path = GetPath(x, y, z, GetExtension(data));
+            std::filesystem::create_directories(path.parent_path());
+
+            // Write then rename, so an interrupted run never leaves a truncated tile behind.
+            std::filesystem::path partial = path;
+            partial += ".part";
+            {
+                std::ofstream file(partial, std::ios::binary);
+                file.write(reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size());
+                if (!file)
+                    throw std::runtime_error("Failed to write " + partial.string());
+            }
+            std::filesystem::rename(partial, path);
+        }
+
+        void Finish(const Options&, const char*) override
+        {
+        }
+
+      private:
+        std::filesystem::path GetPath(int x, int y, int z, const char* extension) const
+        {
+            return m_Root / std::to_string(z) / std::to_string(x) / std::format("{}.{}", y, extension);
+        }
+
+        std::filesystem::path m_Root;
+    };
+
+    class MBTilesTileWriter : public TileWriter
+    {
+      public:
+        MBTilesTileWriter(const std::string& path) : m_Writer(path)
+        {
+        }
+
+        bool Contains(int x, int y, int z) override
+        {
+            return m_Writer.Contains(x, y, z);
+        }
+
+        void Write(int x, int y, int z, std::span<const unsigned char> data) override
+        {
+            m_Writer.Write(x, y, z, data);
+        }
+
+        void Finish(const Options& options, const char* format) override
+        {
+            glm::dvec2 min(180.0, 90.0), max(-180.0, -90.0);
+            for (const auto& p : options.Polygon)
+            {
+                min = glm::min(min, p);
+                max = glm::max(max, p);
+            }
+
+            m_Writer.SetMetadata("name", std::filesystem::path(options.Output).stem().string());
+            m_Writer.SetMetadata("format", format);
+            m_Writer.SetMetadata("minzoom", std::to_string(options.MinZoom));
+            m_Writer.SetMetadata("maxzoom", std::to_string(options.MaxZoom));
+            m_Writer.SetMetadata("bounds", std::format("{},{},{},{}", min.x, min.y, max.x, max.y));
+            m_Writer.Flush();
+        }
+
+      private:
+        Earth::MBTilesWriter m_Writer;
+    };
+
+    // Archives go by their extension. URLs with {z}, {x} and {y} placeholders are templates, and any
+    // other URL is taken for a TileJSON document, whatever its path is called.
+    std::shared_ptr<Earth::TileSource> OpenSource(const std::string& source)
+    {
+        if (source.ends_with(".pmtiles") || source.ends_with(".mbtiles"))
+            return Earth::OpenTileArchive(source);
+
+        int placeholders = 0;
+        for (const char* placeholder : {"{z}", "{x}", "{y}"})
+            placeholders += source.find(placeholder) != std::string::npos;
+        if (placeholders == 3)
+            return std::make_shared<Earth::HTTPTileSource>(source);
+        if (placeholders != 0)
+            throw std::runtime_error("URL template needs {z}, {x} and {y}: " + source);
+
+        std::string path = source.substr(0, source.find_first_of("?#"));
+        nlohmann::json tiles;
+        try
+        {
+            tiles = Earth::TileJSON(source).GetJson().value("tiles", nlohmann::json::array());
+        }
+        catch (const nlohmann::json::exception&)
+        {
+            if (path.ends_with(".json"))
+                throw std::runtime_error("Not a TileJSON document: " + source);
+            throw std::runtime_error("Neither a tile URL template, a TileJSON document nor an archive: " + source);
+        }
+        if (tiles.empty())
+            throw std::runtime_error("TileJSON lists no tile URLs");
+
+        std::vector<Earth::URL> urls;
+        for (const auto& tile : tiles)
+            urls.push_back(tile.get<std::string>());
+        return std::make_shared<Earth::HTTPTileSource>(urls);
+    }
+
+    void PrintProgress(const Stats& stats, uint64_t total, double seconds)
+    {
+        uint64_t completed = stats.GetCompleted();
+        double megabytes = stats.Bytes / (1024.0 * 1024.0);
+        std::println("{}/{} tiles ({:.1f}%) | {} downloaded, {} skipped, {} missing, {} failed | {:.1f} tiles/s, "
+                     "{:.2f} MB/s",
+                     completed, total, total ? 100.0 * completed / total : 100.0, stats.Downloaded.load(),
+                     stats.Skipped.load(), stats.Missing.load(), stats.Failed.load(),
+                     seconds > 0.0 ? stats.Downloaded / seconds : 0.0, seconds > 0.0 ? megabytes / seconds : 0.0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    try
+    {
+        if (!ParseOptions(argc, argv, options))
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+    catch (const std::exception&)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    std::signal(SIGINT, [](int) { s_Interrupted = true; });
+
+    int result = 0;
+    try
+    {
+        std::shared_ptr<Earth::TileSource> source = OpenSource(options.Source);
+
+        std::unique_ptr<TileWriter> writer;
+        if (options.Output.ends_with(".mbtiles"))
+            writer = std::make_unique<MBTilesTileWriter>(options.Output);
+        else
+            writer = std::make_unique<DirectoryTileWriter>(options.Output);
+
+        std::vector<glm::dvec2> polygonUV;
+        for (const auto& p : options.Polygon)
+            polygonUV.push_back(Earth::Mercator::LonLatToUV(p.x, p.y));
+
+        uint64_t total = 0;
+        for (int z = options.MinZoom; z <= options.MaxZoom; ++z)
+            ForEachCoveringTile(polygonUV, z, [&](int, int) {
+                total++;
+                return true;
+            });
+        std::println("Seeding {} tiles at zoom {}-{} with {} connections", total, options.MinZoom, options.MaxZoom,
+                     options.Concurrency);
+
+        Stats stats;
+        std::atomic<const char*> format = nullptr;
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+
+        std::atomic<bool> done = false;
+        std::thread reporter([&] {
+            while (!done)
+            {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                if (!done)
+                    PrintProgress(stats, total, elapsed());
+            }
+        });
+
+        {
+            Earth::HTTPTileSource::SetMaxRequestsPerHost(options.PerHost ? options.PerHost : options.Concurrency);
+            Earth::ThreadPool threadPool(options.Concurrency);
+
+            // Bounds how far enumeration runs ahead of the downloads.
+            const int maxQueued = options.Concurrency * 4;
+            std::counting_semaphore<> slots(maxQueued);
+
+            for (int z = options.MinZoom; z <= options.MaxZoom && !s_Interrupted; ++z)
+            {
+                ForEachCoveringTile(polygonUV, z, [&](int x, int y) {
+                    if (s_Interrupted)
+                        return false;
+
+                    slots.acquire();
+                    threadPool.Enqueue([&, x, y, z] {
+                        try
+                        {
+                            if (writer->Contains(x, y, z))
+                            {
+                                stats.Skipped++;
+                            }
+                            else
+                            {
+                                Earth::TileData data = source->Fetch(x, y, z, &s_Interrupted);
+                                if (data.IsEmpty())
+                                {
+                                    stats.Missing++;
+                                }
+                                else
+                                {
+                                    writer->Write(x, y, z, data.GetBytes());
+                                    format = GetExtension(data.GetBytes());
+                                    stats.Downloaded++;
+                                    stats.Bytes += data.GetBytes().size();
+                                }
+                            }
+                        }
+                        catch (const std::exception& e)
+                        {
+                            if (!s_Interrupted)
+                                std::println(stderr, "Tile {}/{}/{} failed: {}", z, x, y, e.what());
+                            stats.Failed++;
+                        }
+                        slots.release();
+                    });
+                    return true;
+                });
+            }
+
+            // Wait for the tasks still in flight.
+            for (int i = 0; i < maxQueued; ++i)
+                slots.acquire();
+        }
+
+        done = true;
+        reporter.join();
+
+        const char* tileFormat = format.load();
+        writer->Finish(options, tileFormat ? tileFormat : "bin");
+
+        PrintProgress(stats, total, elapsed());
+        if (s_Interrupted)
+        {
+            std::println("Interrupted; run the same command again to resume.");
+            result = 130;
+        }
+        else if (stats.Failed > 0)
+        {
+            result = 2;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::println(stderr, "earth-seed: {}", e.what());
+        result = 1;
+    }
+
+    curl_global_cleanup();
+    return result;
+}
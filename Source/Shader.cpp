@@ -98,4 +98,14 @@ namespace Earth
     {
         glUniform1i(glGetUniformLocation(m_RendererID, name.c_str()), value);
     }
+
+    void Shader::SetFloat2(const std::string& name, const glm::vec2& value) const
+    {
+        glUniform2f(glGetUniformLocation(m_RendererID, name.c_str()), value.x, value.y);
+    }
+
+    void Shader::SetFloat4(const std::string& name, const glm::vec4& value) const
+    {
+        glUniform4f(glGetUniformLocation(m_RendererID, name.c_str()), value.x, value.y, value.z, value.w);
+    }
 }
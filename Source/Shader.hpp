@@ -1,6 +1,8 @@
 #pragma once
 
-#include <OpenGL/gl3.h>
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
 
 #include <string>
 
@@ -18,6 +20,8 @@ namespace Earth
 
         void SetBool(const std::string& name, bool value) const;
         void SetInt(const std::string& name, int value) const;
+        void SetFloat2(const std::string& name, const glm::vec2& value) const;
+        void SetFloat4(const std::string& name, const glm::vec4& value) const;
 
         GLuint GetRendererID() const
         {
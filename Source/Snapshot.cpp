@@ -0,0 +1,576 @@
+#include "Camera.hpp"
+#include "Framebuffer.hpp"
+#include "GL.hpp"
+#include "Heightfield.hpp"
+#include "LODGovernor.hpp"
+#include "Logger.hpp"
+#include "MemoryBudget.hpp"
+#include "Mercator.hpp"
+#include "Quadtree.hpp"
+#include "Renderer.hpp"
+#include "ThreadPool.hpp"
+#include "TileJSON.hpp"
+#include "TileSource.hpp"
+#include "Tileset.hpp"
+#include "UploadScheduler.hpp"
+#include "VertexCache.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <curl/curl.h>
+
+#include <SDL3/SDL_hints.h>
+#include <SDL3/SDL_init.h>
+#include <SDL3/SDL_video.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <print>
+#include <semaphore>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Pose
+    {
+        float Lon = 0.0f;
+        float Lat = 0.0f;
+        // Meters from the camera to the point it looks at
+        float Range = 1.0e7f;
+        float Heading = 0.0f;
+        float Tilt = 0.0f;
+        std::string Name;
+    };
+
+    struct Options
+    {
+        std::string Poses;
+        std::string Satellite;
+        std::string Terrain;
+        std::string Output;
+        int Width = 1280;
+        int Height = 720;
+        float SplitThreshold = Earth::LODGovernor::DEFAULT_THRESHOLD;
+        int Views = 8;
+        float TimeoutSeconds = 60.0f;
+    };
+
+    // One snapshot on its way through the pipeline: its quadtree loads tiles until it reaches the
+    // target LOD, then it is drawn and its pixels are copied into a pixel buffer behind a fence.
+    struct View
+    {
+        Pose Target;
+        Earth::Camera Camera;
+        std::unique_ptr<Earth::Quadtree> Quadtree;
+        std::chrono::steady_clock::time_point Start;
+        bool TimedOut = false;
+        GLuint PixelBuffer = 0;
+        GLsync Fence = nullptr;
+    };
+
+    // Released by the workers after each task, so the loop sleeps until a tile or image is done.
+    std::binary_semaphore s_WorkDone(0);
+
+    void PrintUsage()
+    {
+        std::println(stderr, "Renders snapshots of the globe from a list of camera poses, without a window.");
+        std::println(stderr, "");
+        std::println(stderr, "Usage: earth-snapshot --poses <file> --satellite <source> --terrain <source>");
+        std::println(stderr, "                      --output <directory> [--size <width>x<height>]");
+        std::println(stderr, "                      [--threshold <pixels>] [--views <n>] [--timeout <seconds>]");
+        std::println(stderr, "");
+        std::println(stderr, "Sources are archives, tiles.json URLs or {{z}}/{{x}}/{{y}} URL templates, as for");
+        std::println(stderr, "earth-seed. Each line of the poses file is");
+        std::println(stderr, "    lon,lat,range,heading,tilt[,name]");
+        std::println(stderr, "with degrees for angles and meters for the range. Images are written as PNGs, named");
+        std::println(stderr, "after the pose or numbered in order.");
+    }
+
+    std::vector<double> ParseNumbers(const std::string& text, char separator)
+    {
+        std::vector<double> values;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, separator))
+            values.push_back(std::stod(item));
+        return values;
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc)
+                return false;
+            std::string value = argv[++i];
+
+            if (arg == "--poses")
+            {
+                options.Poses = value;
+            }
+            else if (arg == "--satellite")
+            {
+                options.Satellite = value;
+            }
+            else if (arg == "--terrain")
+            {
+                options.Terrain = value;
+            }
+            else if (arg == "--output")
+            {
+                options.Output = value;
+            }
+            else if (arg == "--size")
+            {
+                std::vector<double> size = ParseNumbers(value, 'x');
+                if (size.size() != 2)
+                    return false;
+                options.Width = (int)size[0];
+                options.Height = (int)size[1];
+            }
+            else if (arg == "--threshold")
+            {
+                options.SplitThreshold = std::stof(value);
+            }
+            else if (arg == "--views")
+            {
+                options.Views = std::max(1, std::stoi(value));
+            }
+            else if (arg == "--timeout")
+            {
+                options.TimeoutSeconds = std::stof(value);
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        return !options.Poses.empty() && !options.Satellite.empty() && !options.Terrain.empty() &&
+               !options.Output.empty() && options.Width > 0 && options.Height > 0 && options.SplitThreshold > 0.0f;
+    }
+
+    std::vector<Pose> ReadPoses(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+            throw std::runtime_error("Failed to open " + path);
+
+        std::vector<Pose> poses;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::stringstream stream(line);
+            std::vector<std::string> fields;
+            std::string field;
+            while (std::getline(stream, field, ','))
+                fields.push_back(field);
+            if (fields.size() < 5)
+                throw std::runtime_error(std::format("Pose needs lon,lat,range,heading,tilt: {}", line));
+
+            Pose pose;
+            pose.Lon = std::stof(fields[0]);
+            pose.Lat = std::stof(fields[1]);
+            pose.Range = std::stof(fields[2]);
+            pose.Heading = std::stof(fields[3]);
+            pose.Tilt = std::stof(fields[4]);
+            pose.Name = fields.size() > 5 ? fields[5] : std::format("snapshot-{:04}", poses.size());
+            poses.push_back(pose);
+        }
+        return poses;
+    }
+
+    std::shared_ptr<Earth::TileSource> OpenSource(const std::string& source)
+    {
+        if (source.ends_with(".pmtiles") || source.ends_with(".mbtiles"))
+            return Earth::OpenTileArchive(source);
+
+        if (source.find("tiles.json") != std::string::npos)
+        {
+            Earth::TileJSON tileJSON(source);
+            auto tiles = tileJSON.GetJson()["tiles"];
+            if (tiles.empty())
+                throw std::runtime_error("TileJSON lists no tile URLs");
+
+            std::vector<Earth::URL> urls;
+            for (const auto& tile : tiles)
+                urls.push_back(tile.get<std::string>());
+            auto httpSource = std::make_shared<Earth::HTTPTileSource>(urls);
+            httpSource->SetZoomRange(tileJSON.GetMinZoom(), tileJSON.GetMaxZoom());
+            httpSource->SetBounds(tileJSON.GetBounds());
+            return httpSource;
+        }
+
+        return std::make_shared<Earth::HTTPTileSource>(source);
+    }
+
+    // Without a display SDL's default video drivers fail, but the offscreen one can still create a GL
+    // context through EGL.
+    bool InitVideo()
+    {
+        if (SDL_InitSubSystem(SDL_INIT_VIDEO))
+            return true;
+
+        std::println(stderr, "No display ({}), trying the offscreen video driver", SDL_GetError());
+        SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+        return SDL_InitSubSystem(SDL_INIT_VIDEO);
+    }
+
+    class SnapshotPipeline
+    {
+      public:
+        SnapshotPipeline(const Options& options, std::vector<Pose> poses, Earth::Tileset& satellite,
+                         Earth::Tileset& terrain, Earth::Renderer& renderer, Earth::UploadScheduler& uploadScheduler,
+                         Earth::MemoryBudget& memoryBudget, Earth::ThreadPool& threadPool)
+            : m_Options(options), m_Queued(poses.begin(), poses.end()), m_Total(poses.size()),
+              m_SatelliteTileset(satellite), m_TerrainTileset(terrain), m_Renderer(renderer),
+              m_UploadScheduler(uploadScheduler), m_MemoryBudget(memoryBudget), m_ThreadPool(threadPool),
+              m_Framebuffer(options.Width, options.Height)
+        {
+        }
+
+        ~SnapshotPipeline()
+        {
+            for (const auto& view : m_Reading)
+            {
+                glDeleteSync(view->Fence);
+                m_FreeBuffers.push_back(view->PixelBuffer);
+            }
+            for (const auto& view : m_Loading)
+            {
+                if (view->PixelBuffer)
+                    m_FreeBuffers.push_back(view->PixelBuffer);
+            }
+            if (!m_FreeBuffers.empty())
+                glDeleteBuffers((GLsizei)m_FreeBuffers.size(), m_FreeBuffers.data());
+        }
+
+        // Moves every view in flight as far along as it can go. Returns false once all snapshots have
+        // been handed to the workers for writing.
+        bool Step()
+        {
+            m_SatelliteTileset.Update();
+            m_TerrainTileset.Update();
+            m_UploadScheduler.BeginFrame();
+
+            while (m_Loading.size() + m_Reading.size() < (size_t)m_Options.Views && !m_Queued.empty())
+            {
+                Start(m_Queued.front());
+                m_Queued.pop_front();
+            }
+
+            // All views select their tiles before the budget is trimmed and the uploads go out, so the
+            // tilesets see every view's priorities at once.
+            for (const auto& view : m_Loading)
+                view->Quadtree->Update(view->Camera, m_Options.SplitThreshold);
+            m_MemoryBudget.Trim();
+            m_UploadScheduler.Flush();
+
+            bool progressed = false;
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = m_Loading.begin(); it != m_Loading.end();)
+            {
+                View& view = **it;
+                view.TimedOut = now - view.Start > std::chrono::duration<float>(m_Options.TimeoutSeconds);
+                if (!view.Quadtree->IsComplete() && !view.TimedOut)
+                {
+                    ++it;
+                    continue;
+                }
+
+                Render(view);
+                m_Reading.push_back(std::move(*it));
+                it = m_Loading.erase(it);
+                progressed = true;
+            }
+            // Makes sure the reads are submitted, so the fences can signal while the loop sleeps.
+            if (progressed)
+                glFlush();
+
+            for (auto it = m_Reading.begin(); it != m_Reading.end();)
+            {
+                GLenum status = glClientWaitSync((*it)->Fence, 0, 0);
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                {
+                    ++it;
+                    continue;
+                }
+
+                Write(**it);
+                it = m_Reading.erase(it);
+                progressed = true;
+            }
+
+            if (m_Queued.empty() && m_Loading.empty() && m_Reading.empty())
+                return false;
+
+            // Reads still in flight are polled again shortly. Otherwise only a worker finishing a tile
+            // can move things along.
+            if (!progressed && m_UploadScheduler.GetDeferred() == 0)
+                s_WorkDone.try_acquire_for(m_Reading.empty() ? std::chrono::milliseconds(100)
+                                                             : std::chrono::milliseconds(1));
+            return true;
+        }
+
+        // Waits for the images handed to the workers to be written.
+        void Finish()
+        {
+            for (auto& write : m_Writes)
+                write.get();
+            m_Writes.clear();
+        }
+
+        size_t GetTotal() const
+        {
+            return m_Total;
+        }
+        size_t GetCompleted() const
+        {
+            return m_Completed;
+        }
+        size_t GetInFlight() const
+        {
+            return m_Loading.size() + m_Reading.size();
+        }
+        size_t GetTimedOut() const
+        {
+            return m_TimedOut;
+        }
+
+      private:
+        void Start(const Pose& pose)
+        {
+            auto view = std::make_unique<View>(View{
+                .Target = pose,
+                .Camera = Earth::Camera((float)m_Options.Width, (float)m_Options.Height),
+                .Quadtree = std::make_unique<Earth::Quadtree>(m_SatelliteTileset, m_TerrainTileset),
+                .Start = std::chrono::steady_clock::now(),
+            });
+            view->Camera.SetOrbit(glm::radians(pose.Lon), glm::radians(pose.Lat),
+                                  pose.Range / (float)Earth::Heightfield::EARTH_RADIUS, glm::radians(pose.Heading),
+                                  glm::radians(pose.Tilt));
+            m_Loading.push_back(std::move(view));
+        }
+
+        void Render(View& view)
+        {
+            m_Framebuffer.Bind();
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            glm::mat4 projection = view.Camera.GetProjectionMatrix();
+            glm::mat4 viewMatrix = view.Camera.GetViewMatrix();
+            view.Quadtree->Draw(m_Renderer, projection * viewMatrix);
+
+            size_t size = GetImageSize();
+            if (m_FreeBuffers.empty())
+            {
+                glGenBuffers(1, &view.PixelBuffer);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, view.PixelBuffer);
+                glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)size, nullptr, GL_STREAM_READ);
+            }
+            else
+            {
+                view.PixelBuffer = m_FreeBuffers.back();
+                m_FreeBuffers.pop_back();
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, view.PixelBuffer);
+            }
+
+            // Returns at once: the copy lands in the buffer whenever the GPU gets to it.
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, m_Options.Width, m_Options.Height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            view.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            m_Framebuffer.Unbind();
+
+            // Tiles that views still loading share stay resident through them.
+            view.Quadtree.reset();
+            if (view.TimedOut)
+            {
+                m_TimedOut++;
+                std::println(stderr, "{} timed out before reaching the target LOD", view.Target.Name);
+            }
+        }
+
+        void Write(View& view)
+        {
+            glDeleteSync(view.Fence);
+            view.Fence = nullptr;
+
+            size_t size = GetImageSize();
+            std::vector<unsigned char> pixels(size);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, view.PixelBuffer);
+            if (void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)size, GL_MAP_READ_BIT))
+            {
+                std::memcpy(pixels.data(), mapped, size);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            m_FreeBuffers.push_back(view.PixelBuffer);
+
+            std::filesystem::path path = std::filesystem::path(m_Options.Output) / (view.Target.Name + ".png");
+            int width = m_Options.Width;
+            int height = m_Options.Height;
+            m_Writes.push_back(m_ThreadPool.Enqueue([path, width, height, pixels = std::move(pixels)] {
+                if (!stbi_write_png(path.string().c_str(), width, height, 3, pixels.data(), width * 3))
+                    std::println(stderr, "Failed to write {}", path.string());
+            }));
+            m_Completed++;
+        }
+
+        size_t GetImageSize() const
+        {
+            return (size_t)m_Options.Width * m_Options.Height * 3;
+        }
+
+        const Options& m_Options;
+        std::deque<Pose> m_Queued;
+        size_t m_Total;
+        Earth::Tileset& m_SatelliteTileset;
+        Earth::Tileset& m_TerrainTileset;
+        Earth::Renderer& m_Renderer;
+        Earth::UploadScheduler& m_UploadScheduler;
+        Earth::MemoryBudget& m_MemoryBudget;
+        Earth::ThreadPool& m_ThreadPool;
+        // Views are drawn one at a time, so they share a framebuffer. The pixel buffers hold the
+        // copies until they are read.
+        Earth::Framebuffer m_Framebuffer;
+        std::vector<GLuint> m_FreeBuffers;
+
+        std::vector<std::unique_ptr<View>> m_Loading;
+        std::vector<std::unique_ptr<View>> m_Reading;
+        std::vector<std::future<void>> m_Writes;
+        size_t m_Completed = 0;
+        size_t m_TimedOut = 0;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::vector<Pose> poses;
+    try
+    {
+        if (!ParseOptions(argc, argv, options))
+        {
+            PrintUsage();
+            return 1;
+        }
+        poses = ReadPoses(options.Poses);
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::println(stderr, "{}", e.what());
+        return 1;
+    }
+    catch (const std::exception&)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    if (!InitVideo())
+    {
+        std::println(stderr, "Failed to initialize SDL video: {}", SDL_GetError());
+        return 1;
+    }
+
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+    // Never shown; it only carries the GL context.
+    SDL_Window* window = SDL_CreateWindow("Earth Snapshot", 64, 64, SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL);
+    SDL_GLContext context = window ? SDL_GL_CreateContext(window) : nullptr;
+    if (!context)
+    {
+        std::println(stderr, "Failed to create an OpenGL context: {}", SDL_GetError());
+        return 1;
+    }
+    std::println("Rendering {} snapshots at {}x{} on {}", poses.size(), options.Width, options.Height,
+                 (const char*)glGetString(GL_RENDERER));
+
+    int result = 0;
+    try
+    {
+        std::filesystem::create_directories(options.Output);
+        // glReadPixels returns the bottom row first, and PNG starts at the top.
+        stbi_flip_vertically_on_write(1);
+
+        std::shared_ptr<Earth::TileSource> satelliteSource = OpenSource(options.Satellite);
+        std::shared_ptr<Earth::TileSource> terrainSource = OpenSource(options.Terrain);
+
+        // Declared in the order they must outlive each other, as in the viewer: tiles cancel their
+        // loads on the workers, and the workers may still hold allocations from the budget.
+        Earth::MemoryBudget memoryBudget;
+        Earth::ThreadPool threadPool(std::thread::hardware_concurrency(), [] { s_WorkDone.release(); });
+        Earth::UploadScheduler uploadScheduler;
+        // Nothing to keep interactive, so uploads may take most of each step.
+        uploadScheduler.SetBudget(16.0f);
+        Earth::Renderer renderer;
+        Earth::Mesh planeMesh = Earth::Mercator::GeneratePlaneMesh(64);
+        Earth::VertexCache::Optimize(planeMesh.Indices, planeMesh.Vertices.size());
+        renderer.SetDefaultMesh(planeMesh);
+
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+
+        Earth::TileOptions satelliteOptions;
+        satelliteOptions.GenerateMipmaps = true;
+        satelliteOptions.Compress = true;
+        Earth::Tileset satelliteTileset(satelliteSource, threadPool, uploadScheduler, memoryBudget, satelliteOptions);
+
+        Earth::TileOptions terrainOptions;
+        terrainOptions.Meshes = &renderer.GetMeshPool();
+        Earth::Tileset terrainTileset(terrainSource, threadPool, uploadScheduler, memoryBudget, terrainOptions);
+
+        SnapshotPipeline pipeline(options, std::move(poses), satelliteTileset, terrainTileset, renderer,
+                                  uploadScheduler, memoryBudget, threadPool);
+
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+        double lastReport = 0.0;
+        while (pipeline.Step())
+        {
+            if (elapsed() - lastReport >= 1.0)
+            {
+                lastReport = elapsed();
+                std::println("{}/{} snapshots | {} in flight | {:.2f} snapshots/s", pipeline.GetCompleted(),
+                             pipeline.GetTotal(), pipeline.GetInFlight(), pipeline.GetCompleted() / lastReport);
+            }
+        }
+        pipeline.Finish();
+
+        double seconds = elapsed();
+        std::println("Wrote {} snapshots in {:.1f} s ({:.2f} snapshots/s), {} timed out", pipeline.GetCompleted(),
+                     seconds, seconds > 0.0 ? pipeline.GetCompleted() / seconds : 0.0, pipeline.GetTimedOut());
+    }
+    catch (const std::exception& e)
+    {
+        std::println(stderr, "{}", e.what());
+        result = 1;
+    }
+
+    SDL_GL_DestroyContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    curl_global_cleanup();
+    Earth::Logger::Shutdown();
+    return result;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+
+namespace Earth
+{
+    // Return type for fire-and-forget coroutines, such as ones awaiting Tileset::LoadTileAsync. The
+    // coroutine starts right away and frees itself when it finishes. An exception escaping it
+    // terminates, as it would from a thread.
+    struct DetachedTask
+    {
+        struct promise_type
+        {
+            DetachedTask get_return_object() noexcept
+            {
+                return {};
+            }
+            std::suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+            std::suspend_never final_suspend() noexcept
+            {
+                return {};
+            }
+            void return_void() noexcept
+            {
+            }
+            void unhandled_exception() noexcept
+            {
+                std::terminate();
+            }
+        };
+    };
+}
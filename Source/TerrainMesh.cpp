@@ -0,0 +1,253 @@
+#include "TerrainMesh.hpp"
+#include "VertexCache.hpp"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+namespace Earth::TerrainMesh
+{
+    namespace
+    {
+        constexpr int TILE_SIZE = GRID_SIZE - 1;
+        constexpr int TRIANGLE_COUNT = TILE_SIZE * TILE_SIZE * 2 - 2;
+        constexpr int PARENT_TRIANGLE_COUNT = TRIANGLE_COUNT - TILE_SIZE * TILE_SIZE;
+
+        constexpr double EARTH_CIRCUMFERENCE = 40075016.686;
+
+        // The two corners of every triangle's hypotenuse, indexed in implicit binary tree order.
+        // The third corner follows from the first two.
+        const std::vector<uint16_t>& GetCoords()
+        {
+            static const std::vector<uint16_t> s_Coords = []() {
+                std::vector<uint16_t> coords(TRIANGLE_COUNT * 4);
+                for (int i = 0; i < TRIANGLE_COUNT; ++i)
+                {
+                    int id = i + 2;
+                    int ax = 0, ay = 0, bx = 0, by = 0, cx = 0, cy = 0;
+                    if (id & 1)
+                    {
+                        bx = by = cx = TILE_SIZE;
+                    }
+                    else
+                    {
+                        ax = ay = cy = TILE_SIZE;
+                    }
+
+                    while ((id >>= 1) > 1)
+                    {
+                        int mx = (ax + bx) >> 1;
+                        int my = (ay + by) >> 1;
+
+                        if (id & 1)
+                        {
+                            bx = ax;
+                            by = ay;
+                            ax = cx;
+                            ay = cy;
+                        }
+                        else
+                        {
+                            ax = bx;
+                            ay = by;
+                            bx = cx;
+                            by = cy;
+                        }
+                        cx = mx;
+                        cy = my;
+                    }
+
+                    coords[i * 4 + 0] = (uint16_t)ax;
+                    coords[i * 4 + 1] = (uint16_t)ay;
+                    coords[i * 4 + 2] = (uint16_t)bx;
+                    coords[i * 4 + 3] = (uint16_t)by;
+                }
+                return coords;
+            }();
+            return s_Coords;
+        }
+
+        // The largest error of any vertex that splitting at each grid point would bring in.
+        std::vector<float> ComputeErrors(const std::vector<float>& heights)
+        {
+            const std::vector<uint16_t>& coords = GetCoords();
+            std::vector<float> errors(GRID_SIZE * GRID_SIZE, 0.0f);
+
+            // Children come after their parents, so walking backwards visits the leaves first.
+            for (int i = TRIANGLE_COUNT - 1; i >= 0; --i)
+            {
+                int ax = coords[i * 4 + 0];
+                int ay = coords[i * 4 + 1];
+                int bx = coords[i * 4 + 2];
+                int by = coords[i * 4 + 3];
+                int mx = (ax + bx) >> 1;
+                int my = (ay + by) >> 1;
+                int cx = mx + my - ay;
+                int cy = my + ax - mx;
+
+                float interpolated = (heights[ay * GRID_SIZE + ax] + heights[by * GRID_SIZE + bx]) * 0.5f;
+                int middle = my * GRID_SIZE + mx;
+                errors[middle] = std::max(errors[middle], std::abs(interpolated - heights[middle]));
+
+                if (i < PARENT_TRIANGLE_COUNT)
+                {
+                    int left = ((ay + cy) >> 1) * GRID_SIZE + ((ax + cx) >> 1);
+                    int right = ((by + cy) >> 1) * GRID_SIZE + ((bx + cx) >> 1);
+                    errors[middle] = std::max({errors[middle], errors[left], errors[right]});
+                }
+            }
+            return errors;
+        }
+
+        class Builder
+        {
+          public:
+            Builder(const std::vector<float>& errors, float maxError)
+                : m_Errors(errors), m_MaxError(maxError), m_VertexIndices(GRID_SIZE * GRID_SIZE, 0)
+            {
+            }
+
+            // Returns false if the mesh needs more vertices than 16-bit indices can address.
+            bool Build(Mesh& mesh)
+            {
+                Traverse(0, 0, TILE_SIZE, TILE_SIZE, TILE_SIZE, 0);
+                Traverse(TILE_SIZE, TILE_SIZE, 0, 0, 0, TILE_SIZE);
+                AddSkirts();
+
+                if (m_Vertices.size() > Mesh::MAX_VERTICES)
+                    return false;
+
+                mesh.Vertices = std::move(m_Vertices);
+                mesh.Indices.assign(m_Indices.begin(), m_Indices.end());
+                return true;
+            }
+
+          private:
+            void Traverse(int ax, int ay, int bx, int by, int cx, int cy)
+            {
+                int mx = (ax + bx) >> 1;
+                int my = (ay + by) >> 1;
+
+                if (std::abs(ax - cx) + std::abs(ay - cy) > 1 && m_Errors[my * GRID_SIZE + mx] > m_MaxError)
+                {
+                    Traverse(cx, cy, ax, ay, mx, my);
+                    Traverse(bx, by, cx, cy, mx, my);
+                    return;
+                }
+
+                uint32_t a = GetVertex(ax, ay);
+                uint32_t b = GetVertex(bx, by);
+                uint32_t c = GetVertex(cx, cy);
+                m_Indices.insert(m_Indices.end(), {a, b, c});
+            }
+
+            uint32_t GetVertex(int x, int y)
+            {
+                uint32_t& index = m_VertexIndices[y * GRID_SIZE + x];
+                if (index == 0)
+                {
+                    m_Vertices.push_back(Vertex::FromUV((float)x / TILE_SIZE, (float)y / TILE_SIZE));
+                    index = (uint32_t)m_Vertices.size();
+                }
+                return index - 1;
+            }
+
+            // Hangs a strip below every edge that lies on the tile border. The strip faces outward, like
+            // the triangle of a neighbouring tile folded down along the shared edge.
+            void AddSkirts()
+            {
+                std::vector<uint32_t> skirtIndices(m_Vertices.size(), UINT32_MAX);
+                auto getSkirtVertex = [&](uint32_t index) {
+                    if (skirtIndices[index] == UINT32_MAX)
+                    {
+                        Vertex vertex = m_Vertices[index];
+                        vertex.Skirt = 1;
+                        skirtIndices[index] = (uint32_t)m_Vertices.size();
+                        m_Vertices.push_back(vertex);
+                    }
+                    return skirtIndices[index];
+                };
+                auto isBorderEdge = [&](uint32_t i, uint32_t j) {
+                    constexpr uint16_t edge = (uint16_t)Vertex::UV_SCALE;
+                    const Vertex& a = m_Vertices[i];
+                    const Vertex& b = m_Vertices[j];
+                    return (a.U == b.U && (a.U == 0 || a.U == edge)) || (a.V == b.V && (a.V == 0 || a.V == edge));
+                };
+
+                size_t triangleIndexCount = m_Indices.size();
+                for (size_t t = 0; t < triangleIndexCount; t += 3)
+                {
+                    for (int e = 0; e < 3; ++e)
+                    {
+                        uint32_t i = m_Indices[t + e];
+                        uint32_t j = m_Indices[t + (e + 1) % 3];
+                        if (!isBorderEdge(i, j))
+                            continue;
+
+                        uint32_t skirtI = getSkirtVertex(i);
+                        uint32_t skirtJ = getSkirtVertex(j);
+                        m_Indices.insert(m_Indices.end(), {j, i, skirtI, j, skirtI, skirtJ});
+                    }
+                }
+            }
+
+            const std::vector<float>& m_Errors;
+            float m_MaxError;
+            std::vector<uint32_t> m_VertexIndices;
+            std::vector<Vertex> m_Vertices;
+            std::vector<uint32_t> m_Indices;
+        };
+    }
+
+    std::vector<float> DecodeHeights(const Image& image)
+    {
+        int width = image.GetWidth();
+        int height = image.GetHeight();
+        int channels = image.GetChannels();
+        if (width <= 0 || height <= 0 || channels < 3)
+            throw std::runtime_error("Terrain tile is not an RGB image");
+
+        std::vector<float> heights(GRID_SIZE * GRID_SIZE);
+        const unsigned char* data = image.GetData();
+        for (int gy = 0; gy < GRID_SIZE; ++gy)
+        {
+            int y = std::min(gy * height / TILE_SIZE, height - 1);
+            for (int gx = 0; gx < GRID_SIZE; ++gx)
+            {
+                int x = std::min(gx * width / TILE_SIZE, width - 1);
+                const unsigned char* texel = data + ((size_t)y * width + x) * channels;
+                heights[gy * GRID_SIZE + gx] = -10000.0f + (texel[0] * 65536.0f + texel[1] * 256.0f + texel[2]) * 0.1f;
+            }
+        }
+        return heights;
+    }
+
+    float GetMaxError(int y, int z, float pixels)
+    {
+        // Mercator texels shrink towards the poles by the cosine of the latitude.
+        double n = glm::pi<double>() * (1.0 - 2.0 * (y + 0.5) / (double)(1 << z));
+        double latitude = std::atan(std::sinh(n));
+        double texelSize = EARTH_CIRCUMFERENCE / (TILE_SIZE * (double)(1 << z)) * std::cos(latitude);
+        return (float)(pixels * texelSize);
+    }
+
+    Mesh Build(const std::vector<float>& heights, float maxError)
+    {
+        if (heights.size() != GRID_SIZE * GRID_SIZE)
+            throw std::runtime_error("Heightfield does not match the terrain grid size");
+
+        std::vector<float> errors = ComputeErrors(heights);
+
+        // Very rough tiles at a tight threshold can exceed 16-bit indices; coarsen until they fit.
+        Mesh mesh;
+        while (!Builder(errors, maxError).Build(mesh))
+            maxError = std::max(maxError * 2.0f, 0.1f);
+
+        VertexCache::Optimize(mesh.Indices, mesh.Vertices.size());
+        return mesh;
+    }
+}
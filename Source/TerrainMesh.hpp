@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Image.hpp"
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace Earth::TerrainMesh
+{
+    // Heights are sampled on a (2^n + 1)^2 grid so the tile splits into right isosceles triangles
+    // down to single texels.
+    constexpr int GRID_SIZE = 257;
+
+    // Decodes a Terrain-RGB image to GRID_SIZE^2 heights in meters. The last row and column repeat
+    // the image's edge texels.
+    std::vector<float> DecodeHeights(const Image& image);
+
+    // Height error in meters that covers `pixels` texels of tile `y` at zoom `z`. Tiles split once a
+    // texel is about a pixel on screen, so this keeps the mesh error near `pixels` on screen.
+    float GetMaxError(int y, int z, float pixels);
+
+    // Builds a right-triangulated irregular network (RTIN) that approximates the heightfield to
+    // within `maxError` meters, with skirts along the tile edges to hide cracks between tiles of
+    // different detail. Triangles are ordered for the post-transform vertex cache.
+    Mesh Build(const std::vector<float>& heights, float maxError);
+}
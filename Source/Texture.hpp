@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Earth
+{
+    enum class TextureFormat
+    {
+        RGB8,
+        RGBA8,
+        // 4x4 blocks of 8 bytes (DXT1), alpha ignored
+        BC1,
+    };
+
+    struct TextureLevel
+    {
+        int Width = 0;
+        int Height = 0;
+        std::vector<unsigned char> Data;
+    };
+
+    // CPU-side texture ready for upload: level 0 followed by any precomputed mip levels.
+    struct TextureData
+    {
+        TextureFormat Format = TextureFormat::RGBA8;
+        std::vector<TextureLevel> Levels;
+
+        bool IsValid() const
+        {
+            return !Levels.empty();
+        }
+
+        bool IsCompressed() const
+        {
+            return Format == TextureFormat::BC1;
+        }
+
+        size_t GetSize() const
+        {
+            size_t size = 0;
+            for (const auto& level : Levels)
+                size += level.Data.size();
+            return size;
+        }
+    };
+}
@@ -0,0 +1,89 @@
+#include "TextureCompression.hpp"
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Earth::TextureCompression
+{
+    namespace
+    {
+        constexpr int BC1_BLOCK_SIZE = 8;
+
+        std::vector<unsigned char> ToRGBA(const unsigned char* pixels, int width, int height, int channels)
+        {
+            std::vector<unsigned char> rgba((size_t)width * height * 4);
+            for (size_t i = 0; i < (size_t)width * height; ++i)
+            {
+                const unsigned char* src = pixels + i * channels;
+                unsigned char* dst = rgba.data() + i * 4;
+                dst[0] = src[0];
+                dst[1] = channels > 1 ? src[1] : src[0];
+                dst[2] = channels > 2 ? src[2] : src[0];
+                dst[3] = channels > 3 ? src[3] : 255;
+            }
+            return rgba;
+        }
+    }
+
+    size_t GetBC1Size(int width, int height)
+    {
+        return (size_t)std::max(1, (width + 3) / 4) * std::max(1, (height + 3) / 4) * BC1_BLOCK_SIZE;
+    }
+
+    std::vector<unsigned char> EncodeBC1(const unsigned char* pixels, int width, int height, int channels)
+    {
+        std::vector<unsigned char> rgba;
+        if (channels != 4)
+        {
+            rgba = ToRGBA(pixels, width, height, channels);
+            pixels = rgba.data();
+        }
+
+        int blocksX = std::max(1, (width + 3) / 4);
+        int blocksY = std::max(1, (height + 3) / 4);
+        std::vector<unsigned char> blocks(GetBC1Size(width, height));
+
+        unsigned char block[4 * 4 * 4];
+        for (int by = 0; by < blocksY; ++by)
+        {
+            for (int bx = 0; bx < blocksX; ++bx)
+            {
+                // Gather the 4x4 block, repeating edge pixels for levels smaller than a block.
+                for (int y = 0; y < 4; ++y)
+                {
+                    int sy = std::min(by * 4 + y, height - 1);
+                    for (int x = 0; x < 4; ++x)
+                    {
+                        int sx = std::min(bx * 4 + x, width - 1);
+                        const unsigned char* src = pixels + ((size_t)sy * width + sx) * 4;
+                        std::copy(src, src + 4, block + (y * 4 + x) * 4);
+                    }
+                }
+
+                unsigned char* dst = blocks.data() + ((size_t)by * blocksX + bx) * BC1_BLOCK_SIZE;
+                stb_compress_dxt_block(dst, block, 0, STB_DXT_HIGHQUAL);
+            }
+        }
+
+        return blocks;
+    }
+
+    TextureData CompressBC1(const TextureData& source)
+    {
+        if (!source.IsValid() || source.IsCompressed())
+            throw std::runtime_error("Cannot compress an empty or already compressed texture");
+
+        int channels = source.Format == TextureFormat::RGBA8 ? 4 : 3;
+
+        TextureData texture;
+        texture.Format = TextureFormat::BC1;
+        for (const auto& level : source.Levels)
+            texture.Levels.push_back(
+                {level.Width, level.Height, EncodeBC1(level.Data.data(), level.Width, level.Height, channels)});
+
+        return texture;
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Texture.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace Earth::TextureCompression
+{
+    // Size in bytes of a BC1 level, which is stored as whole 4x4 blocks.
+    size_t GetBC1Size(int width, int height);
+
+    // Encodes 8-bit RGB or RGBA pixels into BC1 blocks. Alpha is dropped.
+    std::vector<unsigned char> EncodeBC1(const unsigned char* pixels, int width, int height, int channels);
+
+    // Encodes every level of an RGB8 or RGBA8 texture, mips included, into BC1.
+    TextureData CompressBC1(const TextureData& source);
+}
@@ -2,7 +2,8 @@
 
 namespace Earth
 {
-    ThreadPool::ThreadPool(size_t threads) : stop(false)
+    ThreadPool::ThreadPool(size_t threads, std::function<void()> onTaskComplete)
+        : onTaskComplete(std::move(onTaskComplete)), stop(false)
     {
         for (size_t i = 0; i < threads; ++i)
             workers.emplace_back([this] {
@@ -12,7 +13,24 @@ namespace Earth
 
                     {
                         std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock, [this] { return this->stop || !this->tasks.empty(); });
+                        for (;;)
+                        {
+                            auto now = std::chrono::steady_clock::now();
+                            size_t due = 0;
+                            for (; !this->delayed.empty() && this->delayed.begin()->first <= now; ++due)
+                            {
+                                this->tasks.push(std::move(this->delayed.begin()->second));
+                                this->delayed.erase(this->delayed.begin());
+                            }
+                            if (due > 1)
+                                this->condition.notify_all();
+                            if (this->stop || !this->tasks.empty())
+                                break;
+                            if (this->delayed.empty())
+                                this->condition.wait(lock);
+                            else
+                                this->condition.wait_until(lock, this->delayed.begin()->first);
+                        }
                         if (this->stop && this->tasks.empty())
                             return;
                         task = std::move(this->tasks.front());
@@ -20,10 +38,26 @@ namespace Earth
                     }
 
                     task();
+                    if (this->onTaskComplete)
+                        this->onTaskComplete();
                 }
             });
     }
 
+    void ThreadPool::EnqueueAt(std::chrono::steady_clock::time_point time, std::function<void()> f)
+    {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+
+            if (stop)
+                throw std::runtime_error("enqueue on stopped ThreadPool");
+
+            delayed.emplace(time, std::move(f));
+        }
+        // Whichever worker wakes recomputes the earliest due time.
+        condition.notify_one();
+    }
+
     ThreadPool::~ThreadPool()
     {
         {
@@ -32,6 +66,7 @@ namespace Earth
             // Clear pending tasks to avoid processing them during shutdown
             std::queue<std::function<void()>> empty;
             std::swap(tasks, empty);
+            delayed.clear();
         }
         condition.notify_all();
         for (std::thread& worker : workers)
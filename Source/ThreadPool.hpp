@@ -1,8 +1,10 @@
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <future>
+#include <map>
 #include <mutex>
 #include <queue>
 #include <thread>
@@ -13,15 +15,20 @@ namespace Earth
     class ThreadPool
     {
       public:
-        ThreadPool(size_t threads);
+        // `onTaskComplete` runs on the worker after each task, once its future is ready.
+        ThreadPool(size_t threads, std::function<void()> onTaskComplete = {});
         ~ThreadPool();
 
         template <class F, class... Args>
         auto Enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type>;
+        // Queues `f` once `time` has passed, without holding a worker until then.
+        void EnqueueAt(std::chrono::steady_clock::time_point time, std::function<void()> f);
 
       private:
         std::vector<std::thread> workers;
         std::queue<std::function<void()>> tasks;
+        std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> delayed;
+        std::function<void()> onTaskComplete;
 
         std::mutex queue_mutex;
         std::condition_variable condition;
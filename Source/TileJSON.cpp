@@ -1,11 +1,139 @@
 #include "TileJSON.hpp"
 #include "HTTP.hpp"
 
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <print>
+#include <sstream>
+
 namespace Earth
 {
-    TileJSON::TileJSON(const URL& url)
+    namespace
+    {
+        // FNV-1a, so cache file names are stable across runs and don't expose API keys in the URL.
+        std::string GetCacheKey(const std::string& url)
+        {
+            uint64_t hash = 14695981039346656037ull;
+            for (unsigned char c : url)
+            {
+                hash ^= c;
+                hash *= 1099511628211ull;
+            }
+            return std::format("{:016x}", hash);
+        }
+
+        bool ReadFile(const std::filesystem::path& path, std::string& contents)
+        {
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open())
+                return false;
+
+            std::ostringstream stream;
+            stream << file.rdbuf();
+            contents = stream.str();
+            return true;
+        }
+
+        void WriteFile(const std::filesystem::path& path, const std::string& contents)
+        {
+            // Write to a temporary file first so a crash never leaves a truncated document behind.
+            std::filesystem::path temp = path;
+            temp += ".part";
+            {
+                std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+                file.write(contents.data(), (std::streamsize)contents.size());
+                if (!file)
+                    return;
+            }
+            std::error_code error;
+            std::filesystem::rename(temp, path, error);
+        }
+    }
+
+    TileJSON::TileJSON(const URL& url, const std::string& cacheDirectory)
+    {
+        if (cacheDirectory.empty())
+        {
+            m_Json = nlohmann::json::parse(HTTP::Fetch(url));
+            return;
+        }
+
+        std::filesystem::path directory(cacheDirectory);
+        std::string key = GetCacheKey(url.Get());
+        std::filesystem::path documentPath = directory / (key + ".json");
+        std::filesystem::path etagPath = directory / (key + ".etag");
+
+        std::string cached, etag;
+        bool hasCache = ReadFile(documentPath, cached);
+        if (hasCache)
+            ReadFile(etagPath, etag);
+
+        HTTP::Response response;
+        try
+        {
+            response = HTTP::FetchIfNoneMatch(url, hasCache ? etag : "");
+        }
+        catch (const std::exception& e)
+        {
+            if (!hasCache)
+                throw;
+
+            std::println(stderr, "Failed to revalidate TileJSON, using cached copy: {}", e.what());
+            m_Json = nlohmann::json::parse(cached);
+            return;
+        }
+
+        if (response.Status == 304 && hasCache)
+        {
+            m_Json = nlohmann::json::parse(cached);
+            return;
+        }
+
+        if (response.Status != 200)
+        {
+            if (!hasCache)
+                throw std::runtime_error(std::format("HTTP request failed with status code: {}", response.Status));
+
+            std::println(stderr, "TileJSON request failed with status {}, using cached copy", response.Status);
+            m_Json = nlohmann::json::parse(cached);
+            return;
+        }
+
+        m_Json = nlohmann::json::parse(response.Body);
+
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        WriteFile(documentPath, response.Body);
+        if (!response.ETag.empty())
+            WriteFile(etagPath, response.ETag);
+        else
+            std::filesystem::remove(etagPath, error);
+    }
+
+    int TileJSON::GetMinZoom() const
+    {
+        return std::clamp(m_Json.value("minzoom", 0), 0, TileSource::MAX_ZOOM);
+    }
+
+    int TileJSON::GetMaxZoom() const
+    {
+        return std::clamp(m_Json.value("maxzoom", 30), 0, TileSource::MAX_ZOOM);
+    }
+
+    TileBounds TileJSON::GetBounds() const
     {
-        std::string jsonString = HTTP::Fetch(url);
-        m_Json = nlohmann::json::parse(jsonString);
+        TileBounds bounds;
+        auto it = m_Json.find("bounds");
+        if (it != m_Json.end() && it->is_array() && it->size() == 4)
+        {
+            bounds.West = (*it)[0].get<double>();
+            bounds.South = (*it)[1].get<double>();
+            bounds.East = (*it)[2].get<double>();
+            bounds.North = (*it)[3].get<double>();
+        }
+        return bounds;
     }
 }
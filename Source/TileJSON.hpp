@@ -2,6 +2,7 @@
 
 #include <nlohmann/json.hpp>
 
+#include "TileSource.hpp"
 #include "URL.hpp"
 
 #include <string>
@@ -11,13 +12,22 @@ namespace Earth
     class TileJSON
     {
       public:
-        TileJSON(const URL& url);
+        // With a `cacheDirectory`, the document is kept on disk and revalidated with its ETag, so an
+        // unchanged document costs one round trip without a body. If the server can't be reached the
+        // cached copy is used as is.
+        TileJSON(const URL& url, const std::string& cacheDirectory = "");
 
         const nlohmann::json& GetJson() const
         {
             return m_Json;
         }
 
+        // `minzoom`, `maxzoom` and `bounds`, with the spec's defaults when absent. The max zoom is
+        // capped at TileSource::MAX_ZOOM.
+        int GetMinZoom() const;
+        int GetMaxZoom() const;
+        TileBounds GetBounds() const;
+
       private:
         nlohmann::json m_Json;
     };
@@ -0,0 +1,381 @@
+#include "TileSource.hpp"
+#include "HTTP.hpp"
+#include "MBTiles.hpp"
+#include "Mercator.hpp"
+#include "PMTiles.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <stdexcept>
+
+namespace Earth
+{
+    namespace
+    {
+        // Subdomains substituted for {s}, as used by most tile CDNs.
+        constexpr const char* SUBDOMAINS[] = {"a", "b", "c"};
+
+        // A host is skipped after this many failures in a row, for a cool-down that doubles with
+        // every further failure.
+        constexpr int MAX_FAILURES = 3;
+        constexpr std::chrono::seconds BASE_COOLDOWN(5);
+        constexpr std::chrono::seconds MAX_COOLDOWN(120);
+
+        std::string ReplaceAll(std::string text, const std::string& key, const std::string& value)
+        {
+            for (size_t pos = text.find(key); pos != std::string::npos; pos = text.find(key, pos + value.size()))
+                text.replace(pos, key.size(), value);
+            return text;
+        }
+
+        std::string ExpandTemplate(const std::string& urlTemplate, int x, int y, int z)
+        {
+            std::string url = ReplaceAll(urlTemplate, "{z}", std::to_string(z));
+            url = ReplaceAll(url, "{x}", std::to_string(x));
+            return ReplaceAll(url, "{y}", std::to_string(y));
+        }
+
+        // The host name and port of a URL, e.g. "a.tile.example.com" for "https://a.tile.example.com/{z}/{x}/{y}".
+        std::string GetHostName(const std::string& url)
+        {
+            size_t begin = url.find("://");
+            begin = begin == std::string::npos ? 0 : begin + 3;
+            std::string authority = url.substr(begin, url.find_first_of("/?#", begin) - begin);
+            if (size_t at = authority.rfind('@'); at != std::string::npos)
+                authority.erase(0, at + 1);
+            return authority;
+        }
+    }
+
+    std::atomic<int> HTTPTileSource::s_MaxRequestsPerHost = 6;
+    std::mutex HTTPTileSource::s_HostsMutex;
+    std::unordered_map<std::string, std::unique_ptr<HTTPTileSource::HostState>> HTTPTileSource::s_Hosts;
+
+    HTTPTileSource::HTTPTileSource(const URL& urlTemplate) : HTTPTileSource(std::vector<URL>{urlTemplate})
+    {
+    }
+
+    HTTPTileSource::HTTPTileSource(const std::vector<URL>& urlTemplates)
+    {
+        auto addHost = [this](std::string urlTemplate) {
+            HostState& state = GetHostState(GetHostName(urlTemplate));
+            m_Hosts.push_back({std::move(urlTemplate), &state});
+        };
+        for (const auto& urlTemplate : urlTemplates)
+        {
+            if (urlTemplate.Get().find("{s}") == std::string::npos)
+            {
+                addHost(urlTemplate.Get());
+                continue;
+            }
+            for (const char* subdomain : SUBDOMAINS)
+                addHost(ReplaceAll(urlTemplate.Get(), "{s}", subdomain));
+        }
+
+        if (m_Hosts.empty())
+            throw std::runtime_error("HTTPTileSource needs at least one URL template");
+
+        // A stuck tile holds its node and all of its ancestors at a coarser level, so give up early
+        // and let the quadtree ask again.
+        m_Policy.Deadline = std::chrono::seconds(10);
+        m_Policy.Hedge = true;
+    }
+
+    void HTTPTileSource::SetMaxRequestsPerHost(int count)
+    {
+        s_MaxRequestsPerHost = std::max(1, count);
+
+        // A raised cap frees slots that no request is going to release.
+        std::vector<HostState*> hosts;
+        {
+            std::lock_guard<std::mutex> lock(s_HostsMutex);
+            for (auto& [name, host] : s_Hosts)
+                hosts.push_back(host.get());
+        }
+        for (HostState* host : hosts)
+        {
+            StartWaiting(*host);
+            host->Available.notify_all();
+        }
+    }
+
+    int HTTPTileSource::GetMaxRequestsPerHost()
+    {
+        return s_MaxRequestsPerHost;
+    }
+
+    TileData HTTPTileSource::Fetch(int x, int y, int z, std::atomic<bool>* cancelled, const HTTP::SinkFactory& sink)
+    {
+        std::vector<const Host*> order = GetOrder(x, y, z);
+        uint64_t key = GetKey(x, y, z);
+
+        // A slot reserved by WhenAvailable is used for the first host tried, if that is still where the
+        // tile goes. The other hosts' slots are acquired as usual. A request that backed off carries on
+        // at the host it was on.
+        HostState* reserved = nullptr;
+        std::optional<std::pair<HTTP::RetryState, HostState*>> resumed;
+        {
+            std::lock_guard<std::mutex> lock(m_ReservationsMutex);
+            if (auto it = m_Reservations.find(key); it != m_Reservations.end())
+            {
+                reserved = it->second;
+                m_Reservations.erase(it);
+            }
+            if (auto it = m_Retries.find(key); it != m_Retries.end())
+            {
+                resumed = it->second;
+                m_Retries.erase(it);
+            }
+        }
+
+        // Only fetches scheduled through WhenAvailable are rescheduled by their caller; the rest back
+        // off in place.
+        bool deferRetries = reserved != nullptr;
+        auto first = order.begin();
+        if (resumed && deferRetries)
+        {
+            first = std::find_if(order.begin(), order.end(),
+                                 [&](const Host* host) { return host->State == resumed->second; });
+            if (first == order.end())
+            {
+                first = order.begin();
+                resumed.reset();
+            }
+        }
+        else
+        {
+            resumed.reset();
+        }
+        if (reserved && reserved != (*first)->State)
+        {
+            Release(*reserved, std::nullopt);
+            reserved = nullptr;
+        }
+
+        std::exception_ptr lastError;
+        for (auto it = first; it != order.end(); ++it)
+        {
+            const Host* host = *it;
+            HostState& state = *host->State;
+            if (reserved)
+                reserved = nullptr;
+            else if (!Acquire(state, cancelled))
+                throw std::runtime_error("Request cancelled");
+
+            HTTP::RetryState retry = resumed ? resumed->first : HTTP::RetryState();
+            resumed.reset();
+            try
+            {
+                URL url = ExpandTemplate(host->Template.Get(), x, y, z);
+                HTTP::Response response =
+                    HTTP::Get(url, m_Policy, &state.Latency, cancelled, sink, deferRetries ? &retry : nullptr);
+                if (response.Status != 200 && response.Status != 404 && response.Status != 204)
+                    throw std::runtime_error(std::format("HTTP request failed with status code: {}", response.Status));
+
+                Release(state, true);
+
+                // Missing tiles are the source's answer, not a host problem.
+                if (response.Status != 200)
+                    return TileData();
+                return TileData(std::move(response.Body), std::move(response.Sink));
+            }
+            catch (const HTTP::RetryLater&)
+            {
+                // The slot goes to other tiles for the backoff rather than idling with this one.
+                Release(state, std::nullopt);
+                std::lock_guard<std::mutex> lock(m_ReservationsMutex);
+                m_Retries[key] = {retry, &state};
+                throw;
+            }
+            catch (const std::exception&)
+            {
+                // A cancelled request says nothing about the host.
+                bool isCancelled = cancelled && *cancelled;
+                Release(state, isCancelled ? std::optional<bool>() : false);
+                if (isCancelled)
+                    throw;
+                lastError = std::current_exception();
+            }
+        }
+
+        std::rethrow_exception(lastError);
+    }
+
+    void HTTPTileSource::WhenAvailable(int x, int y, int z, std::function<void()> start)
+    {
+        HostState& host = *GetOrder(x, y, z).front()->State;
+        {
+            std::lock_guard<std::mutex> lock(m_ReservationsMutex);
+            m_Reservations.emplace(GetKey(x, y, z), &host);
+        }
+        {
+            std::lock_guard<std::mutex> lock(host.Mutex);
+            if (host.Active >= s_MaxRequestsPerHost)
+            {
+                host.Waiting.push_back(std::move(start));
+                return;
+            }
+            host.Active++;
+        }
+        start();
+    }
+
+    URL HTTPTileSource::GetTileURL(int x, int y, int z) const
+    {
+        return ExpandTemplate(m_Hosts[GetShard(x, y, z)].Template.Get(), x, y, z);
+    }
+
+    size_t HTTPTileSource::GetShard(int x, int y, int z) const
+    {
+        // Mixing the key keeps neighbouring tiles, which are requested together, on different hosts.
+        uint64_t key = GetKey(x, y, z);
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return (size_t)(key % m_Hosts.size());
+    }
+
+    std::vector<const HTTPTileSource::Host*> HTTPTileSource::GetOrder(int x, int y, int z) const
+    {
+        size_t shard = GetShard(x, y, z);
+
+        // Start at the tile's own host and walk the ring past unhealthy ones. If every host is
+        // cooling down, try them anyway rather than failing outright.
+        std::vector<const Host*> order;
+        for (size_t i = 0; i < m_Hosts.size(); ++i)
+        {
+            const Host& host = m_Hosts[(shard + i) % m_Hosts.size()];
+            if (IsHealthy(*host.State))
+                order.push_back(&host);
+        }
+        if (order.empty())
+            order.push_back(&m_Hosts[shard]);
+        return order;
+    }
+
+    HTTPTileSource::HostState& HTTPTileSource::GetHostState(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(s_HostsMutex);
+        std::unique_ptr<HostState>& host = s_Hosts[name];
+        if (!host)
+            host = std::make_unique<HostState>();
+        return *host;
+    }
+
+    bool HTTPTileSource::IsHealthy(HostState& host)
+    {
+        std::lock_guard<std::mutex> lock(host.Mutex);
+        return host.Failures < MAX_FAILURES || Clock::now() >= host.RetryAt;
+    }
+
+    bool HTTPTileSource::Acquire(HostState& host, std::atomic<bool>* cancelled)
+    {
+        std::unique_lock<std::mutex> lock(host.Mutex);
+        while (host.Active >= s_MaxRequestsPerHost)
+        {
+            if (cancelled && *cancelled)
+                return false;
+            host.Available.wait_for(lock, std::chrono::milliseconds(50));
+        }
+        host.Active++;
+        return true;
+    }
+
+    void HTTPTileSource::Release(HostState& host, std::optional<bool> succeeded)
+    {
+        {
+            std::lock_guard<std::mutex> lock(host.Mutex);
+            host.Active--;
+            if (succeeded == true)
+            {
+                host.Failures = 0;
+            }
+            else if (succeeded == false && ++host.Failures >= MAX_FAILURES)
+            {
+                auto cooldown = std::min<std::chrono::seconds>(
+                    BASE_COOLDOWN * (1 << std::min(host.Failures - MAX_FAILURES, 5)), MAX_COOLDOWN);
+                host.RetryAt = Clock::now() + cooldown;
+            }
+        }
+        StartWaiting(host);
+        host.Available.notify_one();
+    }
+
+    void HTTPTileSource::StartWaiting(HostState& host)
+    {
+        std::vector<std::function<void()>> starts;
+        {
+            std::lock_guard<std::mutex> lock(host.Mutex);
+            while (!host.Waiting.empty() && host.Active < s_MaxRequestsPerHost)
+            {
+                host.Active++;
+                starts.push_back(std::move(host.Waiting.front()));
+                host.Waiting.pop_front();
+            }
+        }
+        for (auto& start : starts)
+            start();
+    }
+
+    bool TileSource::Covers(int x, int y, int z) const
+    {
+        if (z < GetMinZoom() || z > GetMaxZoom())
+            return false;
+
+        TileBounds bounds = GetBounds();
+        glm::dvec2 min = Mercator::LonLatToUV(bounds.West, bounds.North);
+        glm::dvec2 max = Mercator::LonLatToUV(bounds.East, bounds.South);
+
+        double size = 1.0 / (double)(1 << z);
+        double left = x * size, right = (x + 1) * size;
+        double top = y * size, bottom = (y + 1) * size;
+        if (bottom <= min.y || top >= max.y)
+            return false;
+
+        auto overlaps = [&](double west, double east) { return right > west && left < east; };
+        if (min.x <= max.x)
+            return overlaps(min.x, max.x);
+        return overlaps(min.x, 1.0) || overlaps(0.0, max.x);
+    }
+
+    LayeredTileSource::LayeredTileSource(std::shared_ptr<TileSource> base, std::shared_ptr<TileSource> primary)
+        : m_Base(std::move(base)), m_Primary(std::move(primary))
+    {
+    }
+
+    TileData LayeredTileSource::Fetch(int x, int y, int z, std::atomic<bool>* cancelled, const HTTP::SinkFactory& sink)
+    {
+        if (z <= m_Base->GetMaxZoom())
+        {
+            TileData data = m_Base->Fetch(x, y, z, cancelled, sink);
+            if (!data.IsEmpty())
+                return data;
+        }
+        return m_Primary->Fetch(x, y, z, cancelled, sink);
+    }
+
+    void LayeredTileSource::WhenAvailable(int x, int y, int z, std::function<void()> start)
+    {
+        // The base is local and needs no slot. Tiles it turns out not to have wait in the primary's Fetch.
+        if (z <= m_Base->GetMaxZoom() && m_Base->Covers(x, y, z))
+            m_Base->WhenAvailable(x, y, z, std::move(start));
+        else
+            m_Primary->WhenAvailable(x, y, z, std::move(start));
+    }
+
+    bool LayeredTileSource::Covers(int x, int y, int z) const
+    {
+        return (z <= m_Base->GetMaxZoom() && m_Base->Covers(x, y, z)) || m_Primary->Covers(x, y, z);
+    }
+
+    std::shared_ptr<TileSource> OpenTileArchive(const std::string& path)
+    {
+        if (path.ends_with(".pmtiles"))
+            return std::make_shared<PMTilesSource>(path);
+        if (path.ends_with(".mbtiles"))
+            return std::make_shared<MBTilesSource>(path);
+
+        throw std::runtime_error("Unknown tile archive type: " + path);
+    }
+}
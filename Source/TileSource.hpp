@@ -0,0 +1,257 @@
+#pragma once
+
+#include "HTTP.hpp"
+#include "URL.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+
+namespace Earth
+{
+    // Encoded tile bytes as handed to the decoder. Either owns its bytes or views memory that is
+    // kept alive by an owner, such as a memory-mapped archive.
+    class TileData
+    {
+      public:
+        TileData() = default;
+        TileData(std::string bytes, std::shared_ptr<HTTP::BodySink> sink = nullptr)
+            : m_Storage(std::move(bytes)), m_Sink(std::move(sink))
+        {
+        }
+        TileData(std::span<const unsigned char> view, std::shared_ptr<const void> owner)
+            : m_View(view), m_Owner(std::move(owner))
+        {
+        }
+
+        std::span<const unsigned char> GetBytes() const
+        {
+            if (m_Owner)
+                return m_View;
+            return {reinterpret_cast<const unsigned char*>(m_Storage.data()), m_Storage.size()};
+        }
+
+        bool IsEmpty() const
+        {
+            return GetBytes().empty();
+        }
+
+        // The sink made by the factory passed to TileSource::Fetch, if the bytes were streamed
+        // through one.
+        HTTP::BodySink* GetSink() const
+        {
+            return m_Sink.get();
+        }
+
+      private:
+        std::string m_Storage;
+        std::shared_ptr<HTTP::BodySink> m_Sink;
+        std::span<const unsigned char> m_View;
+        std::shared_ptr<const void> m_Owner;
+    };
+
+    // Area a source has tiles for, in degrees. Bounds that cross the antimeridian have West > East.
+    struct TileBounds
+    {
+        double West = -180.0;
+        double South = -85.05112877980659;
+        double East = 180.0;
+        double North = 85.05112877980659;
+    };
+
+    // Where a Tileset gets its encoded tiles from. Fetch is called concurrently from worker threads.
+    class TileSource
+    {
+      public:
+        static constexpr int MAX_ZOOM = 21;
+
+        virtual ~TileSource() = default;
+
+        // Returns an empty TileData if the source has no tile for this key, throws on errors. Sources
+        // that download tiles feed the bytes to a sink from `sink` as they arrive.
+        virtual TileData Fetch(int x, int y, int z, std::atomic<bool>* cancelled = nullptr,
+                               const HTTP::SinkFactory& sink = {}) = 0;
+
+        // Calls `start` once a Fetch of this key would not have to wait for a connection: at once for
+        // sources without limits, otherwise when a slot frees up, possibly on another thread. Callers
+        // queue the Fetch from `start`, so no worker sits waiting. `start` must not throw. A Fetch
+        // started this way may throw HTTP::RetryLater rather than sleep through a backoff; going
+        // through WhenAvailable again after its NotBefore picks the request up where it left off.
+        virtual void WhenAvailable(int x, int y, int z, std::function<void()> start)
+        {
+            start();
+        }
+
+        // Shallowest and deepest zoom levels the source has tiles for.
+        virtual int GetMinZoom() const
+        {
+            return 0;
+        }
+        virtual int GetMaxZoom() const
+        {
+            return MAX_ZOOM;
+        }
+
+        virtual TileBounds GetBounds() const
+        {
+            return {};
+        }
+
+        // Whether the source can have a tile at this key, going by its zoom range and bounds. Keys it
+        // doesn't cover are not worth a request.
+        virtual bool Covers(int x, int y, int z) const;
+    };
+
+    // Fetches tiles from "https://.../{z}/{x}/{y}.jpg" style URL templates. Every tile key maps to
+    // one host so its connection stays warm, with `{s}` expanded to the a/b/c subdomains. Hosts that
+    // keep failing are skipped for a while and their tiles go to the next healthy host. Requests
+    // that take longer than the host's p95 latency are hedged, and each has a deadline. Connection
+    // slots, health and latency are tracked per host name across all sources.
+    class HTTPTileSource : public TileSource
+    {
+      public:
+        HTTPTileSource(const URL& urlTemplate);
+        HTTPTileSource(const std::vector<URL>& urlTemplates);
+
+        TileData Fetch(int x, int y, int z, std::atomic<bool>* cancelled = nullptr,
+                       const HTTP::SinkFactory& sink = {}) override;
+        // Reserves a slot on the tile's host for its next Fetch, or queues `start` until one frees up.
+        void WhenAvailable(int x, int y, int z, std::function<void()> start) override;
+
+        // URL of the tile on the host it is sharded to.
+        URL GetTileURL(int x, int y, int z) const;
+
+        // Zoom range and bounds as advertised by the TileJSON document, set before the source is shared.
+        void SetZoomRange(int minZoom, int maxZoom)
+        {
+            m_MinZoom = minZoom;
+            m_MaxZoom = maxZoom;
+        }
+        void SetBounds(const TileBounds& bounds)
+        {
+            m_Bounds = bounds;
+        }
+
+        int GetMinZoom() const override
+        {
+            return m_MinZoom;
+        }
+        int GetMaxZoom() const override
+        {
+            return m_MaxZoom;
+        }
+        TileBounds GetBounds() const override
+        {
+            return m_Bounds;
+        }
+
+        // Requests in flight to any one host, shared by all HTTP sources.
+        static void SetMaxRequestsPerHost(int count);
+        static int GetMaxRequestsPerHost();
+
+      private:
+        using Clock = std::chrono::steady_clock;
+
+        // One host name, shared by every source whose templates point at it.
+        struct HostState
+        {
+            HTTP::LatencyTracker Latency;
+
+            std::mutex Mutex;
+            std::condition_variable Available;
+            // Requests in flight or holding a reservation.
+            int Active = 0;
+            int Failures = 0;
+            Clock::time_point RetryAt;
+            // Starts of reserved requests waiting for a slot, oldest first.
+            std::deque<std::function<void()>> Waiting;
+        };
+
+        struct Host
+        {
+            URL Template;
+            HostState* State;
+        };
+
+        static uint64_t GetKey(int x, int y, int z)
+        {
+            return ((uint64_t)z << 58) ^ ((uint64_t)x << 29) ^ (uint64_t)y;
+        }
+        size_t GetShard(int x, int y, int z) const;
+        // The tile's own host followed by the healthy ones after it on the ring. If every host is
+        // cooling down, just its own host.
+        std::vector<const Host*> GetOrder(int x, int y, int z) const;
+
+        static HostState& GetHostState(const std::string& name);
+        static bool IsHealthy(HostState& host);
+        // Blocks until the host has a free slot; false if cancelled while waiting. Only Fetches that
+        // didn't go through WhenAvailable wait here.
+        static bool Acquire(HostState& host, std::atomic<bool>* cancelled);
+        // `succeeded` updates the host's health; leave it empty when the outcome says nothing about it.
+        static void Release(HostState& host, std::optional<bool> succeeded);
+        // Hands free slots to waiting starts and runs them.
+        static void StartWaiting(HostState& host);
+
+        std::vector<Host> m_Hosts;
+        HTTP::RequestPolicy m_Policy;
+        int m_MinZoom = 0;
+        int m_MaxZoom = MAX_ZOOM;
+        TileBounds m_Bounds;
+
+        // Slots reserved by WhenAvailable, by tile key, until the tile's Fetch takes them. Also guards
+        // m_Retries.
+        std::mutex m_ReservationsMutex;
+        std::unordered_multimap<uint64_t, HostState*> m_Reservations;
+        // Requests that threw RetryLater, by tile key, with the host they were on.
+        std::unordered_map<uint64_t, std::pair<HTTP::RetryState, HostState*>> m_Retries;
+
+        static std::atomic<int> s_MaxRequestsPerHost;
+        // Never shrinks; a process talks to a handful of hosts.
+        static std::mutex s_HostsMutex;
+        static std::unordered_map<std::string, std::unique_ptr<HostState>> s_Hosts;
+    };
+
+    // Serves the low zoom levels from a local `base` source, such as the bundled base pack, and
+    // everything else (including tiles missing from the base) from `primary`.
+    class LayeredTileSource : public TileSource
+    {
+      public:
+        LayeredTileSource(std::shared_ptr<TileSource> base, std::shared_ptr<TileSource> primary);
+
+        TileData Fetch(int x, int y, int z, std::atomic<bool>* cancelled = nullptr,
+                       const HTTP::SinkFactory& sink = {}) override;
+        void WhenAvailable(int x, int y, int z, std::function<void()> start) override;
+
+        int GetMinZoom() const override
+        {
+            return std::min(m_Base->GetMinZoom(), m_Primary->GetMinZoom());
+        }
+        int GetMaxZoom() const override
+        {
+            return m_Primary->GetMaxZoom();
+        }
+        TileBounds GetBounds() const override
+        {
+            return m_Primary->GetBounds();
+        }
+        bool Covers(int x, int y, int z) const override;
+
+      private:
+        std::shared_ptr<TileSource> m_Base;
+        std::shared_ptr<TileSource> m_Primary;
+    };
+
+    // Opens a local .pmtiles or .mbtiles archive based on the file extension.
+    std::shared_ptr<TileSource> OpenTileArchive(const std::string& path);
+}
@@ -1,10 +1,13 @@
 #include "Tileset.hpp"
-#include "HTTP.hpp"
 #include "Image.hpp"
 #include "Logger.hpp"
+#include "Mipmap.hpp"
+#include "TerrainMesh.hpp"
+#include "TextureCompression.hpp"
 
 #include <format>
 #include <print>
+#include <string_view>
 
 #ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
 #define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
@@ -12,55 +15,161 @@
 #ifndef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
 #define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
 #endif
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
 
 namespace Earth
 {
     static Logger s_Logger("Tileset");
 
+    namespace
+    {
+        // Loads between sweeps of the entries whose tiles are gone
+        constexpr size_t PURGE_INTERVAL = 256;
+
+        bool IsS3TCSupported()
+        {
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; ++i)
+            {
+                const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+                if (name && (std::string_view(name) == "GL_EXT_texture_compression_s3tc" ||
+                             std::string_view(name) == "GL_EXT_texture_compression_dxt1"))
+                    return true;
+            }
+            return false;
+        }
+
+        // Decodes tile bytes while they download.
+        class ImageSink : public HTTP::BodySink
+        {
+          public:
+            void Write(std::span<const unsigned char> data) override
+            {
+                Stream.Append(data);
+            }
+
+            ImageStream Stream;
+        };
+
+        // Decoders always produce RGBA8, so the pixels become level 0 without a copy.
+        TextureData ToTextureData(Image&& image)
+        {
+            TextureData texture;
+            texture.Format = TextureFormat::RGBA8;
+
+            int width = image.GetWidth();
+            int height = image.GetHeight();
+            texture.Levels.push_back({width, height, image.TakePixels()});
+            return texture;
+        }
+    }
+
     std::atomic<int> Tile::s_TotalTiles = 0;
     std::atomic<int> Tile::s_LoadingTiles = 0;
     std::atomic<int> Tile::s_LoadedTiles = 0;
-    int Tile::s_UploadsPerFrame = 0;
 
-    Tile::Tile(int x, int y, int z, const URL& urlTemplate, bool generateMipmaps, ThreadPool& threadPool)
-        : X(x), Y(y), Z(z), m_GenerateMipmaps(generateMipmaps)
+    Tile::Tile(int x, int y, int z, const TileOptions& options, UploadScheduler& uploadScheduler,
+               MemoryBudget& memoryBudget)
+        : X(x), Y(y), Z(z), m_UploadScheduler(uploadScheduler), m_MemoryBudget(memoryBudget),
+          m_MeshPool(options.Meshes), m_HeightfieldCache(options.Heightfields)
     {
         s_TotalTiles++;
         s_LoadingTiles++;
         m_Cancelled = std::make_shared<std::atomic<bool>>(false);
+    }
 
-        std::string url = urlTemplate.Get();
-        // Simple replacement for now. In a real app, use a proper template engine or regex.
-        // The template is like "https://.../{z}/{x}/{y}.jpg"
+    void Tile::Load(std::shared_ptr<TileSource> source, const TileOptions& options, ThreadPool& threadPool,
+                    std::shared_ptr<CompletionQueue> completions)
+    {
+        Start({std::move(source), X, Y, Z, options, m_Cancelled, &m_MemoryBudget, weak_from_this(),
+               std::move(completions)},
+              threadPool);
+    }
 
-        auto replace = [&](const std::string& key, int value) {
-            std::string keyStr = "{" + key + "}";
-            size_t pos = url.find(keyStr);
-            if (pos != std::string::npos)
+    void Tile::Start(LoadRequest request, ThreadPool& threadPool)
+    {
+        // Queued only once the source has a connection for it, so workers aren't left waiting on hosts
+        // while decodes pile up behind them.
+        TileSource& source = *request.Source;
+        source.WhenAvailable(request.X, request.Y, request.Z, [request, &threadPool]() {
+            try
             {
-                url.replace(pos, keyStr.length(), std::to_string(value));
+                threadPool.Enqueue([request, &threadPool]() {
+                    const auto& [source, x, y, z, options, cancelled, budget, self, completions] = request;
+                    try
+                    {
+                        completions->Push({self, Decode(*source, x, y, z, options, cancelled.get(), *budget)});
+                    }
+                    catch (const HTTP::RetryLater& retry)
+                    {
+                        // The worker moves on to other tiles; the fetch resumes once the backoff is over.
+                        threadPool.EnqueueAt(retry.NotBefore, [request, &threadPool]() { Start(request, threadPool); });
+                    }
+                });
             }
-        };
+            catch (const std::exception&)
+            {
+                // The pool is shutting down, and the tile with it.
+            }
+        });
+    }
+
+    Tile::DecodeResult Tile::Decode(TileSource& source, int x, int y, int z, const TileOptions& options,
+                                    std::atomic<bool>* cancelled, MemoryBudget& memoryBudget)
+    {
+        static LogRateLimit s_FetchLogLimit(10);
+        EARTH_LOG_DEBUG(s_Logger, s_FetchLogLimit, "Fetching tile: {}/{}/{}", z, x, y);
 
-        replace("z", z);
-        replace("x", x);
-        replace("y", y);
+        try
+        {
+            TileData data = source.Fetch(x, y, z, cancelled, []() { return std::make_unique<ImageSink>(); });
+            if (data.IsEmpty())
+                return {};
 
-        s_Logger.Info("Fetching tile: {}", url);
+            MemoryBudget::Allocation encoded = memoryBudget.Allocate(MemoryCategory::Encoded, data.GetBytes().size());
 
-        std::shared_ptr<std::atomic<bool>> cancelled = m_Cancelled;
-        m_Future = threadPool.Enqueue([url, cancelled]() {
-            try
-            {
-                std::string imageData = HTTP::Fetch(url, cancelled.get());
-                return Image(imageData);
-            }
-            catch (const std::exception& e)
+            // Streamed WebP is already decoded by the time the last byte arrives; other formats and
+            // local archives are decoded from the complete bytes.
+            auto* sink = (ImageSink*)data.GetSink();
+            Image image = sink && sink->Stream.IsComplete() ? sink->Stream.TakeImage() : Image(data.GetBytes());
+
+            std::vector<float> heights;
+            if (options.Meshes)
+                heights = TerrainMesh::DecodeHeights(image);
+            TextureData texture = ToTextureData(std::move(image));
+
+            // Mips, transcoding and meshing happen here so the main thread only hands finished data to GL.
+            if (options.GenerateMipmaps)
+                Mipmap::Generate(texture, options.MinMipSize);
+            if (options.Compress)
+                texture = TextureCompression::CompressBC1(texture);
+
+            Mesh mesh;
+            std::shared_ptr<const Heightfield> heightfield;
+            if (options.Meshes)
             {
-                s_Logger.Error("Failed to fetch tile: {}", e.what());
-                return Image();
+                float maxError = TerrainMesh::GetMaxError(y, z, options.MeshErrorPixels);
+                mesh = TerrainMesh::Build(heights, maxError);
+                heightfield = std::make_shared<const Heightfield>(x, y, z, std::move(heights));
             }
-        });
+
+            size_t size = texture.GetSize() + GetMeshSize(mesh) + GetHeightfieldSize(heightfield);
+            MemoryBudget::Allocation decoded = memoryBudget.Allocate(MemoryCategory::Decoded, size);
+            return {std::move(texture), std::move(mesh), std::move(heightfield), std::move(decoded)};
+        }
+        catch (const HTTP::RetryLater&)
+        {
+            throw;
+        }
+        catch (const std::exception& e)
+        {
+            static LogRateLimit s_ErrorLogLimit(5);
+            s_Logger.Error(s_ErrorLogLimit, "Failed to fetch tile {}/{}/{}: {}", z, x, y, e.what());
+            return {};
+        }
     }
 
     Tile::~Tile()
@@ -82,8 +191,6 @@ namespace Earth
 
     void Tile::Bind(int slot)
     {
-        CheckLoad();
-
         if (TextureID)
         {
             glActiveTexture(GL_TEXTURE0 + slot);
@@ -91,65 +198,219 @@ namespace Earth
         }
     }
 
-    void Tile::CheckLoad()
+    void Tile::CheckLoad(float priority)
+    {
+        if (m_IsLoading && m_Pending.IsValid())
+            m_UploadScheduler.Request(shared_from_this(), priority);
+    }
+
+    void Tile::Complete(DecodeResult&& result)
     {
-        if (m_IsLoading && m_Future.valid())
+        // Evicted while the worker was busy; the result is dropped with its memory.
+        if (!m_IsLoading)
+            return;
+
+        m_Pending = std::move(result.Texture);
+        m_PendingMesh = std::move(result.Geometry);
+        m_PendingHeightfield = std::move(result.Heights);
+        m_PendingMemory = std::move(result.Memory);
+        if (!m_Pending.IsValid())
         {
-            if (s_UploadsPerFrame >= MAX_UPLOADS_PER_FRAME)
-                return;
+            // Fetch or decode failed; nothing to upload.
+            m_IsLoading = false;
+            s_LoadingTiles--;
+        }
+    }
+
+    void Tile::Upload()
+    {
+        if (!m_IsLoading || !m_Pending.IsValid())
+            return;
+
+        TextureData texture = std::move(m_Pending);
+        m_Pending = TextureData();
+        Mesh mesh = std::move(m_PendingMesh);
+        m_PendingMesh = Mesh();
+        m_PendingMemory.Release();
+        // The heightfield stays in system memory, but is charged with the tile's GPU data so the
+        // budget evicts them together.
+        m_Heightfield = std::move(m_PendingHeightfield);
+        size_t size = texture.GetSize() + GetMeshSize(mesh) + GetHeightfieldSize(m_Heightfield);
+        m_GPUMemory = m_MemoryBudget.Allocate(MemoryCategory::GPU, size);
+        m_IsLoading = false;
+        s_LoadingTiles--;
+
+        s_LoadedTiles++;
+        glGenTextures(1, &TextureID);
+        glBindTexture(GL_TEXTURE_2D, TextureID);
+
+        const TextureLevel& base = texture.Levels[0];
+        bool hasMipmaps = texture.Levels.size() > 1;
 
-            if (m_Future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        // Rows of small RGB levels are not 4-byte aligned.
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        for (size_t level = 0; level < texture.Levels.size(); ++level)
+        {
+            const TextureLevel& mip = texture.Levels[level];
+            if (texture.IsCompressed())
+            {
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, mip.Width,
+                                       mip.Height, 0, (GLsizei)mip.Data.size(), mip.Data.data());
+            }
+            else
             {
-                s_UploadsPerFrame++;
-                Image image = m_Future.get();
-                m_IsLoading = false;
-                s_LoadingTiles--;
+                GLenum format = texture.Format == TextureFormat::RGBA8 ? GL_RGBA : GL_RGB;
+                glTexImage2D(GL_TEXTURE_2D, (GLint)level, format, mip.Width, mip.Height, 0, format, GL_UNSIGNED_BYTE,
+                             mip.Data.data());
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.Levels.size() - 1);
 
-                if (image.GetData())
-                {
-                    s_LoadedTiles++;
-                    glGenTextures(1, &TextureID);
-                    glBindTexture(GL_TEXTURE_2D, TextureID);
+        if (hasMipmaps)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-                    GLenum format = GL_RGB;
-                    if (image.GetChannels() == 4)
-                        format = GL_RGBA;
+            GLfloat maxAniso = 0.0f;
+            glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAniso);
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAniso);
+        }
+        else
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
 
-                    glTexImage2D(GL_TEXTURE_2D, 0, format, image.GetWidth(), image.GetHeight(), 0, format,
-                                 GL_UNSIGNED_BYTE, image.GetData());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-                    if (m_GenerateMipmaps)
-                    {
-                        glGenerateMipmap(GL_TEXTURE_2D);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (m_MeshPool && !mesh.Indices.empty())
+            m_Mesh = m_MeshPool->Allocate(mesh);
+        if (m_HeightfieldCache && m_Heightfield)
+            m_HeightfieldCache->Insert(X, Y, Z, m_Heightfield);
 
-                        GLfloat maxAniso = 0.0f;
-                        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAniso);
-                        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAniso);
-                    }
-                    else
-                    {
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-                    }
+        static LogRateLimit s_LoadLogLimit(10);
+        EARTH_LOG_DEBUG(s_Logger, s_LoadLogLimit, "Loaded tile texture: {} ({}x{}, {} levels, {} bytes)", TextureID,
+                        base.Width, base.Height, texture.Levels.size(), texture.GetSize());
+    }
 
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    void Tile::Touch(float priority)
+    {
+        if (IsLoaded() || m_Pending.IsValid())
+            m_MemoryBudget.Track(shared_from_this(), priority);
+    }
 
-                    s_Logger.Info("Loaded tile texture: {} ({}x{})", TextureID, image.GetWidth(), image.GetHeight());
-                }
-            }
+    void Tile::Evict()
+    {
+        if (m_Cancelled)
+            *m_Cancelled = true;
+
+        if (m_IsLoading)
+        {
+            m_IsLoading = false;
+            s_LoadingTiles--;
         }
+        if (TextureID)
+        {
+            glDeleteTextures(1, &TextureID);
+            TextureID = 0;
+            s_LoadedTiles--;
+        }
+
+        m_Pending = TextureData();
+        m_PendingMesh = Mesh();
+        m_Mesh = MeshPool::Handle();
+        m_PendingHeightfield.reset();
+        m_Heightfield.reset();
+        m_PendingMemory.Release();
+        m_GPUMemory.Release();
+        m_IsEvicted = true;
     }
 
-    Tileset::Tileset(const URL& urlTemplate, ThreadPool& threadPool, bool generateMipmaps)
-        : m_UrlTemplate(urlTemplate), m_ThreadPool(threadPool), m_GenerateMipmaps(generateMipmaps)
+    Tileset::Tileset(std::shared_ptr<TileSource> source, ThreadPool& threadPool, UploadScheduler& uploadScheduler,
+                     MemoryBudget& memoryBudget, const TileOptions& options)
+        : m_Source(std::move(source)), m_Options(options), m_ThreadPool(threadPool), m_UploadScheduler(uploadScheduler),
+          m_MemoryBudget(memoryBudget), m_Completions(std::make_shared<Tile::CompletionQueue>())
     {
+        if (m_Options.Compress)
+        {
+            m_Options.Compress = IsS3TCSupported();
+            if (!m_Options.Compress)
+                s_Logger.Warn("S3TC texture compression not supported, uploading uncompressed tiles");
+        }
+    }
+
+    Tileset::~Tileset()
+    {
+        // Coroutines still waiting would never be resumed.
+        for (Waiter& waiter : m_Waiters)
+            waiter.Handle.destroy();
+    }
+
+    std::shared_ptr<Tile> Tileset::LoadTile(int x, int y, int z, float priority)
+    {
+        if (!m_Source->Covers(x, y, z))
+            return nullptr;
+
+        // A tile another view already holds costs nothing more, so it skips admission.
+        uint64_t key = GetKey(x, y, z);
+        if (std::shared_ptr<Tile> tile = m_Tiles[key].lock(); tile && !tile->IsEvicted())
+        {
+            m_SharedLoads++;
+            return tile;
+        }
+
+        if (!m_MemoryBudget.Admit(priority))
+            return nullptr;
+
+        auto tile = std::make_shared<Tile>(x, y, z, m_Options, m_UploadScheduler, m_MemoryBudget);
+        tile->Load(m_Source, m_Options, m_ThreadPool, m_Completions);
+        m_Tiles[key] = tile;
+
+        if (++m_LoadsSincePurge >= PURGE_INTERVAL)
+        {
+            std::erase_if(m_Tiles, [](const auto& entry) { return entry.second.expired(); });
+            m_LoadsSincePurge = 0;
+        }
+        return tile;
+    }
+
+    void Tileset::SetSource(std::shared_ptr<TileSource> source)
+    {
+        m_Source = std::move(source);
+        // Holders keep the tiles they have, but new requests go to the new source.
+        m_Tiles.clear();
     }
 
-    std::shared_ptr<Tile> Tileset::LoadTile(int x, int y, int z)
+    Tileset::TileLoad Tileset::LoadTileAsync(int x, int y, int z, float priority)
     {
-        return std::make_shared<Tile>(x, y, z, m_UrlTemplate, m_GenerateMipmaps, m_ThreadPool);
+        return TileLoad(*this, LoadTile(x, y, z, priority), priority);
+    }
+
+    void Tileset::Update()
+    {
+        m_Completions->Drain([](Tile::Completion&& completion) {
+            if (std::shared_ptr<Tile> tile = completion.Target.lock())
+                tile->Complete(std::move(completion.Result));
+        });
+
+        // Resumed coroutines may start new loads, which land in m_Waiters for the next frame.
+        std::vector<Waiter> waiters = std::move(m_Waiters);
+        m_Waiters.clear();
+        for (Waiter& waiter : waiters)
+        {
+            if (waiter.Target->IsLoading())
+            {
+                // Nothing else may hold the tile, so keep it moving through upload and in the budget.
+                waiter.Target->CheckLoad(waiter.Priority);
+                waiter.Target->Touch(waiter.Priority);
+                m_Waiters.push_back(std::move(waiter));
+            }
+            else
+            {
+                waiter.Handle.resume();
+            }
+        }
     }
 }
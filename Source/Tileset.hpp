@@ -1,28 +1,96 @@
 #pragma once
 
-#include "Image.hpp"
+#include "GL.hpp"
+#include "Heightfield.hpp"
+#include "HeightfieldCache.hpp"
+#include "MPSCQueue.hpp"
+#include "MemoryBudget.hpp"
+#include "Mesh.hpp"
+#include "MeshPool.hpp"
+#include "Texture.hpp"
 #include "ThreadPool.hpp"
-#include "URL.hpp"
+#include "TileSource.hpp"
+#include "UploadScheduler.hpp"
 
-#include <OpenGL/gl3.h>
 #include <atomic>
-#include <future>
+#include <coroutine>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace Earth
 {
-    struct Tile
+    // How tiles of a tileset are decoded.
+    struct TileOptions
     {
-        Tile(int x, int y, int z, const URL& urlTemplate, bool generateMipmaps, ThreadPool& threadPool);
+        bool GenerateMipmaps = false;
+        // Smallest mip dimension generated. Tiles are never drawn much smaller than their full size,
+        // so the tail of the chain can be skipped to save decode time and memory.
+        int MinMipSize = 1;
+        // Transcode imagery to BC1. Only use it for color data; lossy blocks would corrupt encoded elevation.
+        bool Compress = false;
+        // When set, tiles are treated as Terrain-RGB and an adaptive mesh is built for each of them
+        // and stored in this pool.
+        MeshPool* Meshes = nullptr;
+        // Mesh error in texels, which is roughly pixels on screen at the split threshold.
+        float MeshErrorPixels = 2.0f;
+        // When set, terrain tiles register their heightfields here as they upload, for elevation queries.
+        HeightfieldCache* Heightfields = nullptr;
+    };
+
+    class Tileset;
+
+    // Created and loaded through a Tileset.
+    struct Tile : public std::enable_shared_from_this<Tile>
+    {
+        Tile(int x, int y, int z, const TileOptions& options, UploadScheduler& uploadScheduler,
+             MemoryBudget& memoryBudget);
         ~Tile();
 
         void Bind(int slot = 0);
-        void CheckLoad();
+        // Once the decoded data has arrived, asks the upload scheduler for an upload slot.
+        // `priority` is the tile's on-screen importance.
+        void CheckLoad(float priority = 0.0f);
         bool IsLoaded() const
         {
             return TextureID != 0;
         }
+        // Still being fetched, decoded or waiting for upload.
+        bool IsLoading() const
+        {
+            return m_IsLoading;
+        }
+
+        // Size of the decoded data waiting for upload, 0 if there is none.
+        size_t GetPendingSize() const
+        {
+            return m_Pending.GetSize() + GetMeshSize(m_PendingMesh) + GetHeightfieldSize(m_PendingHeightfield);
+        }
+        // Creates the texture and mesh from the pending data. Called by the UploadScheduler.
+        void Upload();
+
+        // Reports the memory this tile holds to the budget, with `priority` deciding eviction order.
+        void Touch(float priority);
+        // Frees the texture and any pending data, and stops loading. The owner should drop an
+        // evicted tile and request it again once it is needed.
+        void Evict();
+        bool IsEvicted() const
+        {
+            return m_IsEvicted;
+        }
+
+        // The terrain mesh, or nullptr if the tileset builds none or it has not been uploaded yet.
+        const MeshPool::Handle* GetMesh() const
+        {
+            return m_Mesh.IsValid() ? &m_Mesh : nullptr;
+        }
+        // Terrain heights for picking, available along with the mesh.
+        const Heightfield* GetHeightfield() const
+        {
+            return m_Heightfield.get();
+        }
 
         int X, Y, Z;
         GLuint TextureID = 0;
@@ -30,31 +98,190 @@ namespace Earth
         static std::atomic<int> s_TotalTiles;
         static std::atomic<int> s_LoadingTiles;
         static std::atomic<int> s_LoadedTiles;
-        static int s_UploadsPerFrame;
-        static const int MAX_UPLOADS_PER_FRAME = 4;
 
-        static void ResetUploadStats()
+      private:
+        friend class Tileset;
+
+        struct DecodeResult
+        {
+            TextureData Texture;
+            Mesh Geometry;
+            std::shared_ptr<const Heightfield> Heights;
+            MemoryBudget::Allocation Memory;
+        };
+
+        // Workers push finished tiles here and the tileset hands them over on the main thread, so
+        // finding the few tiles that finished doesn't mean polling every tile in flight.
+        struct Completion
+        {
+            std::weak_ptr<Tile> Target;
+            DecodeResult Result;
+        };
+        using CompletionQueue = MPSCQueue<Completion>;
+
+        static size_t GetMeshSize(const Mesh& mesh)
+        {
+            return mesh.Vertices.size() * sizeof(Vertex) + mesh.Indices.size() * sizeof(uint16_t);
+        }
+        static size_t GetHeightfieldSize(const std::shared_ptr<const Heightfield>& heightfield)
         {
-            s_UploadsPerFrame = 0;
+            return heightfield ? heightfield->GetSize() : 0;
         }
 
-      private:
-        std::future<Image> m_Future;
+        // Everything a worker needs to fetch and decode a tile, so a load that backs off can start over.
+        struct LoadRequest
+        {
+            std::shared_ptr<TileSource> Source;
+            int X = 0, Y = 0, Z = 0;
+            TileOptions Options;
+            std::shared_ptr<std::atomic<bool>> Cancelled;
+            MemoryBudget* Budget = nullptr;
+            std::weak_ptr<Tile> Target;
+            std::shared_ptr<CompletionQueue> Completions;
+        };
+
+        // Starts fetching and decoding on a worker, which pushes the result to `completions`.
+        void Load(std::shared_ptr<TileSource> source, const TileOptions& options, ThreadPool& threadPool,
+                  std::shared_ptr<CompletionQueue> completions);
+        // Queues the request once its source has a slot for it, and again after any backoff.
+        static void Start(LoadRequest request, ThreadPool& threadPool);
+        // Errors are logged and leave the result empty, apart from HTTP::RetryLater, which is thrown on.
+        static DecodeResult Decode(TileSource& source, int x, int y, int z, const TileOptions& options,
+                                   std::atomic<bool>* cancelled, MemoryBudget& memoryBudget);
+        // Takes the decoded data on the main thread.
+        void Complete(DecodeResult&& result);
+
+        UploadScheduler& m_UploadScheduler;
+        MemoryBudget& m_MemoryBudget;
+        TextureData m_Pending;
+        Mesh m_PendingMesh;
+        MeshPool* m_MeshPool;
+        HeightfieldCache* m_HeightfieldCache;
+        MeshPool::Handle m_Mesh;
+        std::shared_ptr<const Heightfield> m_PendingHeightfield;
+        std::shared_ptr<const Heightfield> m_Heightfield;
+        MemoryBudget::Allocation m_PendingMemory;
+        MemoryBudget::Allocation m_GPUMemory;
         std::shared_ptr<std::atomic<bool>> m_Cancelled;
         bool m_IsLoading = true;
-        bool m_GenerateMipmaps = false;
+        bool m_IsEvicted = false;
     };
 
     class Tileset
     {
       public:
-        Tileset(const URL& urlTemplate, ThreadPool& threadPool, bool generateMipmaps = false);
+        // Awaitable returned by LoadTileAsync.
+        class TileLoad
+        {
+          public:
+            TileLoad(Tileset& tileset, std::shared_ptr<Tile> tile, float priority)
+                : m_Tileset(tileset), m_Tile(std::move(tile)), m_Priority(priority)
+            {
+            }
+
+            bool await_ready() const noexcept
+            {
+                return !m_Tile || !m_Tile->IsLoading();
+            }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                m_Tileset.m_Waiters.push_back({m_Tile, m_Priority, handle});
+            }
+            std::shared_ptr<Tile> await_resume() noexcept
+            {
+                return std::move(m_Tile);
+            }
+
+          private:
+            Tileset& m_Tileset;
+            std::shared_ptr<Tile> m_Tile;
+            float m_Priority;
+        };
+
+        // Compression is only enabled when the GL driver supports S3TC.
+        Tileset(std::shared_ptr<TileSource> source, ThreadPool& threadPool, UploadScheduler& uploadScheduler,
+                MemoryBudget& memoryBudget, const TileOptions& options = {});
+        ~Tileset();
 
-        std::shared_ptr<Tile> LoadTile(int x, int y, int z);
+        Tileset(const Tileset&) = delete;
+        Tileset& operator=(const Tileset&) = delete;
+
+        // Returns nullptr if the source doesn't cover the key or the memory budget rejects a request
+        // of this priority. Tiles are shared: while anyone holds a tile, requests for its key return the
+        // same one, so views over the same tileset fetch, decode and upload each tile once. The memory
+        // budget and upload scheduler rank a shared tile by its most important use.
+        std::shared_ptr<Tile> LoadTile(int x, int y, int z, float priority);
+
+        // For coroutines (see DetachedTask in Task.hpp): `co_await LoadTileAsync(...)` resumes on the
+        // main thread, inside Update, once the tile is uploaded or has failed or been evicted. Yields
+        // nullptr where LoadTile would.
+        TileLoad LoadTileAsync(int x, int y, int z, float priority);
+
+        // Hands tiles the workers have finished to the main thread and resumes coroutines whose loads
+        // are done. Call once per frame before the tiles are used.
+        void Update();
+
+        // Replaces the source for tiles loaded from now on. Tiles already loaded are kept.
+        void SetSource(std::shared_ptr<TileSource> source);
+        int GetMaxZoom() const
+        {
+            return m_Source->GetMaxZoom();
+        }
+        // Whether the source's zoom range and bounds include the key.
+        bool Covers(int x, int y, int z) const
+        {
+            return m_Source->Covers(x, y, z);
+        }
+
+        // Options for tiles loaded from now on.
+        int GetMinMipSize() const
+        {
+            return m_Options.MinMipSize;
+        }
+        void SetMinMipSize(int size)
+        {
+            m_Options.MinMipSize = size;
+        }
+        float GetMeshErrorPixels() const
+        {
+            return m_Options.MeshErrorPixels;
+        }
+        void SetMeshErrorPixels(float pixels)
+        {
+            m_Options.MeshErrorPixels = pixels;
+        }
+
+        // Requests answered with a tile that was already held, such as by another view.
+        size_t GetSharedLoads() const
+        {
+            return m_SharedLoads;
+        }
 
       private:
-        URL m_UrlTemplate;
-        bool m_GenerateMipmaps;
+        struct Waiter
+        {
+            std::shared_ptr<Tile> Target;
+            float Priority;
+            std::coroutine_handle<> Handle;
+        };
+
+        static uint64_t GetKey(int x, int y, int z)
+        {
+            return ((uint64_t)z << 58) | ((uint64_t)y << 29) | (uint64_t)x;
+        }
+
+        std::shared_ptr<TileSource> m_Source;
+        TileOptions m_Options;
         ThreadPool& m_ThreadPool;
+        UploadScheduler& m_UploadScheduler;
+        MemoryBudget& m_MemoryBudget;
+        // Shared with the workers, which may still push to it after the tileset is gone.
+        std::shared_ptr<Tile::CompletionQueue> m_Completions;
+        std::vector<Waiter> m_Waiters;
+        // Every tile still held by someone, so requests from several views share one fetch, decode and
+        // upload per tile.
+        std::unordered_map<uint64_t, std::weak_ptr<Tile>> m_Tiles;
+        size_t m_LoadsSincePurge = 0;
+        size_t m_SharedLoads = 0;
     };
 }
@@ -0,0 +1,136 @@
+#include "UploadScheduler.hpp"
+#include "Tileset.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_set>
+
+namespace Earth
+{
+    namespace
+    {
+        // Weight of each new measurement in the running cost estimate
+        constexpr double ESTIMATE_SMOOTHING = 0.1;
+    }
+
+    UploadScheduler::UploadScheduler()
+    {
+        GLint bits = 0;
+        glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &bits);
+        m_HasGPUTimers = bits > 0;
+    }
+
+    UploadScheduler::~UploadScheduler()
+    {
+        for (const auto& pending : m_PendingQueries)
+            glDeleteQueries(1, &pending.Query);
+        if (!m_FreeQueries.empty())
+            glDeleteQueries((GLsizei)m_FreeQueries.size(), m_FreeQueries.data());
+    }
+
+    void UploadScheduler::BeginFrame()
+    {
+        // Queries finish in submission order, so stop at the first one that isn't ready.
+        size_t completed = 0;
+        for (const auto& pending : m_PendingQueries)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(pending.Query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(pending.Query, GL_QUERY_RESULT, &nanoseconds);
+            UpdateEstimate(pending.Bytes, std::max(pending.CPUMs, nanoseconds / 1.0e6));
+
+            m_FreeQueries.push_back(pending.Query);
+            completed++;
+        }
+        m_PendingQueries.erase(m_PendingQueries.begin(), m_PendingQueries.begin() + completed);
+    }
+
+    void UploadScheduler::Request(const std::shared_ptr<Tile>& tile, float priority)
+    {
+        m_Requests.push_back({tile, priority});
+    }
+
+    void UploadScheduler::Flush()
+    {
+        std::sort(m_Requests.begin(), m_Requests.end(),
+                  [](const QueuedUpload& a, const QueuedUpload& b) { return a.Priority > b.Priority; });
+
+        double spent = 0.0;
+        int uploads = 0;
+
+        for (const auto& request : m_Requests)
+        {
+            std::shared_ptr<Tile> tile = request.Target.lock();
+            if (!tile)
+                continue;
+
+            size_t bytes = tile->GetPendingSize();
+            if (bytes == 0)
+                continue;
+
+            double predicted = bytes * m_CostPerByteMs;
+            if (uploads > 0 && spent + predicted > m_BudgetMs)
+                break;
+
+            GLuint query = 0;
+            if (m_HasGPUTimers)
+            {
+                if (m_FreeQueries.empty())
+                {
+                    glGenQueries(1, &query);
+                }
+                else
+                {
+                    query = m_FreeQueries.back();
+                    m_FreeQueries.pop_back();
+                }
+                glBeginQuery(GL_TIME_ELAPSED, query);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            tile->Upload();
+            double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            if (query)
+            {
+                glEndQuery(GL_TIME_ELAPSED);
+                m_PendingQueries.push_back({query, bytes, cpuMs});
+            }
+            else
+            {
+                UpdateEstimate(bytes, cpuMs);
+            }
+
+            // The GPU side isn't known yet, so charge whichever is larger.
+            spent += std::max(cpuMs, predicted);
+            uploads++;
+        }
+
+        // Views can request the same tile, so count each waiting tile once.
+        std::unordered_set<const Tile*> deferred;
+        for (const auto& request : m_Requests)
+        {
+            std::shared_ptr<Tile> tile = request.Target.lock();
+            if (tile && tile->GetPendingSize() > 0)
+                deferred.insert(tile.get());
+        }
+        m_Deferred = (int)deferred.size();
+
+        m_Requests.clear();
+        m_UploadsLastFrame = uploads;
+        m_SpentLastFrameMs = (float)spent;
+    }
+
+    void UploadScheduler::UpdateEstimate(size_t bytes, double milliseconds)
+    {
+        if (bytes == 0)
+            return;
+
+        double costPerByte = milliseconds / bytes;
+        m_CostPerByteMs += (costPerByte - m_CostPerByteMs) * ESTIMATE_SMOOTHING;
+    }
+}
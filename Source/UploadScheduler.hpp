@@ -0,0 +1,97 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace Earth
+{
+    struct Tile;
+
+    // Spends a per-frame millisecond budget on texture uploads, most important tiles first.
+    // The cost of an upload is predicted from its size using a running cost-per-byte estimate,
+    // measured with CPU timers and, where available, GL timer queries.
+    class UploadScheduler
+    {
+      public:
+        UploadScheduler();
+        ~UploadScheduler();
+
+        UploadScheduler(const UploadScheduler&) = delete;
+        UploadScheduler& operator=(const UploadScheduler&) = delete;
+
+        // Collects finished GPU timings and starts a new frame's budget.
+        void BeginFrame();
+
+        // Queues a tile whose data is ready. Higher priority uploads first.
+        void Request(const std::shared_ptr<Tile>& tile, float priority);
+
+        // Uploads queued tiles until the budget is spent. At least one upload happens per frame so
+        // loading always makes progress.
+        void Flush();
+
+        float GetBudget() const
+        {
+            return m_BudgetMs;
+        }
+        void SetBudget(float milliseconds)
+        {
+            m_BudgetMs = milliseconds;
+        }
+
+        int GetUploadsLastFrame() const
+        {
+            return m_UploadsLastFrame;
+        }
+        // Tiles the last Flush left waiting because the budget ran out. They are requested again
+        // next frame, so a frame should follow soon.
+        int GetDeferred() const
+        {
+            return m_Deferred;
+        }
+        float GetSpentLastFrame() const
+        {
+            return m_SpentLastFrameMs;
+        }
+        // Current estimate in milliseconds per megabyte uploaded.
+        float GetCostPerMB() const
+        {
+            return (float)(m_CostPerByteMs * 1024.0 * 1024.0);
+        }
+        bool HasGPUTimers() const
+        {
+            return m_HasGPUTimers;
+        }
+
+      private:
+        struct QueuedUpload
+        {
+            std::weak_ptr<Tile> Target;
+            float Priority;
+        };
+
+        struct PendingQuery
+        {
+            GLuint Query;
+            size_t Bytes;
+            double CPUMs;
+        };
+
+        void UpdateEstimate(size_t bytes, double milliseconds);
+
+        std::vector<QueuedUpload> m_Requests;
+        std::vector<PendingQuery> m_PendingQueries;
+        std::vector<GLuint> m_FreeQueries;
+
+        float m_BudgetMs = 2.0f;
+        // Conservative starting point of 1 ms per MB, refined by measurements
+        double m_CostPerByteMs = 1.0 / (1024.0 * 1024.0);
+        bool m_HasGPUTimers = false;
+
+        int m_UploadsLastFrame = 0;
+        int m_Deferred = 0;
+        float m_SpentLastFrameMs = 0.0f;
+    };
+}
@@ -0,0 +1,225 @@
+#include "VertexCache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace Earth::VertexCache
+{
+    namespace
+    {
+        // The scoring model's LRU cache is larger than the measured FIFO so that vertices about to
+        // fall out still attract their neighbours.
+        constexpr int SCORE_CACHE_SIZE = 32;
+        constexpr float CACHE_DECAY_POWER = 1.5f;
+        constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+        constexpr float VALENCE_BOOST_SCALE = 2.0f;
+        constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+        struct VertexData
+        {
+            int CachePosition = -1;
+            float Score = 0.0f;
+            // Triangles not yet emitted, stored in the first `Remaining` entries of the adjacency range.
+            uint32_t Remaining = 0;
+            uint32_t FirstTriangle = 0;
+        };
+
+        float ComputeScore(const VertexData& vertex)
+        {
+            if (vertex.Remaining == 0)
+                return -1.0f;
+
+            float score = 0.0f;
+            if (vertex.CachePosition >= 0)
+            {
+                if (vertex.CachePosition < 3)
+                {
+                    // The last triangle's vertices get a fixed score so the optimizer doesn't simply
+                    // strip along them.
+                    score = LAST_TRIANGLE_SCORE;
+                }
+                else
+                {
+                    float scale = 1.0f / (SCORE_CACHE_SIZE - 3);
+                    score = std::pow(1.0f - (vertex.CachePosition - 3) * scale, CACHE_DECAY_POWER);
+                }
+            }
+
+            // Favour vertices with few triangles left so they don't get stranded.
+            score += VALENCE_BOOST_SCALE * std::pow((float)vertex.Remaining, -VALENCE_BOOST_POWER);
+            return score;
+        }
+
+        std::atomic<bool> s_Measuring = false;
+    }
+
+    Stats& GetStats()
+    {
+        static Stats s_Stats;
+        return s_Stats;
+    }
+
+    void SetMeasuring(bool measuring)
+    {
+        s_Measuring = measuring;
+    }
+
+    bool IsMeasuring()
+    {
+        return s_Measuring;
+    }
+
+    size_t CountMisses(const std::vector<uint16_t>& indices, size_t vertexCount, int cacheSize)
+    {
+        // FIFO: a vertex stays cached for `cacheSize` misses after its own.
+        std::vector<size_t> cachedAt(vertexCount, 0);
+        size_t misses = 0;
+        for (uint16_t index : indices)
+        {
+            if (cachedAt[index] == 0 || misses - cachedAt[index] >= (size_t)cacheSize)
+            {
+                misses++;
+                cachedAt[index] = misses;
+            }
+        }
+        return misses;
+    }
+
+    void Optimize(std::vector<uint16_t>& indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        bool measuring = s_Measuring;
+        size_t missesBefore = measuring ? CountMisses(indices, vertexCount) : 0;
+
+        // Vertex to triangle adjacency
+        std::vector<VertexData> vertices(vertexCount);
+        for (uint16_t index : indices)
+            vertices[index].Remaining++;
+
+        uint32_t offset = 0;
+        for (VertexData& vertex : vertices)
+        {
+            vertex.FirstTriangle = offset;
+            offset += vertex.Remaining;
+            vertex.Remaining = 0;
+        }
+
+        std::vector<uint32_t> adjacency(indices.size());
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                VertexData& vertex = vertices[indices[t * 3 + k]];
+                adjacency[vertex.FirstTriangle + vertex.Remaining++] = (uint32_t)t;
+            }
+        }
+
+        for (VertexData& vertex : vertices)
+            vertex.Score = ComputeScore(vertex);
+
+        std::vector<float> triangleScores(triangleCount);
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            triangleScores[t] = vertices[indices[t * 3]].Score + vertices[indices[t * 3 + 1]].Score +
+                                vertices[indices[t * 3 + 2]].Score;
+        }
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint16_t> output;
+        output.reserve(indices.size());
+
+        // LRU cache, most recent first, with room for the three vertices being pushed.
+        std::array<int, SCORE_CACHE_SIZE + 3> cache;
+        int cacheCount = 0;
+
+        size_t nextUnemitted = 0;
+        int64_t bestTriangle = -1;
+        for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+        {
+            if (bestTriangle < 0)
+            {
+                // Nothing in the cache is connected to a remaining triangle; start a new region with
+                // the best remaining triangle.
+                float bestScore = -1.0f;
+                for (size_t t = nextUnemitted; t < triangleCount; ++t)
+                {
+                    if (!emitted[t] && triangleScores[t] > bestScore)
+                    {
+                        bestScore = triangleScores[t];
+                        bestTriangle = (int64_t)t;
+                    }
+                }
+            }
+
+            size_t triangle = (size_t)bestTriangle;
+            emitted[triangle] = true;
+            while (nextUnemitted < triangleCount && emitted[nextUnemitted])
+                nextUnemitted++;
+
+            std::array<int, SCORE_CACHE_SIZE + 3> newCache;
+            int newCount = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                uint16_t index = indices[triangle * 3 + k];
+                output.push_back(index);
+                newCache[newCount++] = index;
+
+                // Drop the triangle from the vertex's remaining list.
+                VertexData& vertex = vertices[index];
+                uint32_t* first = &adjacency[vertex.FirstTriangle];
+                uint32_t* last = first + vertex.Remaining;
+                std::iter_swap(std::find(first, last, (uint32_t)triangle), last - 1);
+                vertex.Remaining--;
+            }
+            for (int i = 0; i < cacheCount; ++i)
+            {
+                int index = cache[i];
+                if (index != newCache[0] && index != newCache[1] && index != newCache[2])
+                    newCache[newCount++] = index;
+            }
+
+            // Rescore everything that was in the cache, including vertices that just dropped out.
+            for (int i = 0; i < newCount; ++i)
+            {
+                VertexData& vertex = vertices[newCache[i]];
+                vertex.CachePosition = i < SCORE_CACHE_SIZE ? i : -1;
+                vertex.Score = ComputeScore(vertex);
+            }
+
+            bestTriangle = -1;
+            float bestScore = -1.0f;
+            for (int i = 0; i < newCount; ++i)
+            {
+                const VertexData& vertex = vertices[newCache[i]];
+                for (uint32_t j = 0; j < vertex.Remaining; ++j)
+                {
+                    uint32_t t = adjacency[vertex.FirstTriangle + j];
+                    float score = vertices[indices[t * 3]].Score + vertices[indices[t * 3 + 1]].Score +
+                                  vertices[indices[t * 3 + 2]].Score;
+                    triangleScores[t] = score;
+                    if (score > bestScore)
+                    {
+                        bestScore = score;
+                        bestTriangle = t;
+                    }
+                }
+            }
+
+            cacheCount = std::min(newCount, SCORE_CACHE_SIZE);
+            std::copy(newCache.begin(), newCache.begin() + cacheCount, cache.begin());
+        }
+
+        indices = std::move(output);
+        if (!measuring)
+            return;
+
+        Stats& stats = GetStats();
+        stats.Triangles += triangleCount;
+        stats.MissesBefore += missesBefore;
+        stats.MissesAfter += CountMisses(indices, vertexCount);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Earth::VertexCache
+{
+    // Size of the FIFO post-transform cache used to measure meshes. Most GPUs behave like a cache of
+    // this size or larger.
+    constexpr int CACHE_SIZE = 16;
+
+    // Average cache miss ratio (vertex shader invocations per triangle) over the meshes optimized while
+    // measuring.
+    struct Stats
+    {
+        std::atomic<uint64_t> Triangles = 0;
+        std::atomic<uint64_t> MissesBefore = 0;
+        std::atomic<uint64_t> MissesAfter = 0;
+
+        float GetACMRBefore() const
+        {
+            return Triangles ? (float)MissesBefore / (float)Triangles : 0.0f;
+        }
+        float GetACMRAfter() const
+        {
+            return Triangles ? (float)MissesAfter / (float)Triangles : 0.0f;
+        }
+    };
+
+    Stats& GetStats();
+
+    // Whether Optimize records the miss ratio before and after in GetStats(). Off by default, as it
+    // takes two more passes over every mesh.
+    void SetMeasuring(bool measuring);
+    bool IsMeasuring();
+
+    // Counts the vertex shader invocations a FIFO cache of `cacheSize` entries needs to draw `indices`.
+    size_t CountMisses(const std::vector<uint16_t>& indices, size_t vertexCount, int cacheSize = CACHE_SIZE);
+
+    // Reorders triangles to maximize post-transform cache hits, using Tom Forsyth's linear-speed
+    // vertex cache optimisation.
+    void Optimize(std::vector<uint16_t>& indices, size_t vertexCount);
+}